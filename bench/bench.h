@@ -0,0 +1,118 @@
+/* bench.h — Shared timing and reporting helpers for the bench/ harnesses
+ *
+ * Every result is one row: name, variant, size, ops, ns/op, ops/s and the
+ * process peak RSS so far. Rows print as JSON lines (default) or CSV so
+ * runs on different hardware can be diffed or loaded into a spreadsheet. */
+
+#ifndef VEX_BENCH_H
+#define VEX_BENCH_H
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#endif
+
+#define BENCH_JSON 0
+#define BENCH_CSV  1
+
+static int bench_format = BENCH_JSON;
+static int bench_header_done = 0;
+
+/* Sink for results the optimiser must not discard */
+static volatile uint64_t bench_sink;
+
+static inline uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Time-stamp counter, or 0 where there is none. On x86 this counts at the
+ * nominal clock, so cycles/byte is exact only with frequency scaling off. */
+static inline uint64_t bench_cycles(void) {
+#ifdef BENCH_HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/* Peak resident set size of this process in KB */
+static inline long bench_peak_rss_kb(void) {
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return -1;
+    return ru.ru_maxrss;
+}
+
+/* Deterministic 64-bit stream (splitmix64) for synthetic IDs and payloads */
+static inline uint64_t bench_rand(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/* Parse --format json|csv; returns 1 if argv[i] was consumed */
+static inline int bench_parse_format(int argc, char **argv, int *i) {
+    if (strcmp(argv[*i], "--format") != 0 || *i + 1 >= argc) return 0;
+    bench_format = strcmp(argv[++*i], "csv") == 0 ? BENCH_CSV : BENCH_JSON;
+    return 1;
+}
+
+static inline void bench_report(const char *name, const char *variant, long size,
+                                uint64_t ops, uint64_t elapsed_ns) {
+    double ns_per_op = ops ? (double)elapsed_ns / (double)ops : 0.0;
+    double ops_per_sec = elapsed_ns ? (double)ops * 1e9 / (double)elapsed_ns : 0.0;
+    long rss = bench_peak_rss_kb();
+
+    if (bench_format == BENCH_CSV) {
+        if (!bench_header_done) {
+            printf("name,variant,size,ops,ns_per_op,ops_per_sec,peak_rss_kb\n");
+            bench_header_done = 1;
+        }
+        printf("%s,%s,%ld,%llu,%.2f,%.0f,%ld\n", name, variant, size,
+               (unsigned long long)ops, ns_per_op, ops_per_sec, rss);
+    } else {
+        printf("{\"name\":\"%s\",\"variant\":\"%s\",\"size\":%ld,\"ops\":%llu,"
+               "\"ns_per_op\":%.2f,\"ops_per_sec\":%.0f,\"peak_rss_kb\":%ld}\n",
+               name, variant, size, (unsigned long long)ops, ns_per_op, ops_per_sec, rss);
+    }
+    fflush(stdout);
+}
+
+/* bench_report plus cycles/op and cycles/byte (-1 when no cycle counter) */
+static inline void bench_report_cycles(const char *name, const char *variant, long size,
+                                       uint64_t ops, uint64_t elapsed_ns, uint64_t cycles) {
+    double ns_per_op = ops ? (double)elapsed_ns / (double)ops : 0.0;
+    double ops_per_sec = elapsed_ns ? (double)ops * 1e9 / (double)elapsed_ns : 0.0;
+    double cyc_per_op = cycles && ops ? (double)cycles / (double)ops : -1.0;
+    double cyc_per_byte = cycles && ops && size > 0 ? cyc_per_op / (double)size : -1.0;
+    long rss = bench_peak_rss_kb();
+
+    if (bench_format == BENCH_CSV) {
+        if (!bench_header_done) {
+            printf("name,variant,size,ops,ns_per_op,ops_per_sec,cycles_per_op,"
+                   "cycles_per_byte,peak_rss_kb\n");
+            bench_header_done = 1;
+        }
+        printf("%s,%s,%ld,%llu,%.2f,%.0f,%.0f,%.2f,%ld\n", name, variant, size,
+               (unsigned long long)ops, ns_per_op, ops_per_sec, cyc_per_op, cyc_per_byte, rss);
+    } else {
+        printf("{\"name\":\"%s\",\"variant\":\"%s\",\"size\":%ld,\"ops\":%llu,"
+               "\"ns_per_op\":%.2f,\"ops_per_sec\":%.0f,\"cycles_per_op\":%.0f,"
+               "\"cycles_per_byte\":%.2f,\"peak_rss_kb\":%ld}\n",
+               name, variant, size, (unsigned long long)ops, ns_per_op, ops_per_sec,
+               cyc_per_op, cyc_per_byte, rss);
+    }
+    fflush(stdout);
+}
+
+#endif
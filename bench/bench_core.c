@@ -0,0 +1,389 @@
+/* bench_core.c — Seen-cache, packet-codec and send-path microbenchmarks
+ *
+ * Drives the dedup and codec hot paths with synthetic ID streams:
+ *   all_new     every ID unique, cache reset each time it fills
+ *   dup_heavy   --dup-ratio of lookups hit a recently added ID
+ *   full_evict  cache pre-filled to capacity, every add evicts
+ *
+ * The exact cache size is fixed at compile time (make bench SEEN_CAPACITY=N);
+ * the bloom backend is sized at runtime with --bloom-size.
+ *
+ * relay_fanout relays bursts to socketpair peers with and without the
+ * transport's per-peer batching and prints the write syscalls per relayed
+ * packet to stderr.
+ *
+ * Usage: vexbench [--ops N] [--dup-ratio R] [--bloom-size N] [--bloom-fp P]
+ *                 [--format json|csv] */
+
+#include "bench.h"
+#include "vex.h"
+#include "tweetnacl.h"
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#define SCEN_ALL_NEW    0
+#define SCEN_DUP_HEAVY  1
+#define SCEN_FULL_EVICT 2
+
+static const char *scenario_names[] = { "all_new", "dup_heavy", "full_evict" };
+
+/* Build an ID stream for a scenario. dup_heavy re-uses one of the last
+ * `window` unique IDs with probability dup_ratio. */
+static uint8_t *make_ids(int scenario, uint64_t ops, double dup_ratio, uint64_t window) {
+    uint8_t *ids = malloc(ops * 8);
+    uint64_t rng = 0x5eed0000 + (uint64_t)scenario;
+    uint64_t unique = 0;
+
+    if (!ids) return NULL;
+    for (uint64_t i = 0; i < ops; i++) {
+        uint64_t id;
+        int dup = scenario == SCEN_DUP_HEAVY && unique > 0 &&
+                  (double)(bench_rand(&rng) >> 11) / 9007199254740992.0 < dup_ratio;
+        if (dup) {
+            uint64_t span = unique < window ? unique : window;
+            uint64_t back = bench_rand(&rng) % span;
+            memcpy(&id, ids + (i - 1 - back) * 8, 8);
+        } else {
+            id = bench_rand(&rng);
+            unique++;
+        }
+        memcpy(ids + i * 8, &id, 8);
+    }
+    return ids;
+}
+
+/* Receive-path dedup: check, add if new. Mirrors vex_mesh_receive() */
+static void bench_seen_exact(int scenario, uint64_t ops, double dup_ratio) {
+    static vex_seen_cache_t cache;
+    uint8_t *ids = make_ids(scenario, ops, dup_ratio, VEX_SEEN_CAPACITY / 2);
+    uint64_t hits = 0, elapsed = 0;
+
+    if (!ids) return;
+    vex_seen_init(&cache);
+
+    if (scenario == SCEN_FULL_EVICT) {
+        uint64_t rng = 0xf111;
+        for (int i = 0; i < VEX_SEEN_CAPACITY; i++) {
+            uint64_t id = bench_rand(&rng) | 1ULL << 63;
+            vex_seen_add(&cache, (const uint8_t *)&id);
+        }
+    }
+
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < ops; i++) {
+        const uint8_t *id = ids + i * 8;
+        if (scenario == SCEN_ALL_NEW && cache.count == VEX_SEEN_CAPACITY) {
+            elapsed += bench_now_ns() - start;
+            vex_seen_init(&cache);
+            start = bench_now_ns();
+        }
+        if (vex_seen_check(&cache, id)) hits++;
+        else vex_seen_add(&cache, id);
+    }
+    elapsed += bench_now_ns() - start;
+    bench_sink += hits;
+
+    char variant[32];
+    snprintf(variant, sizeof(variant), "exact_%s", scenario_names[scenario]);
+    bench_report("seen_check_add", variant, VEX_SEEN_CAPACITY, ops, elapsed);
+    free(ids);
+}
+
+static void bench_seen_bloom(int scenario, uint64_t ops, double dup_ratio,
+                             uint32_t size, double fp) {
+    vex_bloom_t bf;
+    uint8_t *ids = make_ids(scenario, ops, dup_ratio, size / 2);
+    uint64_t hits = 0;
+
+    if (!ids) return;
+    if (vex_bloom_init(&bf, size, fp) != 0) {
+        free(ids);
+        return;
+    }
+
+    if (scenario == SCEN_FULL_EVICT) {
+        uint64_t rng = 0xf111;
+        for (uint32_t i = 0; i < size; i++) {
+            uint64_t id = bench_rand(&rng) | 1ULL << 63;
+            vex_bloom_add(&bf, (const uint8_t *)&id);
+        }
+    }
+
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < ops; i++) {
+        const uint8_t *id = ids + i * 8;
+        if (vex_bloom_check(&bf, id)) hits++;
+        else vex_bloom_add(&bf, id);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    bench_sink += hits;
+
+    char variant[32];
+    snprintf(variant, sizeof(variant), "bloom_%s", scenario_names[scenario]);
+    bench_report("seen_check_add", variant, size, ops, elapsed);
+    vex_bloom_free(&bf);
+    free(ids);
+}
+
+/* vex_seen_prune on a full cache with nothing due — the periodic cost */
+static void bench_seen_prune(uint64_t ops) {
+    static vex_seen_cache_t cache;
+    uint64_t rng = 0x9a9e;
+
+    vex_seen_init(&cache);
+    for (int i = 0; i < VEX_SEEN_CAPACITY; i++) {
+        uint64_t id = bench_rand(&rng);
+        vex_seen_add(&cache, (const uint8_t *)&id);
+    }
+
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < ops; i++) vex_seen_prune(&cache);
+    uint64_t elapsed = bench_now_ns() - start;
+    bench_sink += (uint64_t)cache.count;
+
+    bench_report("seen_prune", "exact_full", VEX_SEEN_CAPACITY, ops, elapsed);
+}
+
+static void bench_codec(uint64_t ops, uint16_t payload_len) {
+    vex_packet_t pkt, out;
+    vex_packet_view_t view;
+    uint8_t wire[VEX_MAX_PACKET];
+    uint64_t rng = payload_len;
+    char variant[32];
+
+    pkt.version = VEX_VERSION;
+    pkt.ttl = VEX_DEFAULT_TTL;
+    pkt.flags = VEX_FLAG_ENCRYPTED | VEX_FLAG_BROADCAST;
+    pkt.payload_len = payload_len;
+    for (uint16_t i = 0; i < payload_len; i++) pkt.payload[i] = (uint8_t)bench_rand(&rng);
+    memset(pkt.packet_id, 0xab, 8);
+
+    snprintf(variant, sizeof(variant), "payload_%u", payload_len);
+
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < ops; i++) {
+        pkt.ttl = (uint8_t)i;
+        bench_sink += (uint64_t)vex_packet_encode(&pkt, wire, sizeof(wire));
+    }
+    bench_report("packet_encode", variant, payload_len, ops, bench_now_ns() - start);
+
+    int wire_len = vex_packet_encode(&pkt, wire, sizeof(wire));
+
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < ops; i++) {
+        wire[VEX_TTL_OFFSET] = (uint8_t)i;
+        bench_sink += (uint64_t)vex_packet_decode(wire, (size_t)wire_len, &out) + out.ttl;
+    }
+    bench_report("packet_decode", variant, payload_len, ops, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < ops; i++) {
+        wire[VEX_TTL_OFFSET] = (uint8_t)i;
+        bench_sink += (uint64_t)vex_packet_decode_view(wire, (size_t)wire_len, &view) + view.ttl;
+    }
+    bench_report("packet_decode_view", variant, payload_len, ops, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < ops; i++) {
+        vex_packet_make_id(pkt.payload, payload_len, out.packet_id);
+        bench_sink += out.packet_id[0];
+    }
+    snprintf(variant, sizeof(variant), "siphash_payload_%u", payload_len);
+    bench_report("packet_make_id", variant, payload_len, ops, bench_now_ns() - start);
+
+    /* SHA-512 is far slower — scale the op count down */
+    uint64_t id_ops = ops / 20 ? ops / 20 : 1;
+    vex_packet_set_id_scheme(VEX_ID_SHA512);
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < id_ops; i++) {
+        vex_packet_make_id(pkt.payload, payload_len, out.packet_id);
+        bench_sink += out.packet_id[0];
+    }
+    snprintf(variant, sizeof(variant), "sha512_payload_%u", payload_len);
+    bench_report("packet_make_id", variant, payload_len, id_ops, bench_now_ns() - start);
+    vex_packet_set_id_scheme(VEX_ID_SIPHASH);
+}
+
+/* The pre-pool randombytes(): open/read/close /dev/urandom per call */
+static void urandom_per_call(uint8_t *x, size_t len) {
+    int fd = open("/dev/urandom", O_RDONLY);
+    if (fd < 0) return;
+    bench_sink += (uint64_t)read(fd, x, len);
+    close(fd);
+}
+
+/* The two draws every send makes: 24-byte secretbox nonce, 8-byte ID nonce */
+static void bench_random(uint64_t ops) {
+    uint8_t buf[24];
+
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < ops; i++) {
+        randombytes(buf, 24);
+        randombytes(buf, 8);
+        bench_sink += buf[0];
+    }
+    bench_report("randombytes_24_8", "pool", 32, ops, bench_now_ns() - start);
+
+    uint64_t slow_ops = ops / 20 ? ops / 20 : 1;
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < slow_ops; i++) {
+        urandom_per_call(buf, 24);
+        urandom_per_call(buf, 8);
+        bench_sink += buf[0];
+    }
+    bench_report("randombytes_24_8", "urandom_per_call", 32, slow_ops, bench_now_ns() - start);
+}
+
+/* Full vex_mesh_send() on a node with no peers: encrypt, ID, dedup, encode.
+ * Per-send log lines go to /dev/null while timing. */
+static void bench_mesh_send(uint64_t ops, size_t msg_len, int id_scheme) {
+    const char *scheme_name = id_scheme == VEX_ID_SHA512 ? "sha512" : "siphash";
+    static vex_node_t node;
+    char msg[VEX_MAX_PAYLOAD];
+    char variant[32];
+
+    memset(&node, 0, sizeof(node));
+    vex_seen_init(&node.seen);
+    vex_crypto_init(&node);
+    node.default_ttl = VEX_DEFAULT_TTL;
+
+    vex_packet_set_id_scheme(id_scheme);
+    memset(msg, 'x', msg_len);
+    msg[msg_len] = '\0';
+
+    int saved_stderr = dup(STDERR_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    if (devnull >= 0) dup2(devnull, STDERR_FILENO);
+
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < ops; i++) {
+        msg[0] = (char)('a' + i % 26);
+        bench_sink += (uint64_t)vex_mesh_send(&node, msg);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+
+    if (saved_stderr >= 0) {
+        dup2(saved_stderr, STDERR_FILENO);
+        close(saved_stderr);
+    }
+    if (devnull >= 0) close(devnull);
+    vex_packet_set_id_scheme(VEX_ID_SIPHASH);
+
+    snprintf(variant, sizeof(variant), "%s_msg_%zu", scheme_name, msg_len);
+    bench_report("mesh_send", variant, (long)msg_len, ops, elapsed);
+}
+
+/* Relay bursts of packets to `peers` socketpair peers. Unbatched, every
+ * frame is one writev per peer; batched, a burst costs one write per peer
+ * at the flush that ends the loop turn. Draining the far ends is untimed. */
+static void bench_relay_fanout(uint64_t ops, int peers, int burst, int batched) {
+    static vex_node_t node;
+    int far[VEX_MAX_PEERS];
+    uint8_t wire[VEX_MAX_PACKET], sink[16384];
+    uint64_t rng = 0xfa17;
+    char variant[32];
+
+    int saved_stderr = dup(STDERR_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    if (devnull >= 0) dup2(devnull, STDERR_FILENO);
+
+    memset(&node, 0, sizeof(node));
+    for (int i = 0; i < peers; i++) {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return;
+        vex_transport_add_peer(&node, sv[0], "bench");
+        far[i] = sv[1];
+        fcntl(sv[1], F_SETFL, O_NONBLOCK);
+    }
+
+    wire[0] = VEX_VERSION;
+    for (int i = 1; i < VEX_MAX_PACKET; i++) wire[i] = (uint8_t)bench_rand(&rng);
+    wire[VEX_HEADER_SIZE - 1] = VEX_FLAG_ENCRYPTED | VEX_FLAG_BROADCAST;
+    size_t len = VEX_HEADER_SIZE + 128;
+
+    uint64_t frames0, writes0, frames1, writes1, dropped, elapsed = 0;
+    vex_transport_set_batching(batched);
+    vex_transport_counters(&frames0, &writes0, &dropped);
+
+    for (uint64_t done = 0; done < ops; done += (uint64_t)burst) {
+        uint64_t start = bench_now_ns();
+        for (int b = 0; b < burst; b++) {
+            wire[VEX_TTL_OFFSET] = VEX_DEFAULT_TTL;
+            bench_sink += (uint64_t)vex_mesh_relay(&node, wire, len, -1);
+        }
+        vex_transport_flush_all(&node);
+        elapsed += bench_now_ns() - start;
+
+        for (int i = 0; i < peers; i++)
+            while (read(far[i], sink, sizeof(sink)) > 0) {}
+    }
+
+    vex_transport_counters(&frames1, &writes1, &dropped);
+    vex_transport_set_batching(0);
+
+    if (saved_stderr >= 0) {
+        dup2(saved_stderr, STDERR_FILENO);
+        close(saved_stderr);
+    }
+    if (devnull >= 0) close(devnull);
+
+    uint64_t relayed = ops / (uint64_t)burst * (uint64_t)burst;
+    snprintf(variant, sizeof(variant), "%s_burst_%d", batched ? "batched" : "writev", burst);
+    bench_report("relay_fanout", variant, peers, relayed, elapsed);
+    fprintf(stderr, "# relay_fanout %s peers=%d: %.3f writes/packet, %.3f writes/frame\n",
+            variant, peers, relayed ? (double)(writes1 - writes0) / (double)relayed : 0.0,
+            frames1 > frames0 ? (double)(writes1 - writes0) / (double)(frames1 - frames0) : 0.0);
+
+    for (int i = 0; i < peers; i++) {
+        close(node.peers[i].fd);
+        close(far[i]);
+    }
+}
+
+int main(int argc, char **argv) {
+    uint64_t ops = 1000000;
+    double dup_ratio = 0.9;
+    uint32_t bloom_size = VEX_BLOOM_DEFAULT_CAPACITY;
+    double bloom_fp = VEX_BLOOM_DEFAULT_FP;
+
+    for (int i = 1; i < argc; i++) {
+        if (bench_parse_format(argc, argv, &i)) continue;
+        if (i + 1 < argc && strcmp(argv[i], "--ops") == 0) ops = strtoull(argv[++i], NULL, 10);
+        else if (i + 1 < argc && strcmp(argv[i], "--dup-ratio") == 0) dup_ratio = atof(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--bloom-size") == 0) bloom_size = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (i + 1 < argc && strcmp(argv[i], "--bloom-fp") == 0) bloom_fp = atof(argv[++i]);
+        else {
+            fprintf(stderr, "Usage: %s [--ops N] [--dup-ratio R] [--bloom-size N] "
+                            "[--bloom-fp P] [--format json|csv]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (ops == 0) ops = 1;
+
+    for (int s = SCEN_ALL_NEW; s <= SCEN_FULL_EVICT; s++) bench_seen_exact(s, ops, dup_ratio);
+    for (int s = SCEN_ALL_NEW; s <= SCEN_FULL_EVICT; s++)
+        bench_seen_bloom(s, ops, dup_ratio, bloom_size, bloom_fp);
+    bench_seen_prune(ops);
+
+    bench_codec(ops, 32);
+    bench_codec(ops, 256);
+    bench_codec(ops, VEX_MAX_PAYLOAD);
+
+    bench_random(ops);
+
+    /* vex_mesh_send is dominated by crypto — scale the op count down */
+    uint64_t send_ops = ops / 50 ? ops / 50 : 1;
+    bench_mesh_send(send_ops, 32, VEX_ID_SIPHASH);
+    bench_mesh_send(send_ops, 32, VEX_ID_SHA512);
+    bench_mesh_send(send_ops, VEX_MAX_PAYLOAD - 100, VEX_ID_SIPHASH);
+    bench_mesh_send(send_ops, VEX_MAX_PAYLOAD - 100, VEX_ID_SHA512);
+
+    /* Fanout is syscall-bound — scale the op count down */
+    uint64_t relay_ops = ops / 10 ? ops / 10 : 16;
+    bench_relay_fanout(relay_ops, 8, 16, 0);
+    bench_relay_fanout(relay_ops, 8, 16, 1);
+
+    return 0;
+}
@@ -0,0 +1,130 @@
+/* bench_crypto.c — Crypto throughput benchmarks for hardware sizing
+ *
+ * Times the broadcast seal/open path at message sizes from 16 bytes up to
+ * the largest message that fits a VEX_MAX_PAYLOAD payload, plus the
+ * primitives behind key setup and IDs: crypto_box_keypair,
+ * crypto_sign_keypair, crypto_scalarmult and crypto_hash. Each row adds
+ * cycles/op and cycles/byte (time-stamp counter; -1 where there is none).
+ *
+ * --ref pins the TweetNaCl reference kernels, giving the baseline that any
+ * faster backend is judged against; the variant column names the kernels.
+ *
+ * Usage: vexbench-crypto [--ops N] [--ref] [--format json|csv] */
+
+#include "bench.h"
+#include "vex.h"
+#include "tweetnacl.h"
+#include <stdlib.h>
+
+static const uint16_t msg_sizes[] = { 16, 64, 128, 256, 384, VEX_MAX_PAYLOAD - VEX_SEAL_OVERHEAD };
+
+static uint64_t t_ns, t_cyc;
+
+static void timer_start(void) {
+    t_ns = bench_now_ns();
+    t_cyc = bench_cycles();
+}
+
+static void timer_report(const char *name, const char *variant, long size, uint64_t ops) {
+    uint64_t cyc = bench_cycles() - t_cyc;
+    uint64_t ns = bench_now_ns() - t_ns;
+    bench_report_cycles(name, variant, size, ops, ns, cyc);
+}
+
+static void bench_broadcast(const vex_node_t *node, uint64_t ops, uint16_t len) {
+    uint8_t plain[VEX_MAX_PAYLOAD], cipher[VEX_MAX_PAYLOAD], out[VEX_MAX_PAYLOAD];
+    uint16_t cipher_len = 0, out_len = 0;
+    uint64_t seed = len;
+    const char *variant = vex_crypto_accel_name();
+
+    for (uint16_t i = 0; i < len; i++) plain[i] = (uint8_t)bench_rand(&seed);
+
+    timer_start();
+    for (uint64_t i = 0; i < ops; i++) {
+        plain[0] = (uint8_t)i;
+        vex_crypto_encrypt_broadcast(node, plain, len, cipher, &cipher_len);
+        bench_sink += cipher[cipher_len - 1];
+    }
+    timer_report("encrypt_broadcast", variant, len, ops);
+
+    timer_start();
+    for (uint64_t i = 0; i < ops; i++) {
+        if (vex_crypto_decrypt_broadcast(node, cipher, cipher_len, out, &out_len) == 0)
+            bench_sink += out_len;
+    }
+    timer_report("decrypt_broadcast", variant, len, ops);
+}
+
+static void bench_keys(uint64_t ops) {
+    uint8_t pk[crypto_sign_PUBLICKEYBYTES], sk[crypto_sign_SECRETKEYBYTES];
+    uint8_t q[crypto_scalarmult_BYTES], n[crypto_scalarmult_BYTES];
+
+    timer_start();
+    for (uint64_t i = 0; i < ops; i++) {
+        crypto_box_keypair(pk, sk);
+        bench_sink += pk[0];
+    }
+    timer_report("crypto_box_keypair", "tweetnacl", 0, ops);
+
+    timer_start();
+    for (uint64_t i = 0; i < ops; i++) {
+        crypto_sign_keypair(pk, sk);
+        bench_sink += pk[0];
+    }
+    timer_report("crypto_sign_keypair", "tweetnacl", 0, ops);
+
+    /* Shared-secret step of crypto_box: our secret times a peer's public key */
+    crypto_box_keypair(pk, sk);
+    memcpy(n, sk, sizeof(n));
+    timer_start();
+    for (uint64_t i = 0; i < ops; i++) {
+        crypto_scalarmult(q, n, pk);
+        bench_sink += q[0];
+    }
+    timer_report("crypto_scalarmult", "tweetnacl", 0, ops);
+}
+
+static void bench_hash(uint64_t ops, uint16_t len) {
+    uint8_t msg[VEX_MAX_PAYLOAD], out[crypto_hash_BYTES];
+    uint64_t seed = len;
+
+    for (uint16_t i = 0; i < len; i++) msg[i] = (uint8_t)bench_rand(&seed);
+
+    timer_start();
+    for (uint64_t i = 0; i < ops; i++) {
+        msg[0] = (uint8_t)i;
+        crypto_hash(out, msg, len);
+        bench_sink += out[0];
+    }
+    timer_report("crypto_hash", "sha512", len, ops);
+}
+
+int main(int argc, char **argv) {
+    uint64_t ops = 100000;
+    static vex_node_t node;
+
+    for (int i = 1; i < argc; i++) {
+        if (bench_parse_format(argc, argv, &i)) continue;
+        if (i + 1 < argc && strcmp(argv[i], "--ops") == 0) ops = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--ref") == 0) vex_crypto_accel_disable();
+        else {
+            fprintf(stderr, "Usage: %s [--ops N] [--ref] [--format json|csv]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (ops == 0) ops = 1;
+
+    vex_crypto_init(&node);
+
+    for (size_t i = 0; i < sizeof(msg_sizes) / sizeof(msg_sizes[0]); i++)
+        bench_broadcast(&node, ops, msg_sizes[i]);
+
+    bench_hash(ops, 64);
+    bench_hash(ops, VEX_MAX_PAYLOAD);
+
+    /* Curve operations run at milliseconds apiece — scale the op count down */
+    uint64_t key_ops = ops / 1000 ? ops / 1000 : 1;
+    bench_keys(key_ops);
+
+    return 0;
+}
@@ -0,0 +1,344 @@
+/* bench_transport.c — Relay I/O: epoll/poll readiness path vs io_uring,
+ * and stream framing vs SOCK_SEQPACKET datagrams
+ *
+ * One socketpair peer injects a burst of packets; the node receives them,
+ * runs vex_mesh_receive (dedup + relay) and fans each out to every other
+ * peer, then flushes. A round ends when every send has completed; draining
+ * the far ends is untimed. Rows are per relayed packet at 8, 32 and 256
+ * peers, and stderr gets the syscalls each packet cost.
+ *
+ * Built with VEX_MAX_PEERS=256, and URING=1 for the io_uring rows; with
+ * io_uring missing from the build or kernel those rows are skipped. The
+ * seqpacket rows run the datagram transport on the epoll loop.
+ *
+ * The coalesce rows trade latency for transmissions: a source paced at
+ * --rates feeds 75-byte packets (a short chat message) to a node with 8
+ * peers, coalescing off or packing with a 0, 1 or 5 ms window, and one far
+ * end times each packet from its send. Rate 0 sends as fast as the node
+ * keeps up, for throughput. Rows are delivered packets per second; stderr
+ * gets latency p50/p99, packets per frame and write syscalls per packet.
+ *
+ * Usage: vexbench-transport [--ops N] [--burst B] [--rates R,R,...]
+ *                           [--format json|csv] */
+
+#include "bench.h"
+#include "vex.h"
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+static const int peer_counts[] = { 8, 32, 256 };
+
+#define IO_EPOLL     0      /* stream sockets, readiness loop */
+#define IO_URING     1      /* stream sockets, io_uring */
+#define IO_SEQPACKET 2      /* SOCK_SEQPACKET, recvmmsg/sendmmsg */
+
+static const char *io_names[] = { NULL, "io_uring", "seqpacket" };
+
+static vex_node_t node;
+static vex_reactor_t reactor;
+static int far_fd[VEX_MAX_PEERS];
+static uint64_t frames_in, reads;
+static FILE *note;               /* the real stderr; fd 2 goes to /dev/null */
+
+static void on_frame(void *ctx, vex_peer_t *peer, uint8_t *frame, size_t len) {
+    (void)ctx;
+    vex_mesh_receive(&node, frame, len, peer->fd);
+    frames_in++;
+}
+
+static void on_peer(void *ctx, int fd, uint32_t events) {
+    (void)fd; (void)events;
+    reads++;
+    vex_transport_read(ctx, on_frame, NULL);
+}
+
+static int setup(int peers, int io) {
+    int uring = io == IO_URING;
+    memset(&node, 0, sizeof(node));
+    vex_seen_init(&node.seen);
+    node.relay_enabled = 1;
+    vex_reactor_init(&reactor);
+    vex_transport_set_mode(io == IO_SEQPACKET ? VEX_SOCK_SEQPACKET : VEX_SOCK_STREAM);
+
+    if (uring && vex_transport_uring_init(&node, on_frame, NULL) != 0) return -1;
+
+    for (int i = 0; i < peers; i++) {
+        int sv[2];
+        if (socketpair(AF_UNIX, io == IO_SEQPACKET ? SOCK_SEQPACKET : SOCK_STREAM, 0, sv) != 0)
+            return -1;
+        int slot = vex_transport_add_peer(&node, sv[0], "bench");
+        if (!uring) vex_reactor_add(&reactor, sv[0], VEX_IO_READ, on_peer, &node.peers[slot]);
+        far_fd[i] = sv[1];
+        fcntl(sv[1], F_SETFL, O_NONBLOCK);
+    }
+    return 0;
+}
+
+static void teardown(int peers) {
+    for (int i = 0; i < VEX_MAX_PEERS; i++) {
+        if (!node.peers[i].active) continue;
+        vex_reactor_del(&reactor, node.peers[i].fd);
+        vex_transport_close_peer(&node.peers[i]);
+    }
+    for (int i = 0; i < peers; i++) close(far_fd[i]);
+    vex_transport_uring_close();
+    vex_reactor_close(&reactor);
+}
+
+static int sends_pending(int peers) {
+    for (int i = 0; i < peers; i++)
+        if (node.peers[i].tx_count > 0) return 1;
+    return 0;
+}
+
+static void bench_relay_io(uint64_t ops, int burst, int peers, int io) {
+    int uring = io == IO_URING;
+    uint8_t frames[64 * (2 + VEX_MAX_PACKET)], sink[65536];
+    uint64_t rng = 0x10 + (uint64_t)peers;
+    size_t pkt_len = VEX_HEADER_SIZE + 128;
+    size_t frame_len = 2 + pkt_len;
+
+    if (setup(peers, io) != 0) {
+        teardown(peers);
+        return;
+    }
+
+    uint64_t f0, w0, d0, f1, w1, d1;
+    vex_transport_counters(&f0, &w0, &d0);
+    uint64_t enters0 = vex_transport_uring_enters();
+    uint64_t wakeups0 = reactor.wakeups;
+    reads = 0;
+
+    uint64_t elapsed = 0, relayed = 0;
+    while (relayed < ops) {
+        /* Untimed: the source peer writes a burst of fresh packets */
+        for (int b = 0; b < burst; b++) {
+            uint8_t *f = frames + (size_t)b * frame_len;
+            f[0] = (uint8_t)(pkt_len >> 8);
+            f[1] = (uint8_t)pkt_len;
+            f[2] = VEX_VERSION;
+            for (int i = 1; i < (int)pkt_len; i++) f[2 + i] = (uint8_t)bench_rand(&rng);
+            f[2 + VEX_TTL_OFFSET] = VEX_DEFAULT_TTL;
+            f[2 + VEX_HEADER_SIZE - 1] = VEX_FLAG_BROADCAST;
+        }
+        if (io == IO_SEQPACKET) {
+            for (int b = 0; b < burst; b++)
+                if (write(far_fd[0], frames + (size_t)b * frame_len + 2, pkt_len) < 0) break;
+        } else if (write(far_fd[0], frames, (size_t)burst * frame_len) < 0) {
+            break;
+        }
+        frames_in = 0;
+
+        /* Timed: receive, relay, flush, all sends complete */
+        uint64_t start = bench_now_ns();
+        while (frames_in < (uint64_t)burst) {
+            if (uring) vex_transport_uring_reap(1);
+            else vex_reactor_run_once(&reactor, -1);
+        }
+        vex_transport_flush_all(&node);
+        while (sends_pending(peers)) {
+            if (uring) vex_transport_uring_reap(1);
+            else vex_transport_flush_all(&node);
+        }
+        elapsed += bench_now_ns() - start;
+        relayed += (uint64_t)burst;
+
+        for (int i = 1; i < peers; i++)
+            while (read(far_fd[i], sink, sizeof(sink)) > 0) {}
+    }
+
+    vex_transport_counters(&f1, &w1, &d1);
+    uint64_t syscalls = uring ? vex_transport_uring_enters() - enters0
+                              : (reactor.wakeups - wakeups0) + reads + (w1 - w0);
+    const char *variant = io_names[io] ? io_names[io] : vex_reactor_backend(&reactor);
+
+    bench_report("relay_io", variant, peers, relayed, elapsed);
+    uint32_t pool_used, pool_peak;
+    uint64_t pool_misses;
+    vex_pool_stats(&pool_used, &pool_peak, &pool_misses);
+    fprintf(note, "# relay_io %s peers=%d: %.3f syscalls/packet, %llu frames shed, "
+            "%u pooled buffers at peak\n",
+            variant, peers, relayed ? (double)syscalls / (double)relayed : 0.0,
+            (unsigned long long)(d1 - d0), pool_peak);
+    teardown(peers);
+}
+
+/* ── Coalescing: latency against throughput ── */
+
+#define COALESCE_PEERS     8
+#define COALESCE_PAYLOAD   64
+#define COALESCE_ROW_NS    500000000ULL  /* paced rows run this long */
+#define COALESCE_INFLIGHT  256           /* rate 0: unreceived packets allowed */
+
+static const int coalesce_windows[] = { -1, 0, 1, 5 };  /* -1 = off */
+
+typedef struct {
+    uint8_t  buf[65536];
+    size_t   len;
+    uint64_t *sent_at, *latency;
+    uint64_t got, frames;
+} far_end_t;
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void far_packet(far_end_t *fe, const uint8_t *pkt, size_t len, uint64_t ops,
+                       uint64_t now) {
+    if (len < VEX_HEADER_SIZE) return;
+    uint32_t seq = (uint32_t)pkt[1] << 24 | (uint32_t)pkt[2] << 16 | (uint32_t)pkt[3] << 8 | pkt[4];
+    if (seq < ops) fe->latency[fe->got++] = now - fe->sent_at[seq];
+}
+
+/* Read what the node sent the timed far end; split frames and
+ * multi-packet frames, and time each packet */
+static void far_read(far_end_t *fe, int fd, uint64_t ops) {
+    ssize_t n;
+    while ((n = read(fd, fe->buf + fe->len, sizeof(fe->buf) - fe->len)) > 0) {
+        uint64_t now = bench_now_ns();
+        size_t off = 0;
+        fe->len += (size_t)n;
+        while (fe->len - off >= 2) {
+            size_t flen = (size_t)fe->buf[off] << 8 | fe->buf[off + 1];
+            if (fe->len - off < 2 + flen) break;
+            const uint8_t *f = fe->buf + off + 2;
+            fe->frames++;
+            if (flen > 0 && f[0] == VEX_COALESCED) {
+                for (size_t p = 1; p + 2 <= flen;) {
+                    size_t plen = (size_t)f[p] << 8 | f[p + 1];
+                    if (p + 2 + plen > flen) break;
+                    far_packet(fe, f + p + 2, plen, ops, now);
+                    p += 2 + plen;
+                }
+            } else {
+                far_packet(fe, f, flen, ops, now);
+            }
+            off += 2 + flen;
+        }
+        memmove(fe->buf, fe->buf + off, fe->len - off);
+        fe->len -= off;
+    }
+}
+
+static void bench_coalesce(uint64_t ops, int window, long rate) {
+    static far_end_t fe;
+    uint8_t frame[2 + VEX_MAX_PACKET], sink[65536];
+    size_t pkt_len = VEX_HEADER_SIZE + COALESCE_PAYLOAD;
+    uint64_t rng = 0xC0A1 + (uint64_t)window;
+    char variant[16];
+
+    if (rate > 0) ops = (uint64_t)rate * COALESCE_ROW_NS / 1000000000ULL;
+    if (ops == 0) ops = 1;
+    if (window < 0) snprintf(variant, sizeof(variant), "off");
+    else snprintf(variant, sizeof(variant), "%dms", window);
+
+    memset(&fe, 0, sizeof(fe));
+    fe.sent_at = calloc(ops, sizeof(uint64_t));
+    fe.latency = calloc(ops, sizeof(uint64_t));
+    if (!fe.sent_at || !fe.latency || setup(COALESCE_PEERS, IO_EPOLL) != 0) {
+        free(fe.sent_at);
+        free(fe.latency);
+        teardown(COALESCE_PEERS);
+        return;
+    }
+    vex_transport_set_coalesce(window < 0 ? 0 : window, window < 0 ? 0 : VEX_MAX_PACKET);
+
+    uint64_t f0, w0, d0, f1, w1, d1;
+    vex_transport_counters(&f0, &w0, &d0);
+
+    uint64_t sent = 0, gap = rate > 0 ? 1000000000ULL / (uint64_t)rate : 0;
+    uint64_t start = bench_now_ns(), next = start, last_sent = start;
+    while (fe.got < ops) {
+        uint64_t now = bench_now_ns();
+        while (sent < ops && (rate > 0 ? now >= next : sent - fe.got < COALESCE_INFLIGHT)) {
+            frame[0] = (uint8_t)(pkt_len >> 8);
+            frame[1] = (uint8_t)pkt_len;
+            frame[2] = VEX_VERSION;
+            for (int i = 1; i < (int)pkt_len; i++) frame[2 + i] = (uint8_t)bench_rand(&rng);
+            frame[3] = (uint8_t)(sent >> 24);
+            frame[4] = (uint8_t)(sent >> 16);
+            frame[5] = (uint8_t)(sent >> 8);
+            frame[6] = (uint8_t)sent;
+            frame[2 + VEX_TTL_OFFSET] = VEX_DEFAULT_TTL;
+            frame[2 + VEX_HEADER_SIZE - 1] = VEX_FLAG_BROADCAST;
+            if (write(far_fd[0], frame, 2 + pkt_len) < 0) break;
+            fe.sent_at[sent++] = now;
+            last_sent = now;
+            next += gap;
+        }
+        if (sent == ops && now - last_sent > 1000000000ULL) break;  /* the rest are lost */
+
+        vex_reactor_run_once(&reactor, 0);
+        vex_transport_flush_all(&node);
+        far_read(&fe, far_fd[1], ops);
+        for (int i = 2; i < COALESCE_PEERS; i++)
+            while (read(far_fd[i], sink, sizeof(sink)) > 0) {}
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    vex_transport_counters(&f1, &w1, &d1);
+    vex_transport_set_coalesce(0, 0);
+
+    bench_report("coalesce", variant, rate, fe.got, elapsed);
+    qsort(fe.latency, fe.got, sizeof(uint64_t), cmp_u64);
+    double p50 = fe.got ? (double)fe.latency[fe.got / 2] / 1000.0 : 0.0;
+    double p99 = fe.got ? (double)fe.latency[fe.got * 99 / 100] / 1000.0 : 0.0;
+    fprintf(note, "# coalesce %s rate=%ld: p50 %.1fus, p99 %.1fus, %.2f packets/frame, "
+            "%.3f writes/packet, %llu of %llu lost\n",
+            variant, rate, p50, p99, fe.frames ? (double)fe.got / (double)fe.frames : 0.0,
+            fe.got ? (double)(w1 - w0) / (double)fe.got : 0.0,
+            (unsigned long long)(ops - fe.got), (unsigned long long)ops);
+    free(fe.sent_at);
+    free(fe.latency);
+    teardown(COALESCE_PEERS);
+}
+
+int main(int argc, char **argv) {
+    uint64_t ops = 20000;
+    int burst = 16;
+    long rates[8] = { 2000, 20000, 0 };
+    int nrates = 3;
+
+    for (int i = 1; i < argc; i++) {
+        if (bench_parse_format(argc, argv, &i)) continue;
+        if (i + 1 < argc && strcmp(argv[i], "--ops") == 0) ops = strtoull(argv[++i], NULL, 10);
+        else if (i + 1 < argc && strcmp(argv[i], "--burst") == 0) burst = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--rates") == 0) {
+            char *p = argv[++i];
+            for (nrates = 0; nrates < 8 && *p; nrates++) {
+                rates[nrates] = strtol(p, &p, 10);
+                if (*p == ',') p++;
+            }
+        } else {
+            fprintf(stderr, "Usage: %s [--ops N] [--burst B] [--rates R,R,...] "
+                    "[--format json|csv]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (ops == 0) ops = 1;
+    if (burst < 1 || burst > 64) burst = 16;
+
+    /* Per-packet relay logs go to /dev/null; results are on stdout */
+    int saved_stderr = dup(STDERR_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    if (devnull >= 0) dup2(devnull, STDERR_FILENO);
+    note = saved_stderr >= 0 ? fdopen(saved_stderr, "w") : stderr;
+    setvbuf(note, NULL, _IOLBF, 0);
+
+    vex_transport_set_batching(1);
+    for (size_t n = 0; n < sizeof(peer_counts) / sizeof(peer_counts[0]); n++) {
+        if (peer_counts[n] > VEX_MAX_PEERS) continue;
+        /* Scale rounds down with fanout so each row takes similar time */
+        uint64_t row_ops = ops * 8 / (uint64_t)peer_counts[n];
+        if (row_ops < (uint64_t)burst) row_ops = (uint64_t)burst;
+        for (int io = IO_EPOLL; io <= IO_SEQPACKET; io++)
+            bench_relay_io(row_ops, burst, peer_counts[n], io);
+    }
+    for (int r = 0; r < nrates; r++)
+        for (size_t w = 0; w < sizeof(coalesce_windows) / sizeof(coalesce_windows[0]); w++)
+            bench_coalesce(ops, coalesce_windows[w], rates[r]);
+    return 0;
+}
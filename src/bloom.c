@@ -0,0 +1,164 @@
+/* bloom.c — Rotating Bloom filter backend for the seen cache
+ *
+ * For gateways that must remember far more packet IDs than the exact
+ * cache holds. Memory is split into VEX_BLOOM_SLICES equal filters; new
+ * IDs go into the current slice and a lookup checks all of them. Every
+ * VEX_SEEN_TTL_SEC / (slices - 1) seconds the oldest slice is wiped and
+ * becomes current, so an ID is remembered for 60–80s. A slice that fills
+ * up before its time rotates early, trading window length for a bounded
+ * false-positive rate, just as the exact cache evicts when full. */
+
+#include "vex.h"
+#include "tweetnacl.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#define BLOOM_MAX_HASHES 16
+#define BLOOM_LN2        0.69314718055994530942
+
+static uint64_t mix64(uint64_t h) {
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+/* Map a 32-bit hash onto [0, n) without a division */
+static uint32_t reduce(uint32_t h, uint32_t n) {
+    return (uint32_t)(((uint64_t)h * n) >> 32);
+}
+
+static uint64_t *slice_words(const vex_bloom_t *bf, int slice) {
+    return bf->bits + (size_t)slice * bf->slice_words;
+}
+
+static void slice_clear(vex_bloom_t *bf, int slice) {
+    memset(slice_words(bf, slice), 0, bf->slice_words * sizeof(uint64_t));
+    bf->slice_set[slice] = 0;
+    bf->slice_items[slice] = 0;
+}
+
+static void rotate(vex_bloom_t *bf) {
+    bf->current = (bf->current + 1) % VEX_BLOOM_SLICES;
+    slice_clear(bf, bf->current);
+}
+
+/* Rotate once per elapsed slice period; a long gap clears everything */
+static void advance(vex_bloom_t *bf, time_t now) {
+    int steps = 0;
+    while (now - bf->rotated_at >= bf->rotate_sec && steps < VEX_BLOOM_SLICES) {
+        rotate(bf);
+        bf->rotated_at += bf->rotate_sec;
+        steps++;
+    }
+    if (now - bf->rotated_at >= bf->rotate_sec) bf->rotated_at = now;
+}
+
+int vex_bloom_init(vex_bloom_t *bf, uint32_t capacity, double fp_rate) {
+    memset(bf, 0, sizeof(*bf));
+    if (capacity == 0 || fp_rate <= 0.0 || fp_rate >= 1.0) return -1;
+
+    /* An ID spans at most every slice, so each gets an equal share of the
+     * false-positive budget and (slices - 1) periods' worth of items */
+    double per_slice_fp = 1.0 - pow(1.0 - fp_rate, 1.0 / VEX_BLOOM_SLICES);
+    uint32_t items = (capacity + VEX_BLOOM_SLICES - 2) / (VEX_BLOOM_SLICES - 1);
+    double bits = ceil(-(double)items * log(per_slice_fp) / (BLOOM_LN2 * BLOOM_LN2));
+    if (bits > (double)UINT32_MAX - 64) return -1;
+
+    bf->slice_words = ((uint32_t)bits + 63) / 64;
+    bf->slice_bits = bf->slice_words * 64;
+    bf->slice_capacity = items;
+    bf->hashes = (int)lround((double)bf->slice_bits / items * BLOOM_LN2);
+    if (bf->hashes < 1) bf->hashes = 1;
+    if (bf->hashes > BLOOM_MAX_HASHES) bf->hashes = BLOOM_MAX_HASHES;
+
+    bf->bits = calloc((size_t)bf->slice_words * VEX_BLOOM_SLICES, sizeof(uint64_t));
+    if (!bf->bits) return -1;
+
+    bf->rotate_sec = (VEX_SEEN_TTL_SEC + VEX_BLOOM_SLICES - 2) / (VEX_BLOOM_SLICES - 1);
+    bf->rotated_at = time(NULL);
+    bf->target_fp = fp_rate;
+    randombytes((uint8_t *)&bf->seed, sizeof(bf->seed));
+    return 0;
+}
+
+void vex_bloom_free(vex_bloom_t *bf) {
+    free(bf->bits);
+    bf->bits = NULL;
+}
+
+/* Check if packet_id has (probably) been seen. Returns 1 if seen, 0 if new */
+int vex_bloom_check(vex_bloom_t *bf, const uint8_t *packet_id) {
+    uint64_t key;
+    memcpy(&key, packet_id, 8);
+    uint64_t h = mix64(key ^ bf->seed);
+    uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 32) | 1;
+
+    advance(bf, time(NULL));
+
+    for (int s = 0; s < VEX_BLOOM_SLICES; s++) {
+        const uint64_t *words = slice_words(bf, s);
+        int hit = 1;
+        for (int i = 0; i < bf->hashes && hit; i++) {
+            uint32_t bit = reduce(h1 + (uint32_t)i * h2, bf->slice_bits);
+            hit = (words[bit >> 6] >> (bit & 63)) & 1;
+        }
+        if (hit) return 1;
+    }
+    return 0;
+}
+
+/* Add a packet_id to the current slice */
+void vex_bloom_add(vex_bloom_t *bf, const uint8_t *packet_id) {
+    uint64_t key;
+    memcpy(&key, packet_id, 8);
+    uint64_t h = mix64(key ^ bf->seed);
+    uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 32) | 1;
+
+    advance(bf, time(NULL));
+
+    /* Slice full ahead of schedule — rotate early */
+    if (bf->slice_items[bf->current] >= bf->slice_capacity) {
+        rotate(bf);
+        bf->rotated_at = time(NULL);
+        bf->early_rotations++;
+    }
+
+    uint64_t *words = slice_words(bf, bf->current);
+    for (int i = 0; i < bf->hashes; i++) {
+        uint32_t bit = reduce(h1 + (uint32_t)i * h2, bf->slice_bits);
+        uint64_t mask = 1ULL << (bit & 63);
+        if (!(words[bit >> 6] & mask)) {
+            words[bit >> 6] |= mask;
+            bf->slice_set[bf->current]++;
+        }
+    }
+    bf->slice_items[bf->current]++;
+}
+
+/* Rotate out slices whose period has passed */
+void vex_bloom_prune(vex_bloom_t *bf) {
+    advance(bf, time(NULL));
+}
+
+/* Current false-positive probability of a lookup, from slice fill ratios */
+double vex_bloom_fp_rate(const vex_bloom_t *bf) {
+    double miss = 1.0;
+    for (int s = 0; s < VEX_BLOOM_SLICES; s++) {
+        double fill = (double)bf->slice_set[s] / bf->slice_bits;
+        miss *= 1.0 - pow(fill, bf->hashes);
+    }
+    return 1.0 - miss;
+}
+
+/* Items remembered across all slices */
+uint64_t vex_bloom_count(const vex_bloom_t *bf) {
+    uint64_t n = 0;
+    for (int s = 0; s < VEX_BLOOM_SLICES; s++) n += bf->slice_items[s];
+    return n;
+}
+
+size_t vex_bloom_memory(const vex_bloom_t *bf) {
+    return (size_t)bf->slice_words * VEX_BLOOM_SLICES * sizeof(uint64_t);
+}
@@ -105,72 +105,87 @@ int vex_crypto_load_keys(vex_node_t *node, const char *path) {
     return 0;
 }
 
-/* Encrypt a broadcast message using the shared mesh key.
- * Output: nonce(24) || ciphertext
- * Returns 0 on success */
-int vex_crypto_encrypt_broadcast(const vex_node_t *node,
-                                  const uint8_t *plain, uint16_t len,
-                                  uint8_t *cipher, uint16_t *cipher_len) {
+/* ── In-place broadcast sealing ──
+ * A sealed payload is nonce(24) || MAC(16) || ciphertext. The plaintext
+ * sits at payload + VEX_SEAL_OVERHEAD and is encrypted where it lies:
+ * NaCl's 32 leading zero bytes overlap the tail of the nonce slot and the
+ * MAC slot, and the nonce is written over them afterwards. Inside a wire
+ * buffer (payload = wire + VEX_HEADER_SIZE) the message therefore starts
+ * at VEX_MSG_OFFSET and never moves. */
+
+/* Encrypt msg_len bytes at payload + VEX_SEAL_OVERHEAD in place.
+ * Returns 0 on success with the sealed length in *payload_len */
+int vex_crypto_seal_inplace(const vex_node_t *node, uint8_t *payload, uint16_t msg_len,
+                            uint16_t *payload_len) {
     uint8_t nonce[crypto_secretbox_NONCEBYTES];
-    uint8_t padded[crypto_secretbox_ZEROBYTES + VEX_MAX_PAYLOAD];
-    uint8_t encrypted[crypto_secretbox_ZEROBYTES + VEX_MAX_PAYLOAD];
+    uint8_t *box = payload + VEX_SEAL_OVERHEAD - crypto_secretbox_ZEROBYTES;
 
-    if (len > VEX_MAX_PAYLOAD - crypto_secretbox_NONCEBYTES - crypto_secretbox_BOXZEROBYTES)
-        return -1;
+    if (msg_len > VEX_MAX_PAYLOAD - VEX_SEAL_OVERHEAD) return -1;
 
     /* Generate random nonce */
     randombytes(nonce, crypto_secretbox_NONCEBYTES);
 
-    /* Pad plaintext with ZEROBYTES leading zeros */
-    memset(padded, 0, crypto_secretbox_ZEROBYTES);
-    memcpy(padded + crypto_secretbox_ZEROBYTES, plain, len);
-
-    /* Encrypt */
-    if (crypto_secretbox(encrypted, padded,
-                         crypto_secretbox_ZEROBYTES + len,
+    memset(box, 0, crypto_secretbox_ZEROBYTES);
+    if (crypto_secretbox(box, box, crypto_secretbox_ZEROBYTES + msg_len,
                          nonce, node->mesh_key) != 0)
         return -1;
 
-    /* Output: nonce || ciphertext (without BOXZEROBYTES padding) */
-    memcpy(cipher, nonce, crypto_secretbox_NONCEBYTES);
-    memcpy(cipher + crypto_secretbox_NONCEBYTES,
-           encrypted + crypto_secretbox_BOXZEROBYTES,
-           len + crypto_secretbox_ZEROBYTES - crypto_secretbox_BOXZEROBYTES);
+    /* Nonce goes over the BOXZEROBYTES the cipher left in front of the MAC */
+    memcpy(payload, nonce, crypto_secretbox_NONCEBYTES);
+
+    *payload_len = VEX_SEAL_OVERHEAD + msg_len;
+    return 0;
+}
+
+/* Verify and decrypt a sealed payload in place. On success the plaintext
+ * is at payload + VEX_SEAL_OVERHEAD and the nonce/MAC are destroyed.
+ * Returns 0 on success, -1 if the payload is malformed or forged */
+int vex_crypto_open_inplace(const vex_node_t *node, uint8_t *payload, uint16_t len,
+                            uint16_t *msg_len) {
+    uint8_t nonce[crypto_secretbox_NONCEBYTES];
+    uint8_t *box = payload + VEX_SEAL_OVERHEAD - crypto_secretbox_ZEROBYTES;
+
+    if (len < VEX_SEAL_OVERHEAD) return -1;
+
+    /* The nonce overlaps the zero padding NaCl wants in front of the MAC */
+    memcpy(nonce, payload, crypto_secretbox_NONCEBYTES);
+    memset(box, 0, crypto_secretbox_BOXZEROBYTES);
 
-    *cipher_len = crypto_secretbox_NONCEBYTES + len +
-                  crypto_secretbox_ZEROBYTES - crypto_secretbox_BOXZEROBYTES;
+    if (crypto_secretbox_open(box, box, crypto_secretbox_BOXZEROBYTES + len -
+                              crypto_secretbox_NONCEBYTES, nonce, node->mesh_key) != 0)
+        return -1;
+
+    *msg_len = len - VEX_SEAL_OVERHEAD;
     return 0;
 }
 
+/* Encrypt a broadcast message using the shared mesh key.
+ * Output: nonce(24) || ciphertext
+ * Returns 0 on success */
+int vex_crypto_encrypt_broadcast(const vex_node_t *node,
+                                  const uint8_t *plain, uint16_t len,
+                                  uint8_t *cipher, uint16_t *cipher_len) {
+    if (len > VEX_MAX_PAYLOAD - VEX_SEAL_OVERHEAD) return -1;
+
+    memcpy(cipher + VEX_SEAL_OVERHEAD, plain, len);
+    return vex_crypto_seal_inplace(node, cipher, len, cipher_len);
+}
+
 /* Decrypt a broadcast message using the shared mesh key.
  * Input: nonce(24) || ciphertext
  * Returns 0 on success */
 int vex_crypto_decrypt_broadcast(const vex_node_t *node,
                                   const uint8_t *cipher, uint16_t len,
                                   uint8_t *plain, uint16_t *plain_len) {
-    uint8_t nonce[crypto_secretbox_NONCEBYTES];
-    uint8_t padded_cipher[crypto_secretbox_BOXZEROBYTES + VEX_MAX_PAYLOAD];
-    uint8_t decrypted[crypto_secretbox_ZEROBYTES + VEX_MAX_PAYLOAD];
-
-    if (len <= crypto_secretbox_NONCEBYTES) return -1;
-
-    uint16_t ct_len = len - crypto_secretbox_NONCEBYTES;
-
-    /* Extract nonce */
-    memcpy(nonce, cipher, crypto_secretbox_NONCEBYTES);
+    uint8_t scratch[VEX_MAX_PAYLOAD];
 
-    /* Pad ciphertext with BOXZEROBYTES leading zeros */
-    memset(padded_cipher, 0, crypto_secretbox_BOXZEROBYTES);
-    memcpy(padded_cipher + crypto_secretbox_BOXZEROBYTES,
-           cipher + crypto_secretbox_NONCEBYTES, ct_len);
+    if (len <= crypto_secretbox_NONCEBYTES || len > VEX_MAX_PAYLOAD) return -1;
 
-    /* Decrypt */
-    if (crypto_secretbox_open(decrypted, padded_cipher,
-                              crypto_secretbox_BOXZEROBYTES + ct_len,
-                              nonce, node->mesh_key) != 0)
+    /* cipher is const — open a scratch copy */
+    memcpy(scratch, cipher, len);
+    if (vex_crypto_open_inplace(node, scratch, len, plain_len) != 0)
         return -1;
 
-    *plain_len = ct_len - (crypto_secretbox_ZEROBYTES - crypto_secretbox_BOXZEROBYTES);
-    memcpy(plain, decrypted + crypto_secretbox_ZEROBYTES, *plain_len);
+    memcpy(plain, scratch + VEX_SEAL_OVERHEAD, *plain_len);
     return 0;
 }
@@ -0,0 +1,527 @@
+/* crypto_accel.c — Faster Salsa20 and Poly1305 behind the NaCl API
+ *
+ * crypto_stream_salsa20_xor() and crypto_onetimeauth() dispatch here, so
+ * crypto_secretbox, the broadcast path and randombytes() all pick up the
+ * fastest kernel the CPU supports. Kernels are chosen once at first use:
+ *
+ *   Salsa20   avx2 (8 blocks/pass), sse2 or neon (4 blocks/pass), scalar
+ *   Poly1305  64-bit limbs (donna-64) where the compiler has __int128
+ *
+ * TweetNaCl stays the reference (*_ref). Before a kernel is enabled it is
+ * compared bit-for-bit against the reference on fixed inputs; any mismatch
+ * logs and falls back to the reference.
+ *
+ * Poly1305 stays scalar: our packets are at most 32 Poly1305 blocks, and
+ * at that size a vectorised MAC spends more on precomputing r^2..r^4 than
+ * it saves. 64-bit limbs already replace TweetNaCl's byte-at-a-time loop. */
+
+#include "vex.h"
+#include "tweetnacl.h"
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define ACCEL_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON) && \
+    (!defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define ACCEL_NEON 1
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#endif
+#endif
+
+typedef int (*salsa_xor_fn)(u8 *c, const u8 *m, u64 b, const u8 *n, const u8 *k);
+typedef int (*onetimeauth_fn)(u8 *out, const u8 *m, u64 n, const u8 *k);
+
+static salsa_xor_fn   salsa_impl = crypto_stream_salsa20_xor_ref;
+static onetimeauth_fn auth_impl = crypto_onetimeauth_ref;
+static const char    *salsa_name = "ref";
+static const char    *auth_name = "ref";
+static int            forced_ref;
+static pthread_once_t select_once = PTHREAD_ONCE_INIT;
+
+/* ── Salsa20 ── */
+
+static uint32_t ld32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void st32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+/* Initial state for block counter 0 */
+static void salsa_state(uint32_t s[16], const uint8_t *n, const uint8_t *k) {
+    s[0] = 0x61707865; s[5] = 0x3320646e; s[10] = 0x79622d32; s[15] = 0x6b206574;
+    for (int i = 0; i < 4; i++) {
+        s[1 + i] = ld32(k + 4 * i);
+        s[11 + i] = ld32(k + 16 + 4 * i);
+    }
+    s[6] = ld32(n);
+    s[7] = ld32(n + 4);
+    s[8] = 0;
+    s[9] = 0;
+}
+
+/* One double round over 16 words; VADD/VXOR/VROTL are bound per backend */
+#define QR(a, b, c, r) a = VXOR(a, VROTL(VADD(b, c), r))
+#define SALSA_DOUBLEROUND(x) do {                                                   \
+        QR(x[4], x[0], x[12], 7);   QR(x[8], x[4], x[0], 9);                        \
+        QR(x[12], x[8], x[4], 13);  QR(x[0], x[12], x[8], 18);                      \
+        QR(x[9], x[5], x[1], 7);    QR(x[13], x[9], x[5], 9);                       \
+        QR(x[1], x[13], x[9], 13);  QR(x[5], x[1], x[13], 18);                      \
+        QR(x[14], x[10], x[6], 7);  QR(x[2], x[14], x[10], 9);                      \
+        QR(x[6], x[2], x[14], 13);  QR(x[10], x[6], x[2], 18);                      \
+        QR(x[3], x[15], x[11], 7);  QR(x[7], x[3], x[15], 9);                       \
+        QR(x[11], x[7], x[3], 13);  QR(x[15], x[11], x[7], 18);                     \
+        QR(x[1], x[0], x[3], 7);    QR(x[2], x[1], x[0], 9);                        \
+        QR(x[3], x[2], x[1], 13);   QR(x[0], x[3], x[2], 18);                       \
+        QR(x[6], x[5], x[4], 7);    QR(x[7], x[6], x[5], 9);                        \
+        QR(x[4], x[7], x[6], 13);   QR(x[5], x[4], x[7], 18);                       \
+        QR(x[11], x[10], x[9], 7);  QR(x[8], x[11], x[10], 9);                      \
+        QR(x[9], x[8], x[11], 13);  QR(x[10], x[9], x[8], 18);                      \
+        QR(x[12], x[15], x[14], 7); QR(x[13], x[12], x[15], 9);                     \
+        QR(x[14], x[13], x[12], 13); QR(x[15], x[14], x[13], 18);                   \
+    } while (0)
+
+#define VADD(a, b)  ((a) + (b))
+#define VXOR(a, b)  ((a) ^ (b))
+#define VROTL(v, r) (((v) << (r)) | ((v) >> (32 - (r))))
+
+/* Keystream block for counter s[8..9]; advances the counter */
+static void salsa_block(uint8_t out[64], uint32_t s[16]) {
+    uint32_t x[16];
+
+    memcpy(x, s, sizeof(x));
+    for (int i = 0; i < 10; i++) SALSA_DOUBLEROUND(x);
+    for (int i = 0; i < 16; i++) st32(out + 4 * i, x[i] + s[i]);
+
+    if (++s[8] == 0) s[9]++;
+}
+
+#undef VADD
+#undef VXOR
+#undef VROTL
+
+/* Finish whatever full or partial blocks the wide kernels left over */
+static void salsa_tail(u8 *c, const u8 *m, u64 b, uint32_t s[16]) {
+    uint8_t ks[64];
+
+    while (b > 0) {
+        u64 take = b < 64 ? b : 64;
+        salsa_block(ks, s);
+        for (u64 i = 0; i < take; i++) c[i] = (m ? m[i] : 0) ^ ks[i];
+        c += take;
+        if (m) m += take;
+        b -= take;
+    }
+}
+
+static int salsa_xor_scalar(u8 *c, const u8 *m, u64 b, const u8 *n, const u8 *k) {
+    uint32_t s[16];
+
+    salsa_state(s, n, k);
+    salsa_tail(c, m, b, s);
+    return 0;
+}
+
+/* Per-lane block counters: lane j runs block (s[9]:s[8]) + j */
+static void lane_counters(const uint32_t s[16], int lanes, uint32_t lo[], uint32_t hi[]) {
+    uint64_t ctr = (uint64_t)s[9] << 32 | s[8];
+    for (int j = 0; j < lanes; j++) {
+        lo[j] = (uint32_t)(ctr + (uint64_t)j);
+        hi[j] = (uint32_t)((ctr + (uint64_t)j) >> 32);
+    }
+}
+
+static void advance_counter(uint32_t s[16], uint32_t blocks) {
+    uint64_t ctr = ((uint64_t)s[9] << 32 | s[8]) + blocks;
+    s[8] = (uint32_t)ctr;
+    s[9] = (uint32_t)(ctr >> 32);
+}
+
+#ifdef ACCEL_X86
+
+#define VADD(a, b)  _mm_add_epi32(a, b)
+#define VXOR(a, b)  _mm_xor_si128(a, b)
+#define VROTL(v, r) _mm_or_si128(_mm_slli_epi32(v, r), _mm_srli_epi32(v, 32 - (r)))
+
+/* Four blocks (256 bytes) at the counter in s, one block per 32-bit lane */
+static void sse2_4blocks(u8 *c, const u8 *m, uint32_t s[16]) {
+    __m128i in[16], x[16];
+    uint32_t lo[4], hi[4];
+
+    lane_counters(s, 4, lo, hi);
+    for (int i = 0; i < 16; i++) in[i] = _mm_set1_epi32((int)s[i]);
+    in[8] = _mm_setr_epi32((int)lo[0], (int)lo[1], (int)lo[2], (int)lo[3]);
+    in[9] = _mm_setr_epi32((int)hi[0], (int)hi[1], (int)hi[2], (int)hi[3]);
+    memcpy(x, in, sizeof(x));
+
+    for (int i = 0; i < 10; i++) SALSA_DOUBLEROUND(x);
+    for (int i = 0; i < 16; i++) x[i] = _mm_add_epi32(x[i], in[i]);
+
+    /* Transpose each group of four words back into block order */
+    for (int g = 0; g < 4; g++) {
+        __m128i t0 = _mm_unpacklo_epi32(x[4 * g], x[4 * g + 1]);
+        __m128i t1 = _mm_unpackhi_epi32(x[4 * g], x[4 * g + 1]);
+        __m128i t2 = _mm_unpacklo_epi32(x[4 * g + 2], x[4 * g + 3]);
+        __m128i t3 = _mm_unpackhi_epi32(x[4 * g + 2], x[4 * g + 3]);
+        __m128i blk[4] = {
+            _mm_unpacklo_epi64(t0, t2), _mm_unpackhi_epi64(t0, t2),
+            _mm_unpacklo_epi64(t1, t3), _mm_unpackhi_epi64(t1, t3),
+        };
+        for (int j = 0; j < 4; j++) {
+            size_t off = (size_t)64 * j + 16 * g;
+            if (m) blk[j] = _mm_xor_si128(blk[j], _mm_loadu_si128((const __m128i *)(m + off)));
+            _mm_storeu_si128((__m128i *)(c + off), blk[j]);
+        }
+    }
+    advance_counter(s, 4);
+}
+
+static int salsa_xor_sse2(u8 *c, const u8 *m, u64 b, const u8 *n, const u8 *k) {
+    uint32_t s[16];
+
+    salsa_state(s, n, k);
+    for (; b >= 256; b -= 256) {
+        sse2_4blocks(c, m, s);
+        c += 256;
+        if (m) m += 256;
+    }
+    salsa_tail(c, m, b, s);
+    return 0;
+}
+
+#undef VADD
+#undef VXOR
+#undef VROTL
+
+#define VADD(a, b)  _mm256_add_epi32(a, b)
+#define VXOR(a, b)  _mm256_xor_si256(a, b)
+#define VROTL(v, r) _mm256_or_si256(_mm256_slli_epi32(v, r), _mm256_srli_epi32(v, 32 - (r)))
+
+/* Eight blocks per pass. Each 128-bit half transposes like SSE2: the low
+ * half yields blocks 0-3, the high half blocks 4-7. A leftover 256 bytes
+ * goes through the SSE2 pass before the scalar tail. */
+__attribute__((target("avx2")))
+static int salsa_xor_avx2(u8 *c, const u8 *m, u64 b, const u8 *n, const u8 *k) {
+    uint32_t s[16];
+
+    salsa_state(s, n, k);
+    for (; b >= 512; b -= 512) {
+        __m256i in[16], x[16];
+        uint32_t lo[8], hi[8];
+
+        lane_counters(s, 8, lo, hi);
+        for (int i = 0; i < 16; i++) in[i] = _mm256_set1_epi32((int)s[i]);
+        in[8] = _mm256_setr_epi32((int)lo[0], (int)lo[1], (int)lo[2], (int)lo[3],
+                                  (int)lo[4], (int)lo[5], (int)lo[6], (int)lo[7]);
+        in[9] = _mm256_setr_epi32((int)hi[0], (int)hi[1], (int)hi[2], (int)hi[3],
+                                  (int)hi[4], (int)hi[5], (int)hi[6], (int)hi[7]);
+        memcpy(x, in, sizeof(x));
+
+        for (int i = 0; i < 10; i++) SALSA_DOUBLEROUND(x);
+        for (int i = 0; i < 16; i++) x[i] = _mm256_add_epi32(x[i], in[i]);
+
+        for (int g = 0; g < 4; g++) {
+            __m256i t0 = _mm256_unpacklo_epi32(x[4 * g], x[4 * g + 1]);
+            __m256i t1 = _mm256_unpackhi_epi32(x[4 * g], x[4 * g + 1]);
+            __m256i t2 = _mm256_unpacklo_epi32(x[4 * g + 2], x[4 * g + 3]);
+            __m256i t3 = _mm256_unpackhi_epi32(x[4 * g + 2], x[4 * g + 3]);
+            __m256i blk[4] = {
+                _mm256_unpacklo_epi64(t0, t2), _mm256_unpackhi_epi64(t0, t2),
+                _mm256_unpacklo_epi64(t1, t3), _mm256_unpackhi_epi64(t1, t3),
+            };
+            for (int j = 0; j < 4; j++) {
+                __m128i half[2] = {
+                    _mm256_castsi256_si128(blk[j]), _mm256_extracti128_si256(blk[j], 1),
+                };
+                for (int h = 0; h < 2; h++) {
+                    size_t off = (size_t)64 * (j + 4 * h) + 16 * g;
+                    if (m) half[h] = _mm_xor_si128(half[h], _mm_loadu_si128((const __m128i *)(m + off)));
+                    _mm_storeu_si128((__m128i *)(c + off), half[h]);
+                }
+            }
+        }
+
+        advance_counter(s, 8);
+        c += 512;
+        if (m) m += 512;
+    }
+    if (b >= 256) {
+        sse2_4blocks(c, m, s);
+        c += 256;
+        if (m) m += 256;
+        b -= 256;
+    }
+    salsa_tail(c, m, b, s);
+    return 0;
+}
+
+#undef VADD
+#undef VXOR
+#undef VROTL
+
+#endif /* ACCEL_X86 */
+
+#ifdef ACCEL_NEON
+
+#define VADD(a, b)  vaddq_u32(a, b)
+#define VXOR(a, b)  veorq_u32(a, b)
+#define VROTL(v, r) vsriq_n_u32(vshlq_n_u32(v, r), v, 32 - (r))
+
+static int salsa_xor_neon(u8 *c, const u8 *m, u64 b, const u8 *n, const u8 *k) {
+    uint32_t s[16];
+
+    salsa_state(s, n, k);
+    while (b >= 256) {
+        uint32x4_t in[16], x[16];
+        uint32_t lo[4], hi[4];
+
+        lane_counters(s, 4, lo, hi);
+        for (int i = 0; i < 16; i++) in[i] = vdupq_n_u32(s[i]);
+        in[8] = vld1q_u32(lo);
+        in[9] = vld1q_u32(hi);
+        memcpy(x, in, sizeof(x));
+
+        for (int i = 0; i < 10; i++) SALSA_DOUBLEROUND(x);
+        for (int i = 0; i < 16; i++) x[i] = vaddq_u32(x[i], in[i]);
+
+        for (int g = 0; g < 4; g++) {
+            uint32x4x2_t p01 = vtrnq_u32(x[4 * g], x[4 * g + 1]);
+            uint32x4x2_t p23 = vtrnq_u32(x[4 * g + 2], x[4 * g + 3]);
+            uint32x4_t blk[4] = {
+                vcombine_u32(vget_low_u32(p01.val[0]), vget_low_u32(p23.val[0])),
+                vcombine_u32(vget_low_u32(p01.val[1]), vget_low_u32(p23.val[1])),
+                vcombine_u32(vget_high_u32(p01.val[0]), vget_high_u32(p23.val[0])),
+                vcombine_u32(vget_high_u32(p01.val[1]), vget_high_u32(p23.val[1])),
+            };
+            for (int j = 0; j < 4; j++) {
+                size_t off = (size_t)64 * j + 16 * g;
+                uint8x16_t bytes = vreinterpretq_u8_u32(blk[j]);
+                if (m) bytes = veorq_u8(bytes, vld1q_u8(m + off));
+                vst1q_u8(c + off, bytes);
+            }
+        }
+
+        advance_counter(s, 4);
+        c += 256;
+        if (m) m += 256;
+        b -= 256;
+    }
+    salsa_tail(c, m, b, s);
+    return 0;
+}
+
+#undef VADD
+#undef VXOR
+#undef VROTL
+
+#endif /* ACCEL_NEON */
+
+/* ── Poly1305 ── */
+
+#ifdef __SIZEOF_INT128__
+
+typedef unsigned __int128 u128;
+
+#define MASK44 0xfffffffffffULL
+#define MASK42 0x3ffffffffffULL
+
+static uint64_t ld64(const uint8_t *p) {
+    return (uint64_t)ld32(p) | (uint64_t)ld32(p + 4) << 32;
+}
+
+/* Poly1305 with three 44/44/42-bit limbs and 128-bit products */
+static int onetimeauth_donna64(u8 *out, const u8 *m, u64 n, const u8 *k) {
+    uint64_t t0 = ld64(k), t1 = ld64(k + 8);
+    uint64_t r0 = t0 & 0xffc0fffffffULL;
+    uint64_t r1 = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffffULL;
+    uint64_t r2 = (t1 >> 24) & 0x00ffffffc0fULL;
+    uint64_t s1 = r1 * (5 << 2), s2 = r2 * (5 << 2);
+    uint64_t h0 = 0, h1 = 0, h2 = 0, c;
+
+    while (n > 0) {
+        uint8_t last[16];
+        const uint8_t *p = m;
+        uint64_t hibit = 1ULL << 40;
+        u64 take = 16;
+
+        if (n < 16) {
+            memset(last, 0, sizeof(last));
+            memcpy(last, m, n);
+            last[n] = 1;
+            p = last;
+            hibit = 0;
+            take = n;
+        }
+
+        t0 = ld64(p);
+        t1 = ld64(p + 8);
+        h0 += t0 & MASK44;
+        h1 += ((t0 >> 44) | (t1 << 20)) & MASK44;
+        h2 += ((t1 >> 24) & MASK42) | hibit;
+
+        u128 d0 = (u128)h0 * r0 + (u128)h1 * s2 + (u128)h2 * s1;
+        u128 d1 = (u128)h0 * r1 + (u128)h1 * r0 + (u128)h2 * s2;
+        u128 d2 = (u128)h0 * r2 + (u128)h1 * r1 + (u128)h2 * r0;
+
+        c = (uint64_t)(d0 >> 44); h0 = (uint64_t)d0 & MASK44;
+        d1 += c; c = (uint64_t)(d1 >> 44); h1 = (uint64_t)d1 & MASK44;
+        d2 += c; c = (uint64_t)(d2 >> 42); h2 = (uint64_t)d2 & MASK42;
+        h0 += c * 5; c = h0 >> 44; h0 &= MASK44;
+        h1 += c;
+
+        m += take;
+        n -= take;
+    }
+
+    /* Fully carry h */
+    c = h1 >> 44; h1 &= MASK44;
+    h2 += c; c = h2 >> 42; h2 &= MASK42;
+    h0 += c * 5; c = h0 >> 44; h0 &= MASK44;
+    h1 += c; c = h1 >> 44; h1 &= MASK44;
+    h2 += c; c = h2 >> 42; h2 &= MASK42;
+    h0 += c * 5; c = h0 >> 44; h0 &= MASK44;
+    h1 += c;
+
+    /* g = h + 5 - 2^130; keep h if g went negative, in constant time */
+    uint64_t g0 = h0 + 5; c = g0 >> 44; g0 &= MASK44;
+    uint64_t g1 = h1 + c; c = g1 >> 44; g1 &= MASK44;
+    uint64_t g2 = h2 + c - (1ULL << 42);
+
+    c = (g2 >> 63) - 1;
+    g0 &= c; g1 &= c; g2 &= c;
+    c = ~c;
+    h0 = (h0 & c) | g0;
+    h1 = (h1 & c) | g1;
+    h2 = (h2 & c) | g2;
+
+    /* h + s mod 2^128 */
+    t0 = ld64(k + 16);
+    t1 = ld64(k + 24);
+    h0 += t0 & MASK44; c = h0 >> 44; h0 &= MASK44;
+    h1 += (((t0 >> 44) | (t1 << 20)) & MASK44) + c; c = h1 >> 44; h1 &= MASK44;
+    h2 += ((t1 >> 24) & MASK42) + c; h2 &= MASK42;
+
+    h0 = h0 | (h1 << 44);
+    h1 = (h1 >> 20) | (h2 << 24);
+    for (int i = 0; i < 8; i++) {
+        out[i] = (uint8_t)(h0 >> (8 * i));
+        out[8 + i] = (uint8_t)(h1 >> (8 * i));
+    }
+    return 0;
+}
+
+#endif /* __SIZEOF_INT128__ */
+
+/* ── Selection ── */
+
+#define CHECK_MAX 1100
+
+/* Compare a Salsa20 kernel against the reference on fixed inputs, with and
+ * without a message, across lengths that hit every wide/tail boundary */
+static int salsa_matches_ref(salsa_xor_fn fn) {
+    static const u64 lens[] = { 0, 1, 63, 64, 65, 255, 256, 257, 511, 512, 513, 767, 1024, CHECK_MAX };
+    uint8_t key[32], nonce[8], msg[CHECK_MAX], want[CHECK_MAX], got[CHECK_MAX];
+
+    for (int i = 0; i < 32; i++) key[i] = (uint8_t)(i * 7 + 3);
+    for (int i = 0; i < 8; i++) nonce[i] = (uint8_t)(0xa0 + i);
+    for (int i = 0; i < CHECK_MAX; i++) msg[i] = (uint8_t)(i * 31 + 11);
+
+    for (size_t t = 0; t < sizeof(lens) / sizeof(lens[0]); t++) {
+        crypto_stream_salsa20_xor_ref(want, msg, lens[t], nonce, key);
+        fn(got, msg, lens[t], nonce, key);
+        if (memcmp(want, got, lens[t]) != 0) return 0;
+
+        crypto_stream_salsa20_xor_ref(want, NULL, lens[t], nonce, key);
+        fn(got, NULL, lens[t], nonce, key);
+        if (memcmp(want, got, lens[t]) != 0) return 0;
+    }
+    return 1;
+}
+
+static int auth_matches_ref(onetimeauth_fn fn) {
+    uint8_t key[32], msg[600], want[16], got[16];
+
+    for (int t = 0; t < 4; t++) {
+        /* All-0xff keys and messages push every limb to its carry limit */
+        for (int i = 0; i < 32; i++) key[i] = t == 3 ? 0xff : (uint8_t)(i * 13 + t);
+        for (int i = 0; i < 600; i++) msg[i] = t == 3 ? 0xff : (uint8_t)(i * 17 + t);
+        for (u64 len = 0; len <= 600; len += (len < 70 ? 1 : 37)) {
+            crypto_onetimeauth_ref(want, msg, len, key);
+            fn(got, msg, len, key);
+            if (memcmp(want, got, 16) != 0) return 0;
+        }
+    }
+    return 1;
+}
+
+static void try_salsa(salsa_xor_fn fn, const char *name) {
+    if (salsa_impl != crypto_stream_salsa20_xor_ref) return;  /* better one already chosen */
+    if (salsa_matches_ref(fn)) {
+        salsa_impl = fn;
+        salsa_name = name;
+    } else {
+        vex_log("CRYPTO", "Salsa20 %s kernel disagrees with reference, not used", name);
+    }
+}
+
+static void select_kernels(void) {
+    if (forced_ref) return;
+
+#ifdef ACCEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) try_salsa(salsa_xor_avx2, "avx2");
+    try_salsa(salsa_xor_sse2, "sse2");
+#endif
+#ifdef ACCEL_NEON
+#if defined(__linux__) && defined(HWCAP_ASIMD)
+    if (getauxval(AT_HWCAP) & HWCAP_ASIMD)
+#endif
+        try_salsa(salsa_xor_neon, "neon");
+#endif
+    try_salsa(salsa_xor_scalar, "scalar");
+
+#ifdef __SIZEOF_INT128__
+    if (auth_matches_ref(onetimeauth_donna64)) {
+        auth_impl = onetimeauth_donna64;
+        auth_name = "donna64";
+    } else {
+        vex_log("CRYPTO", "Poly1305 donna64 kernel disagrees with reference, not used");
+    }
+#endif
+}
+
+int crypto_stream_salsa20_xor(u8 *c, const u8 *m, u64 b, const u8 *n, const u8 *k) {
+    pthread_once(&select_once, select_kernels);
+    return salsa_impl(c, m, b, n, k);
+}
+
+int crypto_onetimeauth(u8 *out, const u8 *m, u64 n, const u8 *k) {
+    pthread_once(&select_once, select_kernels);
+    return auth_impl(out, m, n, k);
+}
+
+/* Pin the TweetNaCl reference kernels (for benchmarking). Must be called
+ * before the first encryption or random draw to take effect. */
+void vex_crypto_accel_disable(void) {
+    forced_ref = 1;
+}
+
+/* Names of the Salsa20 and Poly1305 kernels in use, e.g. "avx2/donna64" */
+const char *vex_crypto_accel_name(void) {
+    static char name[32];
+
+    pthread_once(&select_once, select_kernels);
+    snprintf(name, sizeof(name), "%s/%s", salsa_name, auth_name);
+    return name;
+}
@@ -0,0 +1,162 @@
+/* frag.c — Reassembly of messages sent as several fragments
+ *
+ * Each fragment names its message, its index and the fragment count. The
+ * first fragment of a message claims a slot and a buffer for all of it;
+ * every piece is copied to its place and marked in a bitmap, so a repeat
+ * of one already held (a resend under a new packet ID) is ignored. The
+ * message is handed back whole when the last missing piece lands.
+ *
+ * Memory is bounded twice over: a message still incomplete after
+ * VEX_FRAG_TIMEOUT_SEC is dropped, and all buffers together stay under
+ * VEX_FRAG_MEMORY. A new message that does not fit pushes out the oldest
+ * ones in progress, on the view that a message that has waited longest
+ * is the likeliest to have lost a fragment for good. */
+
+#include "vex.h"
+#include <stdlib.h>
+#include <string.h>
+
+vex_frag_table_t *vex_frag_new(void) {
+    vex_frag_table_t *t = calloc(1, sizeof(*t));
+    if (t) pthread_mutex_init(&t->lock, NULL);
+    return t;
+}
+
+void vex_frag_free(vex_frag_table_t *t) {
+    if (!t) return;
+    for (int i = 0; i < VEX_FRAG_SLOTS; i++) free(t->msg[i].data);
+    pthread_mutex_destroy(&t->lock);
+    free(t);
+}
+
+/* Fragment header: message ID, this fragment's index, fragment count */
+void vex_frag_header(uint8_t *out, const uint8_t *msg_id, uint8_t index, uint8_t count) {
+    memcpy(out, msg_id, 8);
+    out[8] = index;
+    out[9] = count;
+}
+
+static void slot_release(vex_frag_table_t *t, vex_frag_msg_t *m) {
+    t->memory -= (size_t)m->count * VEX_FRAG_DATA;
+    free(m->data);
+    memset(m, 0, sizeof(*m));
+}
+
+static vex_frag_msg_t *oldest(vex_frag_table_t *t) {
+    vex_frag_msg_t *old = NULL;
+    for (int i = 0; i < VEX_FRAG_SLOTS; i++) {
+        vex_frag_msg_t *m = &t->msg[i];
+        if (m->count && (!old || m->started < old->started)) old = m;
+    }
+    return old;
+}
+
+/* A slot and buffer for a new message of `count` fragments, making room
+ * by dropping expired then oldest messages. NULL if it can never fit */
+static vex_frag_msg_t *slot_claim(vex_frag_table_t *t, const uint8_t *msg_id, uint8_t count,
+                                  time_t now) {
+    size_t need = (size_t)count * VEX_FRAG_DATA;
+    if (need > VEX_FRAG_MEMORY) return NULL;
+
+    vex_frag_msg_t *free_slot = NULL;
+    for (int i = 0; i < VEX_FRAG_SLOTS; i++) {
+        vex_frag_msg_t *m = &t->msg[i];
+        if (m->count && now - m->started > VEX_FRAG_TIMEOUT_SEC) {
+            slot_release(t, m);
+            t->expired++;
+        }
+        if (!m->count && !free_slot) free_slot = m;
+    }
+    while (!free_slot || t->memory + need > VEX_FRAG_MEMORY) {
+        vex_frag_msg_t *old = oldest(t);
+        slot_release(t, old);
+        t->evicted++;
+        if (!free_slot) free_slot = old;
+    }
+
+    free_slot->data = malloc(need);
+    if (!free_slot->data) return NULL;
+    memcpy(free_slot->msg_id, msg_id, 8);
+    free_slot->count = count;
+    free_slot->started = now;
+    t->memory += need;
+    return free_slot;
+}
+
+/* Store a checked fragment, with the lock held. Returns the whole message
+ * if this was its last missing piece */
+static uint8_t *frag_store(vex_frag_table_t *t, const uint8_t *frag, size_t piece, time_t now,
+                           size_t *msg_len) {
+    const uint8_t *msg_id = frag;
+    uint8_t index = frag[8], count = frag[9];
+
+    vex_frag_msg_t *m = NULL;
+    for (int i = 0; i < VEX_FRAG_SLOTS && !m; i++)
+        if (t->msg[i].count && memcmp(t->msg[i].msg_id, msg_id, 8) == 0) m = &t->msg[i];
+    if (m && m->count != count) {
+        t->rejected++;
+        return NULL;
+    }
+    if (!m && !(m = slot_claim(t, msg_id, count, now))) {
+        t->rejected++;
+        return NULL;
+    }
+
+    uint64_t bit = 1ULL << (index % 64);
+    if (m->got[index / 64] & bit) return NULL;
+    m->got[index / 64] |= bit;
+    memcpy(m->data + (size_t)index * VEX_FRAG_DATA, frag + VEX_FRAG_HDR, piece);
+    if (index + 1 == count) m->last_len = (uint16_t)piece;
+    if (++m->have < m->count) return NULL;
+
+    uint8_t *whole = m->data;
+    *msg_len = (size_t)(m->count - 1) * VEX_FRAG_DATA + m->last_len;
+    m->data = NULL;                      /* the caller owns it now */
+    slot_release(t, m);
+    t->completed++;
+    return whole;
+}
+
+/* Take one fragment (header and piece, as opened). Returns the whole
+ * message once its last piece arrives, in a buffer the caller frees, with
+ * its length in *msg_len; NULL while pieces are missing or if the fragment
+ * is rejected */
+uint8_t *vex_frag_add(vex_frag_table_t *t, const uint8_t *frag, size_t len, time_t now,
+                      size_t *msg_len) {
+    size_t piece = len - VEX_FRAG_HDR;
+    uint8_t *whole = NULL;
+
+    /* Every piece but the last is full, so it lands at index * DATA */
+    int ok = len > VEX_FRAG_HDR && piece <= VEX_FRAG_DATA && frag[8] < frag[9] &&
+             (frag[8] + 1 == frag[9] || piece == VEX_FRAG_DATA);
+
+    pthread_mutex_lock(&t->lock);
+    if (ok) whole = frag_store(t, frag, piece, now, msg_len);
+    else t->rejected++;
+    pthread_mutex_unlock(&t->lock);
+    return whole;
+}
+
+/* Drop messages that have been incomplete too long */
+void vex_frag_prune(vex_frag_table_t *t, time_t now) {
+    pthread_mutex_lock(&t->lock);
+    for (int i = 0; i < VEX_FRAG_SLOTS; i++) {
+        vex_frag_msg_t *m = &t->msg[i];
+        if (m->count && now - m->started > VEX_FRAG_TIMEOUT_SEC) {
+            slot_release(t, m);
+            t->expired++;
+        }
+    }
+    pthread_mutex_unlock(&t->lock);
+}
+
+/* Messages in progress, and the buffer bytes they hold in *bytes */
+size_t vex_frag_pending(vex_frag_table_t *t, size_t *bytes) {
+    size_t n = 0;
+    pthread_mutex_lock(&t->lock);
+    for (int i = 0; i < VEX_FRAG_SLOTS; i++)
+        if (t->msg[i].count) n++;
+    *bytes = t->memory;
+    pthread_mutex_unlock(&t->lock);
+    return n;
+}
@@ -14,13 +14,23 @@
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
-#include <poll.h>
 #include <getopt.h>
+#include <errno.h>
 
-/* Forward declaration */
-int vex_transport_unix_read(vex_peer_t *peer, uint8_t *buf, size_t buf_len);
+#define PRUNE_INTERVAL    10
+#define STATS_INTERVAL    30
 
 static vex_node_t node;
+static vex_reactor_t reactor;
+static int show_stats = 0;
+static int use_uring = 0;
+static int sock_mode = VEX_SOCK_STREAM;
+static int threads = 1;
+static vex_seen_shards_t seen_shards;
+
+/* Partial stdin line carried between reads */
+static char   line_buf[VEX_MAX_MESSAGE + 1];  /* long lines go out in fragments */
+static size_t line_len;
 
 static void handle_signal(int sig) {
     (void)sig;
@@ -41,47 +51,191 @@ static void print_usage(const char *prog) {
     printf("Usage: %s [options]\n\n"
            "Options:\n"
            "  --listen PATH    Unix socket path to listen on (required)\n"
+           "                   (udp: HOST:PORT or :PORT)\n"
            "  --peer PATH      Connect to another node's socket (repeatable)\n"
+           "  --transport T    stream (default), seqpacket or udp\n"
            "  --name NAME      Node display name\n"
            "  --ttl N          Default TTL (default: 7)\n"
            "  --no-relay       Don't relay packets (receive only)\n"
+           "  --seen MODE      Dedup backend: exact (default) or bloom\n"
+           "  --seen-size N    Bloom: packet IDs to remember (default: %d)\n"
+           "  --seen-fp RATE   Bloom: target false-positive rate (default: %g)\n"
+           "  --id-scheme S    Packet ID scheme: siphash (default) or sha512\n"
+           "  --txq-high N     Per-peer send queue limit in frames (default: %d)\n"
+           "  --txq-low N      Queue depth that ends shedding (default: %d)\n"
+           "  --txq-drop P     Full queue sheds: oldest (default) or ttl\n"
+           "  --coalesce MS    Pack small packets for a peer into one frame, waiting\n"
+           "                   up to MS for more (0 = pack only what is queued)\n"
+           "  --coalesce-max N Coalesced frame size in bytes (default: %d)\n"
+           "  --io-uring       Peer I/O through io_uring (make URING=1), else epoll\n"
+           "  --threads N      Relay on N worker threads (stream transport, epoll)\n"
+           "  --relay-policy P Relay: flood (default), counter or gossip\n"
+           "  --relay-delay MS Counter: longest random hold (default: %d)\n"
+           "  --relay-count N  Counter: copies heard that cancel a relay (default: %d)\n"
+           "  --gossip-prob P  Gossip: chance of relaying (default: %g)\n"
+           "  --qos S          Relay scheduler: off (default), strict or weighted\n"
+           "  --priority C     Priority of messages sent: urgent, high, normal\n"
+           "                   (default) or bulk\n"
            "  --stats          Print stats every 30s\n"
            "  --help           Show this help\n"
            "  --version        Show version\n\n"
            "Interactive commands:\n"
            "  <message>        Broadcast a message to the mesh\n"
+           "  /msg ADDR TEXT   Send a message to one node (16 hex digit address)\n"
+           "  /urgent TEXT     Broadcast a message at urgent priority\n"
            "  /peers           List connected peers\n"
+           "  /routes          List learnt routes\n"
            "  /stats           Show relay statistics\n"
            "  /quit            Exit\n\n",
-           prog);
+           prog, VEX_BLOOM_DEFAULT_CAPACITY, VEX_BLOOM_DEFAULT_FP,
+           VEX_PEER_TX_QUEUE, VEX_PEER_TX_QUEUE / 4, VEX_MAX_PACKET, VEX_RELAY_DEFAULT_DELAY_MS,
+           VEX_RELAY_DEFAULT_COUNT, VEX_GOSSIP_DEFAULT_PROB);
+}
+
+/* The node and, with --threads, every worker's copy of it: peers and
+ * relay counters are spread across them */
+static int node_list(vex_node_t *n, vex_node_t **out) {
+    int count = 0;
+    out[count++] = n;
+    for (int i = 0; i < vex_workers_count(); i++) out[count++] = vex_workers_node(i);
+    return count;
 }
 
 static void print_stats(vex_node_t *n) {
     time_t uptime = time(NULL) - n->started_at;
     int hours = (int)(uptime / 3600);
     int mins = (int)((uptime % 3600) / 60);
+    vex_node_t *nodes[VEX_MAX_THREADS + 1];
+    int nnodes = node_list(n, nodes);
+
+    uint64_t sent = 0, received = 0, relayed = 0, dup = 0;
+    uint64_t held = 0, suppressed = 0, routed = 0, route_floods = 0;
+    int routes = 0;
+    int active = 0, queued = 0;
+    for (int k = 0; k < nnodes; k++) {
+        held += nodes[k]->relays_deferred;
+        routed += nodes[k]->packets_routed;
+        route_floods += nodes[k]->route_floods;
+        routes += nodes[k]->routes.count;
+        suppressed += nodes[k]->relays_suppressed;
+        sent += nodes[k]->packets_sent;
+        received += nodes[k]->packets_received;
+        relayed += nodes[k]->packets_relayed;
+        dup += nodes[k]->packets_dropped;
+        for (int i = 0; i < VEX_MAX_PEERS; i++) {
+            if (!nodes[k]->peers[i].active) continue;
+            active++;
+            queued += nodes[k]->peers[i].tx_count;
+        }
+    }
 
     printf("\n[STATS] Node: %s | Uptime: %dh%dm\n", n->node_name, hours, mins);
     printf("[STATS] Sent: %llu | Received: %llu | Relayed: %llu | Dropped: %llu\n",
-           (unsigned long long)n->packets_sent,
-           (unsigned long long)n->packets_received,
-           (unsigned long long)n->packets_relayed,
-           (unsigned long long)n->packets_dropped);
-
-    int active = 0;
-    for (int i = 0; i < VEX_MAX_PEERS; i++)
-        if (n->peers[i].active) active++;
-    printf("[STATS] Peers: %d active\n\n", active);
+           (unsigned long long)sent, (unsigned long long)received,
+           (unsigned long long)relayed, (unsigned long long)dup);
+    if (n->relay_policy != VEX_RELAY_FLOOD) {
+        uint64_t decided = relayed + suppressed;
+        printf("[STATS] Relay: %s | Held: %llu | Suppressed: %llu (%.1f%% of relays saved)\n",
+               vex_mesh_relay_policy_name(n->relay_policy), (unsigned long long)held,
+               (unsigned long long)suppressed,
+               decided ? 100.0 * (double)suppressed / (double)decided : 0.0);
+    }
+    if (n->qos) {
+        /* Each relay thread schedules its own queue: add them up */
+        int waiting = 0;
+        for (int k = 0; k < nnodes; k++)
+            if (nodes[k]->qos) waiting += nodes[k]->qos->count;
+        printf("[STATS] QoS: %s | Queued: %d\n", vex_mesh_qos_name(n->qos->mode), waiting);
+        for (int r = 0; r < VEX_PRIO_CLASSES; r++) {
+            uint64_t done = 0, shed = 0, wait_total = 0, wait_max = 0;
+            for (int k = 0; k < nnodes; k++) {
+                if (!nodes[k]->qos) continue;
+                const vex_qos_class_t *c = &nodes[k]->qos->cls[r];
+                done += c->relayed;
+                shed += c->shed;
+                wait_total += c->wait_ms_total;
+                if (c->wait_ms_max > wait_max) wait_max = c->wait_ms_max;
+            }
+            printf("[STATS]   %-6s relayed: %llu | shed: %llu | wait: avg %.1fms, max %llums\n",
+                   vex_mesh_qos_class_name(r), (unsigned long long)done,
+                   (unsigned long long)shed, done ? (double)wait_total / (double)done : 0.0,
+                   (unsigned long long)wait_max);
+        }
+    }
+    if (routes > 0 || routed + route_floods > 0)
+        printf("[STATS] Routes: %d | Directed: %llu routed, %llu flooded\n", routes,
+               (unsigned long long)routed, (unsigned long long)route_floods);
+    vex_frag_table_t *ft = n->frags;     /* one table, shared with the workers */
+    size_t frag_bytes;
+    size_t frag_pending = ft ? vex_frag_pending(ft, &frag_bytes) : 0;
+    if (ft && (frag_pending > 0 || ft->completed + ft->expired + ft->evicted + ft->rejected > 0))
+        printf("[STATS] Reassembly: %llu done, %zu pending (%zu KB) | Lost: %llu timed out, "
+               "%llu evicted, %llu rejected\n", (unsigned long long)ft->completed,
+               frag_pending, frag_bytes / 1024, (unsigned long long)ft->expired,
+               (unsigned long long)ft->evicted, (unsigned long long)ft->rejected);
+    uint64_t frames, writes, dropped;
+    vex_transport_counters(&frames, &writes, &dropped);
+    printf("[STATS] Frames out: %llu in %llu writes | Queued: %d | Shed: %llu\n",
+           (unsigned long long)frames, (unsigned long long)writes, queued,
+           (unsigned long long)dropped);
+    uint64_t packed, coalesced;
+    vex_transport_coalesce_counters(&packed, &coalesced);
+    if (coalesced > 0)
+        printf("[STATS] Coalesced: %llu packets into %llu frames (%.1f per frame)\n",
+               (unsigned long long)packed, (unsigned long long)coalesced,
+               (double)packed / (double)coalesced);
+
+    uint32_t pool_used, pool_peak;
+    uint64_t pool_misses;
+    vex_pool_stats(&pool_used, &pool_peak, &pool_misses);
+    printf("[STATS] Buffers: %u/%d in use | Peak: %u (%zu KB) | Pool empty: %llu\n",
+           pool_used, VEX_POOL_BUFS, pool_peak,
+           (size_t)pool_peak * sizeof(vex_pktbuf_t) / 1024,
+           (unsigned long long)pool_misses);
+
+    printf("[STATS] Peers: %d active | Crypto: %s | Loop: %s%s, %llu wakeups\n",
+           active, vex_crypto_accel_name(), vex_reactor_backend(&reactor),
+           vex_transport_uring_active() ? "+io_uring" : "",
+           (unsigned long long)reactor.wakeups);
+
+    if (vex_workers_count() > 0) {
+        uint64_t handoffs, lost, wakeups;
+        vex_workers_counters(&handoffs, &lost, &wakeups);
+        printf("[STATS] Threads: %d, %llu wakeups | Handoffs: %llu | Handoff drops: %llu\n",
+               vex_workers_count(), (unsigned long long)wakeups,
+               (unsigned long long)handoffs, (unsigned long long)lost);
+    }
+
+    if (n->seen_shared) {
+        printf("[STATS] Seen: %s, %u shards | IDs: %llu/%llu\n\n",
+               n->seen_shared->mode == VEX_SEEN_BLOOM ? "bloom" : "exact",
+               n->seen_shared->mask + 1,
+               (unsigned long long)vex_seen_shards_count(n->seen_shared),
+               (unsigned long long)n->seen_shared->capacity);
+    } else if (n->seen_mode == VEX_SEEN_BLOOM) {
+        printf("[STATS] Seen: bloom | IDs: %llu | Est. FP rate: %.6f%% (target %g) | %zu KB\n\n",
+               (unsigned long long)vex_bloom_count(&n->seen_bloom),
+               vex_bloom_fp_rate(&n->seen_bloom) * 100.0,
+               n->seen_bloom.target_fp, vex_bloom_memory(&n->seen_bloom) / 1024);
+    } else {
+        printf("[STATS] Seen: exact | IDs: %d/%d\n\n", n->seen.count, VEX_SEEN_CAPACITY);
+    }
 }
 
-static void print_peers(vex_node_t *n) {
+static void print_peers(vex_node_t *node_main) {
+    vex_node_t *nodes[VEX_MAX_THREADS + 1];
+    int nnodes = node_list(node_main, nodes);
     int count = 0;
     printf("\n[PEERS]\n");
-    for (int i = 0; i < VEX_MAX_PEERS; i++) {
-        if (n->peers[i].active) {
+    for (int k = 0; k < nnodes; k++) {
+        vex_node_t *n = nodes[k];
+        for (int i = 0; i < VEX_MAX_PEERS; i++) {
+            if (!n->peers[i].active) continue;
             time_t ago = time(NULL) - n->peers[i].last_seen;
-            printf("  %s (fd=%d, last seen %lds ago)\n",
-                   n->peers[i].name, n->peers[i].fd, (long)ago);
+            printf("  %s (fd=%d, last seen %lds ago, queue %u/%d peak %u, %llu shed)\n",
+                   n->peers[i].name, n->peers[i].fd, (long)ago,
+                   n->peers[i].tx_count, VEX_PEER_TX_QUEUE, n->peers[i].tx_peak,
+                   (unsigned long long)n->peers[i].tx_dropped);
             count++;
         }
     }
@@ -89,6 +243,195 @@ static void print_peers(vex_node_t *n) {
     printf("\n");
 }
 
+static void print_routes(vex_node_t *node_main) {
+    vex_node_t *nodes[VEX_MAX_THREADS + 1];
+    int nnodes = node_list(node_main, nodes);
+    int count = 0;
+    time_t now = time(NULL);
+    printf("\n[ROUTES]\n");
+    for (int k = 0; k < nnodes; k++) {
+        vex_node_t *n = nodes[k];
+        for (int i = 0; i < n->routes.count; i++) {
+            const vex_route_t *r = &n->routes.entries[i];
+            const char *via = "?";
+            for (int p = 0; p < VEX_MAX_PEERS; p++)
+                if (n->peers[p].active && n->peers[p].fd == r->next_fd) via = n->peers[p].name;
+            char dest_hex[2 * VEX_ADDR_SIZE + 1];
+            vex_hex(r->dest, VEX_ADDR_SIZE, dest_hex);
+            printf("  %s via %s (fd=%d), %d hops, updated %lds ago\n",
+                   dest_hex, via, r->next_fd, r->hops, (long)(now - r->updated));
+            count++;
+        }
+    }
+    if (count == 0) printf("  (no routes yet)\n");
+    printf("\n");
+}
+
+/* "/msg ADDR TEXT": parse the hex address and send TEXT to it */
+static void send_directed(char *args) {
+    uint8_t dest[VEX_ADDR_SIZE];
+    char *text = strchr(args, ' ');
+    size_t hex_len = text ? (size_t)(text - args) : strlen(args);
+
+    if (hex_len != 2 * VEX_ADDR_SIZE || !text || text[1] == '\0') {
+        printf("Usage: /msg ADDR TEXT (ADDR is %d hex digits, see /routes or the banner)\n",
+               2 * VEX_ADDR_SIZE);
+        return;
+    }
+    for (int i = 0; i < VEX_ADDR_SIZE; i++) {
+        unsigned v;
+        if (sscanf(args + 2 * i, "%2x", &v) != 1) {
+            printf("Bad address %.*s\n", (int)hex_len, args);
+            return;
+        }
+        dest[i] = (uint8_t)v;
+    }
+    vex_mesh_send_to(&node, dest, text + 1);
+}
+
+/* Run one line typed at the prompt: a command or a message to broadcast */
+static void handle_line(char *input) {
+    if (input[0] == '\0') { printf("> "); fflush(stdout); return; }
+
+    if (strcmp(input, "/quit") == 0 || strcmp(input, "/q") == 0) {
+        node.running = 0;
+        return;
+    }
+    if (strcmp(input, "/peers") == 0) {
+        print_peers(&node);
+    } else if (strcmp(input, "/routes") == 0) {
+        print_routes(&node);
+    } else if (strncmp(input, "/msg ", 5) == 0) {
+        send_directed(input + 5);
+    } else if (strncmp(input, "/urgent ", 8) == 0) {
+        vex_mesh_send_prio(&node, input + 8, VEX_PRIO_URGENT);
+    } else if (strcmp(input, "/stats") == 0) {
+        print_stats(&node);
+    } else {
+        vex_mesh_send(&node, input);
+    }
+    printf("> ");
+    fflush(stdout);
+}
+
+/* stdin is read raw rather than through stdio, so lines that arrive
+ * together are all handled on one wakeup */
+static void on_stdin(void *ctx, int fd, uint32_t events) {
+    (void)ctx; (void)events;
+
+    ssize_t n = read(fd, line_buf + line_len, sizeof(line_buf) - 1 - line_len);
+    if (n <= 0) {
+        if (n < 0 && errno == EINTR) return;
+        vex_reactor_del(&reactor, fd);  /* EOF: keep relaying without a prompt */
+        return;
+    }
+    line_len += (size_t)n;
+
+    size_t start = 0;
+    for (size_t i = 0; i < line_len && node.running; i++) {
+        if (line_buf[i] != '\n') continue;
+        line_buf[i] = '\0';
+        handle_line(line_buf + start);
+        start = i + 1;
+    }
+    if (start == 0 && line_len == sizeof(line_buf) - 1) {
+        /* Over-long line: send what we have, as fgets() used to */
+        line_buf[line_len] = '\0';
+        handle_line(line_buf);
+        start = line_len;
+    }
+    memmove(line_buf, line_buf + start, line_len - start);
+    line_len -= start;
+}
+
+static void on_frame(void *ctx, vex_peer_t *peer, uint8_t *frame, size_t len) {
+    (void)ctx;
+    vex_mesh_receive(&node, frame, len, peer->fd);
+}
+
+static void on_listen(void *ctx, int fd, uint32_t events) {
+    (void)ctx; (void)fd; (void)events;
+    if (sock_mode == VEX_SOCK_UDP) {
+        vex_transport_udp_accept(&node, on_frame, NULL);
+    } else if (vex_workers_count() > 0) {
+        int peer_fd;
+        while ((peer_fd = vex_transport_unix_accept_fd(&node)) >= 0) {
+            char peer_name[64];
+            snprintf(peer_name, sizeof(peer_name), "peer-%d", peer_fd);
+            vex_workers_adopt(peer_fd, peer_name);
+        }
+    } else {
+        while (vex_transport_unix_accept(&node) > 0) {}
+    }
+}
+
+static void on_peer(void *ctx, int fd, uint32_t events) {
+    vex_peer_t *peer = ctx;
+    (void)fd;
+
+    if (!peer->active) return;
+    if (!(events & (VEX_IO_READ | VEX_IO_WRITE)) && (events & VEX_IO_ERROR)) {
+        vex_transport_close_peer(peer);
+        return;
+    }
+    if ((events & VEX_IO_WRITE) && vex_transport_flush(peer) < 0) return;
+    if (events & VEX_IO_READ) vex_transport_read(peer, on_frame, NULL);
+}
+
+/* io_uring completions are waiting: receives, finished sends */
+static void on_uring(void *ctx, int fd, uint32_t events) {
+    (void)ctx; (void)fd; (void)events;
+    vex_transport_uring_reap(0);
+}
+
+/* Watch a peer for writability only while its send queue is backed up */
+static void on_peer_write(void *ctx, vex_peer_t *peer, int want) {
+    (void)ctx;
+    vex_reactor_mod(&reactor, peer->fd, VEX_IO_READ | (want ? VEX_IO_WRITE : 0));
+}
+
+/* Keep the reactor's watch list in step with the transport's peers */
+static void on_peer_change(void *ctx, vex_peer_t *peer, int up) {
+    vex_node_t *n = ctx;
+
+    if (up) {
+        if (vex_transport_uring_active()) return;  /* the ring does its I/O */
+        if (vex_reactor_add(&reactor, peer->fd, VEX_IO_READ, on_peer, peer) != 0) {
+            vex_log("REACTOR", "Cannot watch peer %s (fd=%d), dropping it", peer->name, peer->fd);
+            vex_transport_close_peer(peer);
+        }
+        return;
+    }
+
+    vex_reactor_del(&reactor, peer->fd);
+    vex_log("TRANSPORT", "Peer %s disconnected", peer->name);
+    vex_mesh_peer_down(n, peer->fd);
+    n->peer_count--;
+}
+
+/* Poll timeout: sleep until the next stats print, held relay or held
+ * send queue, or indefinitely */
+static int next_timeout_ms(time_t last_stats) {
+    int timeout = -1;
+    if (show_stats) {
+        time_t due = last_stats + STATS_INTERVAL - time(NULL);
+        timeout = due > 0 ? (int)due * 1000 : 0;
+    }
+    /* UDP peers need their hellos even when nothing else is going on */
+    if (sock_mode == VEX_SOCK_UDP && (timeout < 0 || timeout > PRUNE_INTERVAL * 1000))
+        timeout = PRUNE_INTERVAL * 1000;
+
+    uint64_t relay_due = vex_mesh_next_due(&node);
+    uint64_t send_due = vex_transport_next_due(&node);
+    if (send_due && (!relay_due || send_due < relay_due)) relay_due = send_due;
+    if (relay_due) {
+        uint64_t now = vex_time_ms();
+        int wait = relay_due > now ? (int)(relay_due - now) : 0;
+        if (timeout < 0 || wait < timeout) timeout = wait;
+    }
+    return timeout;
+}
+
 int main(int argc, char *argv[]) {
     const char *listen_path = NULL;
     const char *peer_paths[VEX_MAX_PEERS];
@@ -96,7 +439,20 @@ int main(int argc, char *argv[]) {
     const char *name = NULL;
     int ttl = VEX_DEFAULT_TTL;
     int relay = 1;
-    int show_stats = 0;
+    int seen_mode = VEX_SEEN_EXACT;
+    long seen_size = VEX_BLOOM_DEFAULT_CAPACITY;
+    double seen_fp = VEX_BLOOM_DEFAULT_FP;
+    int txq_high = VEX_PEER_TX_QUEUE;
+    int txq_low = VEX_PEER_TX_QUEUE / 4;
+    int txq_policy = VEX_TX_DROP_OLDEST;
+    int relay_policy = VEX_RELAY_FLOOD;
+    int relay_delay = VEX_RELAY_DEFAULT_DELAY_MS;
+    int relay_count = VEX_RELAY_DEFAULT_COUNT;
+    double gossip_prob = VEX_GOSSIP_DEFAULT_PROB;
+    int qos = VEX_QOS_OFF;
+    int priority = VEX_PRIO_NORMAL;
+    int coalesce_ms = -1;
+    int coalesce_max = VEX_MAX_PACKET;
 
     static struct option long_opts[] = {
         {"listen",   required_argument, 0, 'l'},
@@ -105,13 +461,31 @@ int main(int argc, char *argv[]) {
         {"ttl",      required_argument, 0, 't'},
         {"no-relay", no_argument,       0, 'r'},
         {"stats",    no_argument,       0, 's'},
+        {"seen",     required_argument, 0, 'm'},
+        {"seen-size", required_argument, 0, 'c'},
+        {"seen-fp",  required_argument, 0, 'f'},
+        {"id-scheme", required_argument, 0, 'i'},
+        {"txq-high", required_argument, 0, 'H'},
+        {"txq-low",  required_argument, 0, 'L'},
+        {"txq-drop", required_argument, 0, 'D'},
+        {"coalesce", required_argument, 0, 'W'},
+        {"coalesce-max", required_argument, 0, 'B'},
+        {"io-uring", no_argument,       0, 'u'},
+        {"transport", required_argument, 0, 'T'},
+        {"threads",  required_argument, 0, 'j'},
+        {"relay-policy", required_argument, 0, 'R'},
+        {"relay-delay", required_argument, 0, 'd'},
+        {"relay-count", required_argument, 0, 'C'},
+        {"gossip-prob", required_argument, 0, 'g'},
+        {"qos",      required_argument, 0, 'Q'},
+        {"priority", required_argument, 0, 'P'},
         {"help",     no_argument,       0, 'h'},
         {"version",  no_argument,       0, 'v'},
         {0, 0, 0, 0}
     };
 
     int c;
-    while ((c = getopt_long(argc, argv, "l:p:n:t:rshv", long_opts, NULL)) != -1) {
+    while ((c = getopt_long(argc, argv, "l:p:n:t:rsm:c:f:i:H:L:D:W:B:uT:j:R:d:C:g:Q:P:hv", long_opts, NULL)) != -1) {
         switch (c) {
             case 'l': listen_path = optarg; break;
             case 'p':
@@ -122,6 +496,74 @@ int main(int argc, char *argv[]) {
             case 't': ttl = atoi(optarg); break;
             case 'r': relay = 0; break;
             case 's': show_stats = 1; break;
+            case 'm':
+                if (strcmp(optarg, "bloom") == 0) seen_mode = VEX_SEEN_BLOOM;
+                else if (strcmp(optarg, "exact") == 0) seen_mode = VEX_SEEN_EXACT;
+                else {
+                    fprintf(stderr, "Error: --seen must be exact or bloom\n");
+                    return 1;
+                }
+                break;
+            case 'c': seen_size = atol(optarg); break;
+            case 'f': seen_fp = atof(optarg); break;
+            case 'i':
+                if (strcmp(optarg, "siphash") == 0) vex_packet_set_id_scheme(VEX_ID_SIPHASH);
+                else if (strcmp(optarg, "sha512") == 0) vex_packet_set_id_scheme(VEX_ID_SHA512);
+                else {
+                    fprintf(stderr, "Error: --id-scheme must be siphash or sha512\n");
+                    return 1;
+                }
+                break;
+            case 'H': txq_high = atoi(optarg); break;
+            case 'L': txq_low = atoi(optarg); break;
+            case 'D':
+                if (strcmp(optarg, "oldest") == 0) txq_policy = VEX_TX_DROP_OLDEST;
+                else if (strcmp(optarg, "ttl") == 0) txq_policy = VEX_TX_DROP_LOWEST_TTL;
+                else {
+                    fprintf(stderr, "Error: --txq-drop must be oldest or ttl\n");
+                    return 1;
+                }
+                break;
+            case 'W': coalesce_ms = atoi(optarg); break;
+            case 'B': coalesce_max = atoi(optarg); break;
+            case 'u': use_uring = 1; break;
+            case 'T':
+                if (strcmp(optarg, "stream") == 0) sock_mode = VEX_SOCK_STREAM;
+                else if (strcmp(optarg, "seqpacket") == 0) sock_mode = VEX_SOCK_SEQPACKET;
+                else if (strcmp(optarg, "udp") == 0) sock_mode = VEX_SOCK_UDP;
+                else {
+                    fprintf(stderr, "Error: --transport must be stream, seqpacket or udp\n");
+                    return 1;
+                }
+                break;
+            case 'j': threads = atoi(optarg); break;
+            case 'R':
+                if (strcmp(optarg, "flood") == 0) relay_policy = VEX_RELAY_FLOOD;
+                else if (strcmp(optarg, "counter") == 0) relay_policy = VEX_RELAY_COUNTER;
+                else if (strcmp(optarg, "gossip") == 0) relay_policy = VEX_RELAY_GOSSIP;
+                else {
+                    fprintf(stderr, "Error: --relay-policy must be flood, counter or gossip\n");
+                    return 1;
+                }
+                break;
+            case 'd': relay_delay = atoi(optarg); break;
+            case 'C': relay_count = atoi(optarg); break;
+            case 'g': gossip_prob = atof(optarg); break;
+            case 'Q':
+                if (strcmp(optarg, "off") == 0) qos = VEX_QOS_OFF;
+                else if (strcmp(optarg, "strict") == 0) qos = VEX_QOS_STRICT;
+                else if (strcmp(optarg, "weighted") == 0) qos = VEX_QOS_WEIGHTED;
+                else {
+                    fprintf(stderr, "Error: --qos must be off, strict or weighted\n");
+                    return 1;
+                }
+                break;
+            case 'P':
+                if ((priority = vex_mesh_priority(optarg)) < 0) {
+                    fprintf(stderr, "Error: --priority must be urgent, high, normal or bulk\n");
+                    return 1;
+                }
+                break;
             case 'v': printf("VexConnect v0.1\n"); return 0;
             case 'h':
             default:
@@ -136,6 +578,20 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    if (vex_transport_set_queue(txq_high, txq_low, txq_policy) != 0) {
+        fprintf(stderr, "Error: need 0 <= --txq-low < --txq-high <= %d\n", VEX_PEER_TX_QUEUE);
+        return 1;
+    }
+    if (coalesce_ms >= 0 && vex_transport_set_coalesce(coalesce_ms, coalesce_max) != 0) {
+        fprintf(stderr, "Error: need 0 <= --coalesce <= 1000 and %d <= --coalesce-max <= %d\n",
+                VEX_COALESCE_MIN, VEX_MAX_PACKET);
+        return 1;
+    }
+    if (threads < 1 || threads > VEX_MAX_THREADS) {
+        fprintf(stderr, "Error: --threads must be 1 to %d\n", VEX_MAX_THREADS);
+        return 1;
+    }
+
     /* Signal handlers */
     signal(SIGINT, handle_signal);
     signal(SIGTERM, handle_signal);
@@ -147,122 +603,124 @@ int main(int argc, char *argv[]) {
     if (name) strncpy(node.node_name, name, sizeof(node.node_name) - 1);
     node.default_ttl = (uint8_t)ttl;
     node.relay_enabled = relay;
+    if (vex_mesh_set_relay_policy(&node, relay_policy, relay_delay, relay_count, gossip_prob) != 0) {
+        fprintf(stderr, "Error: need 1 <= --relay-delay <= 60000, 2 <= --relay-count <= 255 "
+                "and 0 <= --gossip-prob <= 1\n");
+        return 1;
+    }
+
+    if (seen_mode == VEX_SEEN_BLOOM) {
+        if (seen_size <= 0 || seen_size > UINT32_MAX ||
+            vex_mesh_use_bloom(&node, (uint32_t)seen_size, seen_fp) != 0) {
+            fprintf(stderr, "Failed to set up bloom seen filter\n");
+            return 1;
+        }
+    }
+
+    node.priority = (uint8_t)priority;
+    if (vex_mesh_set_qos(&node, qos) != 0) {
+        fprintf(stderr, "Failed to set up the QoS relay queue\n");
+        return 1;
+    }
+
+    vex_reactor_init(&reactor);
+    vex_transport_set_peer_hook(on_peer_change, &node);
+    vex_transport_set_write_hook(on_peer_write, NULL);
+    vex_transport_set_mode(sock_mode);
+
+    if (use_uring && sock_mode != VEX_SOCK_STREAM) {
+        vex_log("TRANSPORT", "io_uring drives stream sockets only, using %s",
+                vex_reactor_backend(&reactor));
+    } else if (use_uring) {
+        if (vex_transport_uring_init(&node, on_frame, NULL) == 0 &&
+            vex_reactor_add(&reactor, vex_transport_uring_fd(), VEX_IO_READ, on_uring, NULL) != 0) {
+            vex_transport_uring_close();
+        }
+        if (!vex_transport_uring_active())
+            vex_log("TRANSPORT", "io_uring unavailable, using %s", vex_reactor_backend(&reactor));
+    }
+    vex_transport_set_batching(1);
+
+    if (threads > 1 && (sock_mode != VEX_SOCK_STREAM || vex_transport_uring_active())) {
+        vex_log("WORKER", "--threads needs the stream transport on epoll, relaying on one thread");
+        threads = 1;
+    }
+    if (threads > 1 && relay_policy == VEX_RELAY_COUNTER) {
+        /* Copies of a packet must be counted where it is held */
+        vex_log("WORKER", "--relay-policy counter holds packets per node, relaying on one thread");
+        threads = 1;
+    }
+    if (threads > 1) {
+        /* Workers share one seen cache, about four shards a thread */
+        if (vex_seen_shards_init(&seen_shards, (uint32_t)threads * 4, seen_mode,
+                                 (uint32_t)seen_size, seen_fp) != 0) {
+            fprintf(stderr, "Failed to set up the shared seen cache\n");
+            return 1;
+        }
+        node.seen_shared = &seen_shards;
+        if (vex_workers_start(&node, threads) != 0) {
+            fprintf(stderr, "Failed to start relay threads\n");
+            return 1;
+        }
+    }
 
     /* Start listening */
-    if (vex_transport_unix_init(&node, listen_path) != 0) {
+    int listening = sock_mode == VEX_SOCK_UDP ? vex_transport_udp_init(&node, listen_path)
+                                              : vex_transport_unix_init(&node, listen_path);
+    if (listening != 0) {
         fprintf(stderr, "Failed to start listener\n");
         return 1;
     }
 
     /* Connect to specified peers */
     for (int i = 0; i < peer_count; i++) {
-        vex_transport_unix_connect(&node, peer_paths[i]);
+        if (sock_mode == VEX_SOCK_UDP) {
+            vex_transport_udp_connect(&node, peer_paths[i]);
+        } else if (threads > 1) {
+            int fd = vex_transport_unix_dial(peer_paths[i]);
+            char peer_name[64];
+            snprintf(peer_name, sizeof(peer_name), "peer@%s", peer_paths[i]);
+            if (fd >= 0) vex_workers_adopt(fd, peer_name);
+        } else {
+            vex_transport_unix_connect(&node, peer_paths[i]);
+        }
     }
 
     char id_hex[9];
     vex_hex(node.sign_pk, 4, id_hex);
     printf("[VexConnect] Node %s ready (id: %s)\n", node.node_name, id_hex);
+    char addr_hex[2 * VEX_ADDR_SIZE + 1];
+    vex_hex(node.sign_pk, VEX_ADDR_SIZE, addr_hex);
+    printf("[VexConnect] Address for /msg: %s\n", addr_hex);
     printf("[VexConnect] Peers: %d | Relay: %s\n",
            node.peer_count, relay ? "ON" : "OFF");
     printf("[VexConnect] Type a message and press Enter to broadcast.\n");
-    printf("[VexConnect] Commands: /peers /stats /quit\n\n> ");
+    printf("[VexConnect] Commands: /msg /urgent /peers /routes /stats /quit\n\n> ");
     fflush(stdout);
 
-    /* Main loop */
+    if (node.listen_fd >= 0)
+        vex_reactor_add(&reactor, node.listen_fd, VEX_IO_READ, on_listen, NULL);
+    if (vex_reactor_add(&reactor, STDIN_FILENO, VEX_IO_READ, on_stdin, NULL) != 0)
+        vex_log("REACTOR", "stdin cannot be watched, prompt disabled");
+
+    /* Main loop: sleep until a socket or stdin is ready. Pruning piggybacks
+     * on traffic (the seen cache also expires lazily on every lookup), but
+     * over UDP the loop wakes every PRUNE_INTERVAL to send peers hellos. */
     time_t last_stats = time(NULL);
     time_t last_prune = time(NULL);
 
     while (node.running) {
-        /* Poll for stdin + peer data */
-        struct pollfd fds[VEX_MAX_PEERS + 2];
-        int nfds = 0;
-
-        /* stdin */
-        fds[nfds].fd = STDIN_FILENO;
-        fds[nfds].events = POLLIN;
-        nfds++;
-
-        /* listen socket */
-        if (node.listen_fd >= 0) {
-            fds[nfds].fd = node.listen_fd;
-            fds[nfds].events = POLLIN;
-            nfds++;
-        }
-
-        /* peer sockets */
-        for (int i = 0; i < VEX_MAX_PEERS; i++) {
-            if (node.peers[i].active) {
-                fds[nfds].fd = node.peers[i].fd;
-                fds[nfds].events = POLLIN;
-                nfds++;
-            }
-        }
-
-        int ready = poll(fds, nfds, 1000);  /* 1 second timeout */
-        if (ready < 0) continue;
-
-        /* Check stdin */
-        if (fds[0].revents & POLLIN) {
-            char input[512];
-            if (fgets(input, sizeof(input), stdin)) {
-                /* Strip newline */
-                size_t len = strlen(input);
-                if (len > 0 && input[len - 1] == '\n') input[--len] = '\0';
-                if (len == 0) { printf("> "); fflush(stdout); continue; }
-
-                /* Commands */
-                if (strcmp(input, "/quit") == 0 || strcmp(input, "/q") == 0) {
-                    node.running = 0;
-                    continue;
-                }
-                if (strcmp(input, "/peers") == 0) {
-                    print_peers(&node);
-                    printf("> "); fflush(stdout);
-                    continue;
-                }
-                if (strcmp(input, "/stats") == 0) {
-                    print_stats(&node);
-                    printf("> "); fflush(stdout);
-                    continue;
-                }
-
-                /* Send message */
-                vex_mesh_send(&node, input);
-                printf("> ");
-                fflush(stdout);
-            }
-        }
-
-        /* Check listen socket for new connections */
-        if (node.listen_fd >= 0) {
-            for (int i = 0; i < nfds; i++) {
-                if (fds[i].fd == node.listen_fd && (fds[i].revents & POLLIN)) {
-                    vex_transport_unix_accept(&node);
-                }
-            }
-        }
-
-        /* Check peer sockets for incoming data */
-        for (int i = 0; i < VEX_MAX_PEERS; i++) {
-            if (!node.peers[i].active) continue;
-
-            uint8_t buf[VEX_MAX_PACKET];
-            int n = vex_transport_unix_read(&node.peers[i], buf, sizeof(buf));
-            if (n > 0) {
-                vex_mesh_receive(&node, buf, (size_t)n, node.peers[i].fd);
-            } else if (n < 0) {
-                vex_log("TRANSPORT", "Peer %s disconnected", node.peers[i].name);
-                node.peer_count--;
-            }
-        }
+        vex_reactor_run_once(&reactor, next_timeout_ms(last_stats));
+        vex_mesh_tick(&node);            /* held relays that came due */
+        vex_transport_flush_all(&node);  /* one write per peer for this turn's sends */
 
-        /* Periodic maintenance */
         time_t now = time(NULL);
-        if (now - last_prune > 10) {
-            vex_seen_prune(&node.seen);
+        if (now - last_prune >= PRUNE_INTERVAL) {
+            vex_mesh_prune(&node);
+            if (sock_mode == VEX_SOCK_UDP) vex_transport_udp_prune(&node, VEX_UDP_IDLE_S);
             last_prune = now;
         }
-        if (show_stats && now - last_stats > 30) {
+        if (show_stats && now - last_stats >= STATS_INTERVAL) {
             print_stats(&node);
             printf("> "); fflush(stdout);
             last_stats = now;
@@ -270,10 +728,17 @@ int main(int argc, char *argv[]) {
     }
 
     /* Cleanup */
+    for (int i = 0; i < vex_workers_count(); i++)
+        node.packets_relayed += vex_workers_node(i)->packets_relayed;
+    vex_workers_stop();
+    if (node.seen_shared) vex_seen_shards_free(node.seen_shared);
+    vex_transport_flush_all(&node);
     if (node.listen_fd >= 0) close(node.listen_fd);
     for (int i = 0; i < VEX_MAX_PEERS; i++) {
         if (node.peers[i].active) close(node.peers[i].fd);
     }
+    vex_transport_uring_close();
+    vex_reactor_close(&reactor);
 
     printf("[VexConnect] Node %s offline. %llu packets relayed.\n",
            node.node_name, (unsigned long long)node.packets_relayed);
@@ -6,19 +6,27 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+static uint64_t (*clock_ms)(void) = vex_time_ms;
+
 /* Initialize mesh node */
 int vex_mesh_init(vex_node_t *node) {
     memset(node, 0, sizeof(*node));
 
     node->default_ttl = VEX_DEFAULT_TTL;
+    node->relay_policy = VEX_RELAY_FLOOD;
+    node->relay_delay_ms = VEX_RELAY_DEFAULT_DELAY_MS;
+    node->relay_count = VEX_RELAY_DEFAULT_COUNT;
+    node->gossip_prob = VEX_GOSSIP_DEFAULT_PROB;
     node->scan_interval = VEX_SCAN_INTERVAL;
     node->relay_enabled = 1;
     node->running = 1;
     node->started_at = time(NULL);
     node->listen_fd = -1;
 
-    /* Initialize dedup cache */
+    /* Initialize dedup cache, routes and reassembly */
     vex_seen_init(&node->seen);
+    vex_route_init(&node->routes);
+    node->frags = vex_frag_new();
 
     /* Initialize crypto (generate or load keys) */
     char keypath[256];
@@ -41,22 +49,59 @@ int vex_mesh_init(vex_node_t *node) {
     return 0;
 }
 
-/* Send a message into the mesh (broadcast) */
-int vex_mesh_send(vex_node_t *node, const char *message) {
-    vex_packet_t pkt;
-    uint8_t wire[VEX_MAX_PACKET];
-    uint8_t encrypted[VEX_MAX_PAYLOAD];
-    uint16_t encrypted_len;
-
-    size_t msg_len = strlen(message);
-    if (msg_len > VEX_MAX_PAYLOAD - 100) {  /* Leave room for crypto overhead */
-        vex_log("MESH", "Message too long (%zu bytes)", msg_len);
+/* Switch the node's dedup to the rotating Bloom filter backend */
+int vex_mesh_use_bloom(vex_node_t *node, uint32_t capacity, double fp_rate) {
+    if (vex_bloom_init(&node->seen_bloom, capacity, fp_rate) != 0) {
+        vex_log("MESH", "Bloom seen filter init failed (capacity=%u, fp=%g)",
+                capacity, fp_rate);
         return -1;
     }
+    node->seen_mode = VEX_SEEN_BLOOM;
+    vex_log("MESH", "Seen filter: bloom, %u IDs, fp=%g, %zu KB, k=%d",
+            capacity, fp_rate, vex_bloom_memory(&node->seen_bloom) / 1024,
+            node->seen_bloom.hashes);
+    return 0;
+}
+
+/* Dedup through whichever seen backend the node selected: remember
+ * packet_id, returning 1 if it was already there. With relay worker
+ * threads this is one locked step on the shared shards. */
+static int seen_test_add(vex_node_t *node, const uint8_t *packet_id) {
+    if (node->seen_shared)
+        return vex_seen_shards_test_add(node->seen_shared, packet_id);
+
+    if (node->seen_mode == VEX_SEEN_BLOOM) {
+        if (vex_bloom_check(&node->seen_bloom, packet_id)) return 1;
+        vex_bloom_add(&node->seen_bloom, packet_id);
+    } else {
+        if (vex_seen_check(&node->seen, packet_id)) return 1;
+        vex_seen_add(&node->seen, packet_id);
+    }
+    return 0;
+}
 
-    /* Encrypt the message */
-    if (vex_crypto_encrypt_broadcast(node, (const uint8_t *)message, (uint16_t)msg_len,
-                                      encrypted, &encrypted_len) != 0) {
+/* Periodic maintenance — expire old seen entries, routes and stalled
+ * reassemblies */
+void vex_mesh_prune(vex_node_t *node) {
+    vex_route_prune(&node->routes, time(NULL));
+    if (node->frags) vex_frag_prune(node->frags, time(NULL));
+    if (node->seen_shared)
+        vex_seen_shards_prune(node->seen_shared);
+    else if (node->seen_mode == VEX_SEEN_BLOOM)
+        vex_bloom_prune(&node->seen_bloom);
+    else
+        vex_seen_prune(&node->seen);
+}
+
+/* Seal the msg_len bytes already at wire + VEX_MSG_OFFSET and broadcast
+ * them. Returns peers reached, or -1 */
+static int broadcast_sealed(vex_node_t *node, uint8_t *wire, size_t msg_len, uint8_t flags,
+                            uint8_t *id_out) {
+    vex_packet_view_t pkt;
+    uint8_t *payload = wire + VEX_HEADER_SIZE;
+    uint16_t encrypted_len;
+
+    if (vex_crypto_seal_inplace(node, payload, (uint16_t)msg_len, &encrypted_len) != 0) {
         vex_log("MESH", "Encryption failed");
         return -1;
     }
@@ -64,41 +109,605 @@ int vex_mesh_send(vex_node_t *node, const char *message) {
     /* Build packet */
     pkt.version = VEX_VERSION;
     pkt.ttl = node->default_ttl;
-    pkt.flags = VEX_FLAG_ENCRYPTED | VEX_FLAG_BROADCAST;
+    pkt.flags = VEX_FLAG_ENCRYPTED | VEX_FLAG_BROADCAST | flags;
+    pkt.payload = payload;
     pkt.payload_len = encrypted_len;
-    memcpy(pkt.payload, encrypted, encrypted_len);
 
     /* Generate packet ID */
-    vex_packet_make_id(encrypted, encrypted_len, pkt.packet_id);
+    vex_packet_make_id(payload, encrypted_len, pkt.packet_id);
+    memcpy(id_out, pkt.packet_id, 8);
 
     /* Mark as seen (don't process our own packets) */
-    vex_seen_add(&node->seen, pkt.packet_id);
+    seen_test_add(node, pkt.packet_id);
 
-    /* Encode to wire format */
-    int wire_len = vex_packet_encode(&pkt, wire, sizeof(wire));
+    /* Encode header in front of the payload */
+    int wire_len = vex_packet_encode_header(&pkt, wire, VEX_MAX_PACKET);
     if (wire_len < 0) {
         vex_log("MESH", "Packet encode failed");
         return -1;
     }
 
     /* Send to all peers */
-    int sent = vex_transport_send_to_all(node, wire, (size_t)wire_len, -1);
     node->packets_sent++;
+    return vex_transport_send_to_all(node, wire, (size_t)wire_len, -1);
+}
+
+/* A message too long for one packet: send it as numbered fragments under
+ * one random message ID. Peer queues are flushed every half queue so a
+ * long message does not shed its own fragments */
+static int send_fragments(vex_node_t *node, const char *message, size_t msg_len, uint8_t flags) {
+    uint8_t wire[VEX_MAX_PACKET], msg_id[8], id[8];
+    int count = (int)((msg_len + VEX_FRAG_DATA - 1) / VEX_FRAG_DATA);
+    int sent = 0;
+
+    randombytes(msg_id, sizeof(msg_id));
+    for (int i = 0; i < count; i++) {
+        size_t off = (size_t)i * VEX_FRAG_DATA;
+        size_t piece = msg_len - off < VEX_FRAG_DATA ? msg_len - off : VEX_FRAG_DATA;
+
+        vex_frag_header(wire + VEX_MSG_OFFSET, msg_id, (uint8_t)i, (uint8_t)count);
+        memcpy(wire + VEX_MSG_OFFSET + VEX_FRAG_HDR, message + off, piece);
+        sent = broadcast_sealed(node, wire, VEX_FRAG_HDR + piece, flags | VEX_FLAG_FRAGMENT, id);
+        if (sent < 0) return -1;
+        if ((i + 1) % (VEX_PEER_TX_QUEUE / 2) == 0) vex_transport_flush_all(node);
+    }
 
     char id_hex[17];
-    vex_hex(pkt.packet_id, 8, id_hex);
+    vex_hex(msg_id, 8, id_hex);
+    vex_log("MESH", "Sent message [%s] in %d fragments TTL=%d → %d peers (%zu bytes)",
+            id_hex, count, node->default_ttl, sent, msg_len);
+    return sent;
+}
+
+/* Send a message into the mesh (broadcast) at the node's priority */
+int vex_mesh_send(vex_node_t *node, const char *message) {
+    return vex_mesh_send_prio(node, message, node->priority);
+}
+
+/* Broadcast at a VEX_PRIO_* priority, in fragments if the message does
+ * not fit one packet */
+int vex_mesh_send_prio(vex_node_t *node, const char *message, int priority) {
+    uint8_t wire[VEX_MAX_PACKET], id[8];
+    uint8_t flags = (uint8_t)((priority << VEX_FLAG_PRIO_SHIFT) & VEX_FLAG_PRIO_MASK);
+
+    size_t msg_len = strlen(message);
+    if (msg_len > VEX_MAX_MESSAGE) {
+        vex_log("MESH", "Message too long (%zu bytes, at most %d)", msg_len, VEX_MAX_MESSAGE);
+        return -1;
+    }
+    if (msg_len > VEX_MAX_PAYLOAD - 100)   /* Leave room for crypto overhead */
+        return send_fragments(node, message, msg_len, flags);
+
+    /* Place the message at its final wire position and encrypt it there */
+    memcpy(wire + VEX_MSG_OFFSET, message, msg_len);
+    int sent = broadcast_sealed(node, wire, msg_len, flags, id);
+    if (sent < 0) return -1;
+
+    char id_hex[17];
+    vex_hex(id, 8, id_hex);
     vex_log("MESH", "Sent [%s] TTL=%d → %d peers (%zu bytes)",
-            id_hex, pkt.ttl, sent, msg_len);
+            id_hex, node->default_ttl, sent, msg_len);
 
     return sent;
 }
 
-/* Process a received packet — decrypt, display, relay */
-int vex_mesh_receive(vex_node_t *node, const uint8_t *raw, size_t len, int source_fd) {
-    vex_packet_t pkt;
+/* An opened fragment: file it, and show the message once it is whole */
+static void fragment_received(vex_node_t *node, const uint8_t *frag, uint16_t len,
+                              const vex_packet_view_t *pkt) {
+    if (!node->frags && !(node->frags = vex_frag_new())) return;
+
+    size_t msg_len;
+    uint8_t *msg = vex_frag_add(node->frags, frag, len, time(NULL), &msg_len);
+    if (!msg) return;
+
+    printf("\r[MESH] ← %.*s (%zu bytes in %d fragments, TTL=%d, hops=%d)\n> ",
+           (int)msg_len, (const char *)msg, msg_len, frag[9], pkt->ttl,
+           node->default_ttl - pkt->ttl);
+    fflush(stdout);
+    free(msg);
+}
+
+/* ── Directed packets ──
+ * A directed packet follows the route cache toward its destination and
+ * floods only where no route is known. Every directed packet teaches the
+ * nodes it passes a route back to its source (see route.c), so a flooded
+ * discovery and its ack are enough to lay a path both ways. */
+
+static int is_me(const vex_node_t *node, const uint8_t *addr) {
+    return memcmp(node->sign_pk, addr, VEX_ADDR_SIZE) == 0;
+}
+
+/* Peer to send a directed packet to, or NULL to flood it. Never the peer
+ * it came from: a route leading back there is stale */
+static vex_peer_t *route_next_peer(vex_node_t *node, const uint8_t *dest, int source_fd) {
+    const vex_route_t *r = vex_route_lookup(&node->routes, dest, time(NULL));
+    if (!r || r->next_fd == source_fd) return NULL;
+    for (int i = 0; i < VEX_MAX_PEERS; i++)
+        if (node->peers[i].active && node->peers[i].fd == r->next_fd) return &node->peers[i];
+    return NULL;
+}
+
+/* Send a directed packet on: down its route if there is one, else flood */
+static int directed_forward(vex_node_t *node, uint8_t *raw, size_t len, int source_fd) {
+    vex_peer_t *next = len >= VEX_HEADER_SIZE + VEX_DIRECTED_HDR
+                     ? route_next_peer(node, raw + VEX_HEADER_SIZE, source_fd) : NULL;
+    if (next && vex_transport_send_to_peer(next, raw, len) == 0) {
+        node->packets_routed++;
+        return 1;
+    }
+    node->route_floods++;
+    return vex_transport_send_to_all(node, raw, len, source_fd);
+}
+
+/* Hand a relay to the transport: to all peers except the source, or
+ * along a route */
+static int relay_send(vex_node_t *node, uint8_t *raw, size_t len, int source_fd) {
+    int relayed = (raw[VEX_HEADER_SIZE - 1] & VEX_FLAG_DIRECTED)
+                ? directed_forward(node, raw, len, source_fd)
+                : vex_transport_send_to_all(node, raw, len, source_fd);
+    node->packets_relayed++;
+
+    char id_hex[17];
+    vex_hex(raw + 1, 8, id_hex);
+    vex_log("MESH", "Relay [%s] TTL=%d → %d peers", id_hex, raw[VEX_TTL_OFFSET], relayed);
+
+    return relayed;
+}
+
+/* ── QoS ──
+ * With a scheduler on, relays wait in a FIFO per priority class instead
+ * of going straight to the peers. Each loop turn (vex_mesh_tick) the
+ * scheduler releases as many as the fullest peer queue still draining can
+ * take (vex_transport_room), so under overload packets back up here,
+ * where their class is known, rather than in peer queues that shed
+ * blind. Strict drains the most urgent class first; weighted gives
+ * urgent, high, normal and bulk 8:4:2:1 of each round so bulk still
+ * moves. A full queue sheds the oldest packet of the least urgent class
+ * at or below the newcomer's, else the newcomer. */
+
+static const uint8_t prio_rank[VEX_PRIO_CLASSES] = {
+    [VEX_PRIO_URGENT] = 0, [VEX_PRIO_HIGH] = 1, [VEX_PRIO_NORMAL] = 2, [VEX_PRIO_BULK] = 3,
+};
+static const char *const class_names[VEX_PRIO_CLASSES] = { "urgent", "high", "normal", "bulk" };
+static const int class_weight[VEX_PRIO_CLASSES] = { 8, 4, 2, 1 };
+
+static int packet_rank(const uint8_t *raw) {
+    return prio_rank[(raw[VEX_HEADER_SIZE - 1] & VEX_FLAG_PRIO_MASK) >> VEX_FLAG_PRIO_SHIFT];
+}
+
+/* Take the oldest packet of a class off its FIFO; the caller frees the slot */
+static uint16_t qos_pop(vex_qos_t *q, int rank) {
+    vex_qos_class_t *c = &q->cls[rank];
+    uint16_t s = c->fifo[c->head];
+    c->head = (uint16_t)((c->head + 1) % VEX_QOS_QUEUE);
+    c->count--;
+    return s;
+}
+
+static void qos_free(vex_qos_t *q, uint16_t s) {
+    q->count--;
+    q->free_slot[VEX_QOS_QUEUE - q->count - 1] = s;
+}
+
+/* Queue a relay under its class, shedding by priority if full */
+static int qos_enqueue(vex_node_t *node, const uint8_t *raw, size_t len, int source_fd) {
+    vex_qos_t *q = node->qos;
+    int rank = packet_rank(raw);
+
+    if (q->count == VEX_QOS_QUEUE) {
+        int low = VEX_PRIO_CLASSES - 1;
+        while (low > rank && q->cls[low].count == 0) low--;
+        if (q->cls[low].count == 0) {        /* all queued are more urgent */
+            q->cls[rank].shed++;
+            return 0;
+        }
+        qos_free(q, qos_pop(q, low));
+        q->cls[low].shed++;
+    }
+
+    uint16_t s = q->free_slot[VEX_QOS_QUEUE - q->count - 1];
+    vex_qos_slot_t *slot = &q->slot[s];
+    slot->queued_ms = clock_ms();
+    slot->source_fd = source_fd;
+    slot->len = (uint16_t)len;
+    memcpy(slot->data, raw, len);
+
+    vex_qos_class_t *c = &q->cls[rank];
+    c->fifo[(c->head + c->count) % VEX_QOS_QUEUE] = s;
+    c->count++;
+    q->count++;
+    return 0;
+}
+
+/* Relay the oldest packet of a class */
+static void qos_send(vex_node_t *node, int rank, uint64_t now) {
+    vex_qos_t *q = node->qos;
+    vex_qos_class_t *c = &q->cls[rank];
+    uint16_t s = qos_pop(q, rank);
+    vex_qos_slot_t *slot = &q->slot[s];
+    uint64_t wait = now > slot->queued_ms ? now - slot->queued_ms : 0;
+
+    relay_send(node, slot->data, slot->len, slot->source_fd);
+    c->relayed++;
+    c->wait_ms_total += wait;
+    if (wait > c->wait_ms_max) c->wait_ms_max = wait;
+    qos_free(q, s);
+}
+
+/* Release up to budget queued relays in scheduler order */
+static void qos_drain(vex_node_t *node, int budget) {
+    vex_qos_t *q = node->qos;
+    uint64_t now = clock_ms();
+
+    while (budget > 0 && q->count > 0) {
+        for (int r = 0; r < VEX_PRIO_CLASSES && budget > 0; r++) {
+            int n = q->mode == VEX_QOS_WEIGHTED ? class_weight[r] : budget;
+            for (; n > 0 && budget > 0 && q->cls[r].count > 0; n--, budget--)
+                qos_send(node, r, now);
+        }
+    }
+}
+
+/* Choose the relay scheduler. Turning it off relays anything queued.
+ * Returns 0, or -1 on a bad mode or no memory */
+int vex_mesh_set_qos(vex_node_t *node, int mode) {
+    if (mode < VEX_QOS_OFF || mode > VEX_QOS_WEIGHTED) return -1;
+
+    if (mode == VEX_QOS_OFF) {
+        if (node->qos) {
+            qos_drain(node, VEX_QOS_QUEUE);
+            free(node->qos);
+            node->qos = NULL;
+        }
+        return 0;
+    }
+    if (!node->qos) {
+        vex_qos_t *q = calloc(1, sizeof(*q));
+        if (!q) return -1;
+        for (int i = 0; i < VEX_QOS_QUEUE; i++)
+            q->free_slot[i] = (uint16_t)(VEX_QOS_QUEUE - 1 - i);
+        node->qos = q;
+    }
+    node->qos->mode = mode;
+    return 0;
+}
+
+const char *vex_mesh_qos_name(int mode) {
+    switch (mode) {
+        case VEX_QOS_STRICT:   return "strict";
+        case VEX_QOS_WEIGHTED: return "weighted";
+        default:               return "off";
+    }
+}
+
+/* VEX_PRIO_* for a class name, or -1 */
+int vex_mesh_priority(const char *name) {
+    for (int p = 0; p < VEX_PRIO_CLASSES; p++)
+        if (strcmp(name, class_names[prio_rank[p]]) == 0) return p;
+    return -1;
+}
+
+const char *vex_mesh_priority_name(int priority) {
+    return class_names[prio_rank[priority & 3]];
+}
+
+/* Name of the class the scheduler serves rank-th, for stats */
+const char *vex_mesh_qos_class_name(int rank) {
+    return class_names[rank];
+}
+
+/* Forward a validated packet in place: decrement the TTL byte of the
+ * received buffer and hand that same buffer to the transport, or to the
+ * QoS queue */
+static int relay_in_place(vex_node_t *node, uint8_t *raw, size_t len, int source_fd) {
+    /* TTL check */
+    if (raw[VEX_TTL_OFFSET] <= 1) {
+        /* End of the line */
+        return 0;
+    }
+
+    raw[VEX_TTL_OFFSET]--;
+
+    if (node->qos) return qos_enqueue(node, raw, len, source_fd);
+    return relay_send(node, raw, len, source_fd);
+}
+
+/* ── Relay policies ──
+ * Flooding relays every new packet to every peer, so a dense cluster
+ * sends a copy per link. The counter policy (Ni et al., "The broadcast
+ * storm problem") holds a new packet for a random 0..relay_delay_ms and
+ * counts the copies heard meanwhile; once relay_count copies have arrived,
+ * enough neighbours have covered the area and the relay is dropped. The
+ * gossip policy relays with probability gossip_prob, except on a packet's
+ * first hop so a flood cannot die next to its origin. */
+
+static uint32_t random_u32(void) {
+    uint32_t r;
+    randombytes((uint8_t *)&r, sizeof(r));
+    return r;
+}
+
+static int due_before(const vex_relay_queue_t *q, uint16_t a, uint16_t b) {
+    return q->slot[a].due_ms < q->slot[b].due_ms;
+}
+
+static void queue_push(vex_relay_queue_t *q, uint16_t s) {
+    int i = q->count++;
+    while (i > 0 && due_before(q, s, q->heap[(i - 1) / 2])) {
+        q->heap[i] = q->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    q->heap[i] = s;
+}
 
-    /* Decode */
-    if (vex_packet_decode(raw, len, &pkt) != 0) {
+/* Remove the earliest entry and return its slot to the free list */
+static void queue_pop(vex_relay_queue_t *q) {
+    uint16_t top = q->heap[0], last = q->heap[--q->count];
+    int i = 0;
+    for (;;) {
+        int c = 2 * i + 1;
+        if (c >= q->count) break;
+        if (c + 1 < q->count && due_before(q, q->heap[c + 1], q->heap[c])) c++;
+        if (!due_before(q, q->heap[c], last)) break;
+        q->heap[i] = q->heap[c];
+        i = c;
+    }
+    if (q->count > 0) q->heap[i] = last;
+    q->free_slot[VEX_RELAY_PENDING - q->count - 1] = top;
+}
+
+/* Relay every held packet now (leaving the counter policy) */
+static void queue_flush(vex_node_t *node) {
+    vex_relay_queue_t *q = node->relay_queue;
+    while (q->count > 0) {
+        vex_relay_pending_t *p = &q->slot[q->heap[0]];
+        relay_in_place(node, p->data, p->len, p->source_fd);
+        queue_pop(q);
+    }
+}
+
+/* Choose how this node relays. delay_ms and count tune the counter
+ * policy, gossip_prob the gossip one. Returns 0, or -1 on a bad setting */
+int vex_mesh_set_relay_policy(vex_node_t *node, int policy, int delay_ms, int count,
+                              double gossip_prob) {
+    if (policy < VEX_RELAY_FLOOD || policy > VEX_RELAY_GOSSIP || delay_ms < 1 ||
+        delay_ms > 60000 || count < 2 || count > UINT8_MAX || gossip_prob < 0 ||
+        gossip_prob > 1) {
+        vex_log("MESH", "Bad relay policy settings");
+        return -1;
+    }
+
+    if (policy == VEX_RELAY_COUNTER && !node->relay_queue) {
+        vex_relay_queue_t *q = malloc(sizeof(*q));
+        if (!q) return -1;
+        q->count = 0;
+        for (int i = 0; i < VEX_RELAY_PENDING; i++)
+            q->free_slot[i] = (uint16_t)(VEX_RELAY_PENDING - 1 - i);
+        node->relay_queue = q;
+    } else if (policy != VEX_RELAY_COUNTER && node->relay_queue) {
+        queue_flush(node);
+        free(node->relay_queue);
+        node->relay_queue = NULL;
+    }
+
+    node->relay_policy = policy;
+    node->relay_delay_ms = delay_ms;
+    node->relay_count = count;
+    node->gossip_prob = gossip_prob;
+    return 0;
+}
+
+const char *vex_mesh_relay_policy_name(int policy) {
+    switch (policy) {
+        case VEX_RELAY_COUNTER: return "counter";
+        case VEX_RELAY_GOSSIP:  return "gossip";
+        default:                return "flood";
+    }
+}
+
+/* Clock for relay hold times, in ms; the simulator runs nodes on virtual
+ * time. NULL restores the wall clock */
+void vex_mesh_set_clock(uint64_t (*now_ms)(void)) {
+    clock_ms = now_ms ? now_ms : vex_time_ms;
+}
+
+/* Hold a new packet under the counter policy. Returns 0, or -1 if the
+ * queue is full and it should go out at once */
+static int relay_hold(vex_node_t *node, const uint8_t *raw, size_t len, int source_fd) {
+    vex_relay_queue_t *q = node->relay_queue;
+    if (q->count == VEX_RELAY_PENDING) return -1;
+
+    uint16_t s = q->free_slot[VEX_RELAY_PENDING - q->count - 1];
+    vex_relay_pending_t *p = &q->slot[s];
+    p->due_ms = clock_ms() + random_u32() % (uint32_t)(node->relay_delay_ms + 1);
+    p->source_fd = source_fd;
+    p->len = (uint16_t)len;
+    p->copies = 1;
+    memcpy(p->data, raw, len);
+    queue_push(q, s);
+    node->relays_deferred++;
+    return 0;
+}
+
+/* A duplicate arrived: count it against the held copy, if any */
+static void relay_heard_again(vex_node_t *node, const uint8_t *packet_id) {
+    vex_relay_queue_t *q = node->relay_queue;
+    for (int i = 0; i < q->count; i++) {
+        vex_relay_pending_t *p = &q->slot[q->heap[i]];
+        if (memcmp(p->data + 1, packet_id, 8) == 0) {
+            if (p->copies < UINT8_MAX) p->copies++;
+            return;
+        }
+    }
+}
+
+/* Relay a new packet as the node's policy says: now, later, or not at all */
+static int relay_by_policy(vex_node_t *node, uint8_t *raw, size_t len, int source_fd) {
+    if (raw[VEX_TTL_OFFSET] <= 1) return 0;
+
+    /* A directed packet with a route is one send, not a flood */
+    if ((raw[VEX_HEADER_SIZE - 1] & VEX_FLAG_DIRECTED) &&
+        route_next_peer(node, raw + VEX_HEADER_SIZE, source_fd))
+        return relay_in_place(node, raw, len, source_fd);
+
+    if (node->relay_policy == VEX_RELAY_GOSSIP) {
+        int first_hop = raw[VEX_TTL_OFFSET] >= node->default_ttl;
+        if (!first_hop && random_u32() >= (uint32_t)(node->gossip_prob * 4294967295.0)) {
+            node->relays_suppressed++;
+            return 0;
+        }
+    } else if (node->relay_policy == VEX_RELAY_COUNTER && relay_hold(node, raw, len, source_fd) == 0) {
+        return 0;
+    }
+    return relay_in_place(node, raw, len, source_fd);
+}
+
+/* Once per loop turn, before the flush: relay held packets that have come
+ * due, unless enough copies were heard, then let the QoS scheduler pass
+ * on what the peers have room for */
+void vex_mesh_tick(vex_node_t *node) {
+    vex_relay_queue_t *q = node->relay_queue;
+    if (q && q->count > 0) {
+        uint64_t now = clock_ms();
+        while (q->count > 0 && q->slot[q->heap[0]].due_ms <= now) {
+            vex_relay_pending_t *p = &q->slot[q->heap[0]];
+            if (p->copies >= node->relay_count) node->relays_suppressed++;
+            else relay_in_place(node, p->data, p->len, p->source_fd);
+            queue_pop(q);
+        }
+    }
+    if (node->qos && node->qos->count > 0)
+        qos_drain(node, vex_transport_room(node));
+}
+
+/* When the next held packet comes due (vex_mesh_set_clock's ms), or 0 if
+ * nothing is held. A QoS backlog is due again next millisecond: it waits
+ * on peer queues draining, which need not wake the caller */
+uint64_t vex_mesh_next_due(const vex_node_t *node) {
+    const vex_relay_queue_t *q = node->relay_queue;
+    uint64_t due = q && q->count > 0 ? q->slot[q->heap[0]].due_ms : 0;
+    if (node->qos && node->qos->count > 0) {
+        uint64_t soon = clock_ms() + 1;
+        if (!due || soon < due) due = soon;
+    }
+    return due;
+}
+
+/* Stamp the header in front of a payload built in wire, mark it seen and
+ * send it toward its destination. Returns peers reached, or -1 */
+static int directed_send(vex_node_t *node, uint8_t *wire, uint16_t payload_len, uint8_t flags,
+                         uint8_t *id_out) {
+    vex_packet_view_t pkt;
+
+    pkt.version = VEX_VERSION;
+    pkt.ttl = node->default_ttl;
+    pkt.flags = flags | VEX_FLAG_DIRECTED |
+                (uint8_t)((node->priority << VEX_FLAG_PRIO_SHIFT) & VEX_FLAG_PRIO_MASK);
+    pkt.payload = wire + VEX_HEADER_SIZE;
+    pkt.payload_len = payload_len;
+    vex_packet_make_id(pkt.payload, payload_len, pkt.packet_id);
+    seen_test_add(node, pkt.packet_id);
+    memcpy(id_out, pkt.packet_id, 8);
+
+    int wire_len = vex_packet_encode_header(&pkt, wire, VEX_MAX_PACKET);
+    if (wire_len < 0) return -1;
+    node->packets_sent++;
+    return directed_forward(node, wire, (size_t)wire_len, -1);
+}
+
+/* Directed header: to dest, from this node, starting at its default TTL */
+static void directed_header(const vex_node_t *node, uint8_t *payload, const uint8_t *dest) {
+    memcpy(payload, dest, VEX_ADDR_SIZE);
+    memcpy(payload + VEX_ADDR_SIZE, node->sign_pk, VEX_ADDR_SIZE);
+    payload[2 * VEX_ADDR_SIZE] = node->default_ttl;
+}
+
+/* Send a message to one node by address. With no route yet it floods and
+ * asks for an ack, whose trip back lays the route. Returns peers reached,
+ * or -1 */
+int vex_mesh_send_to(vex_node_t *node, const uint8_t *dest, const char *message) {
+    uint8_t wire[VEX_MAX_PACKET];
+    uint8_t *payload = wire + VEX_HEADER_SIZE;
+    uint16_t encrypted_len;
+
+    size_t msg_len = strlen(message);
+    if (msg_len > VEX_MAX_PAYLOAD - 100 - VEX_DIRECTED_HDR) {
+        vex_log("MESH", "Message too long (%zu bytes)", msg_len);
+        return -1;
+    }
+
+    directed_header(node, payload, dest);
+    memcpy(payload + VEX_DIRECTED_HDR + VEX_SEAL_OVERHEAD, message, msg_len);
+    if (vex_crypto_seal_inplace(node, payload + VEX_DIRECTED_HDR, (uint16_t)msg_len,
+                                &encrypted_len) != 0) {
+        vex_log("MESH", "Encryption failed");
+        return -1;
+    }
+
+    int known = vex_route_lookup(&node->routes, dest, time(NULL)) != NULL;
+    uint8_t id[8];
+    int sent = directed_send(node, wire, (uint16_t)(VEX_DIRECTED_HDR + encrypted_len),
+                             VEX_FLAG_ENCRYPTED | (known ? 0 : VEX_FLAG_ACK_REQ), id);
+
+    char id_hex[17], dest_hex[2 * VEX_ADDR_SIZE + 1];
+    vex_hex(id, 8, id_hex);
+    vex_hex(dest, VEX_ADDR_SIZE, dest_hex);
+    vex_log("MESH", "Sent [%s] to %s %s → %d peers (%zu bytes)", id_hex, dest_hex,
+            known ? "by route" : "by flood, route discovery", sent, msg_len);
+    return sent;
+}
+
+/* A directed packet for this node: show its message or note the ack, and
+ * ack it if the sender asked */
+static void directed_deliver(vex_node_t *node, const vex_packet_view_t *pkt) {
+    const uint8_t *src = pkt->payload + VEX_ADDR_SIZE;
+    const uint8_t *body = pkt->payload + VEX_DIRECTED_HDR;
+    uint16_t body_len = (uint16_t)(pkt->payload_len - VEX_DIRECTED_HDR);
+    int hops = pkt->payload[2 * VEX_ADDR_SIZE] - pkt->ttl + 1;
+    char src_hex[2 * VEX_ADDR_SIZE + 1], id_hex[17];
+    vex_hex(src, VEX_ADDR_SIZE, src_hex);
+
+    if (!(pkt->flags & VEX_FLAG_ENCRYPTED)) {
+        if (body_len == 8) {
+            vex_hex(body, 8, id_hex);
+            vex_log("MESH", "Ack for [%s] from %s, %d hops", id_hex, src_hex, hops);
+        }
+        return;
+    }
+
+    uint8_t box[VEX_MAX_PAYLOAD + 1];
+    uint16_t plain_len;
+    memcpy(box, body, body_len);
+    if (vex_crypto_open_inplace(node, box, body_len, &plain_len) == 0) {
+        char *plaintext = (char *)box + VEX_SEAL_OVERHEAD;
+        plaintext[plain_len] = '\0';
+        printf("\r[MESH] ← %s (from %s, hops=%d)\n> ", plaintext, src_hex, hops);
+        fflush(stdout);
+    } else {
+        vex_hex(pkt->packet_id, 8, id_hex);
+        vex_log("MESH", "Decryption failed for packet %s", id_hex);
+    }
+
+    if (pkt->flags & VEX_FLAG_ACK_REQ) {
+        uint8_t wire[VEX_MAX_PACKET], id[8];
+        directed_header(node, wire + VEX_HEADER_SIZE, src);
+        memcpy(wire + VEX_HEADER_SIZE + VEX_DIRECTED_HDR, pkt->packet_id, 8);
+        directed_send(node, wire, VEX_DIRECTED_HDR + 8, 0, id);
+    }
+}
+
+/* A peer went away: stop routing through it */
+void vex_mesh_peer_down(vex_node_t *node, int fd) {
+    vex_route_drop_peer(&node->routes, fd);
+}
+
+/* Process a received packet — decrypt, display, relay.
+ * On relay the TTL byte of raw is rewritten in place. */
+int vex_mesh_receive(vex_node_t *node, uint8_t *raw, size_t len, int source_fd) {
+    vex_packet_view_t pkt;
+
+    /* Decode header; payload stays in raw */
+    if (vex_packet_decode_view(raw, len, &pkt) != 0) {
         node->packets_dropped++;
         return -1;
     }
@@ -112,67 +721,68 @@ int vex_mesh_receive(vex_node_t *node, const uint8_t *raw, size_t len, int sourc
     char id_hex[17];
     vex_hex(pkt.packet_id, 8, id_hex);
 
-    /* Dedup check */
-    if (vex_seen_check(&node->seen, pkt.packet_id)) {
+    /* Directed: learn the way back to the source, duplicates included
+     * (a copy may have come a shorter way) */
+    int directed = (pkt.flags & VEX_FLAG_DIRECTED) != 0;
+    if (directed) {
+        if (pkt.payload_len < VEX_DIRECTED_HDR) {
+            node->packets_dropped++;
+            return -1;
+        }
+        const uint8_t *src = pkt.payload + VEX_ADDR_SIZE;
+        uint8_t ttl0 = pkt.payload[2 * VEX_ADDR_SIZE];
+        if (source_fd >= 0 && ttl0 >= pkt.ttl && !is_me(node, src))
+            vex_route_learn(&node->routes, src, source_fd, (uint8_t)(ttl0 - pkt.ttl + 1),
+                            time(NULL));
+    }
+
+    /* Dedup check, marking it seen if new */
+    if (seen_test_add(node, pkt.packet_id)) {
         /* Already seen — drop silently */
         node->packets_dropped++;
+        if (node->relay_queue) relay_heard_again(node, pkt.packet_id);
         return 0;
     }
-
-    /* Mark as seen */
-    vex_seen_add(&node->seen, pkt.packet_id);
     node->packets_received++;
 
-    /* Decrypt and display */
-    if (pkt.flags & VEX_FLAG_ENCRYPTED) {
-        uint8_t plaintext[VEX_MAX_PAYLOAD];
+    /* Directed packets are opened only by their destination, which
+     * does not relay them */
+    if (directed) {
+        if (is_me(node, pkt.payload)) {
+            directed_deliver(node, &pkt);
+            return 0;
+        }
+    } else if (pkt.flags & VEX_FLAG_ENCRYPTED) {
+        /* Decrypt and display. raw is still needed for the relay, so open
+         * a copy of the payload in place — the only copy on this path */
+        uint8_t box[VEX_MAX_PAYLOAD + 1];
         uint16_t plain_len;
 
-        if (vex_crypto_decrypt_broadcast(node, pkt.payload, pkt.payload_len,
-                                          plaintext, &plain_len) == 0) {
+        memcpy(box, pkt.payload, pkt.payload_len);
+        if (vex_crypto_open_inplace(node, box, pkt.payload_len, &plain_len) != 0) {
+            vex_log("MESH", "Decryption failed for packet %s", id_hex);
+        } else if (pkt.flags & VEX_FLAG_FRAGMENT) {
+            fragment_received(node, box + VEX_SEAL_OVERHEAD, plain_len, &pkt);
+        } else {
+            char *plaintext = (char *)box + VEX_SEAL_OVERHEAD;
             plaintext[plain_len] = '\0';
             printf("\r[MESH] ← %s (TTL=%d, hops=%d)\n> ",
-                   (char *)plaintext, pkt.ttl, node->default_ttl - pkt.ttl);
+                   plaintext, pkt.ttl, node->default_ttl - pkt.ttl);
             fflush(stdout);
-        } else {
-            vex_log("MESH", "Decryption failed for packet %s", id_hex);
         }
     }
 
-    /* Relay to other peers */
+    /* Relay to other peers (header already validated by decode) */
     if (node->relay_enabled) {
-        return vex_mesh_relay(node, raw, len, source_fd);
+        return relay_by_policy(node, raw, len, source_fd);
     }
 
     return 0;
 }
 
-/* Relay a packet to all peers except the source */
-int vex_mesh_relay(vex_node_t *node, const uint8_t *raw, size_t len, int source_fd) {
-    vex_packet_t pkt;
-
-    if (vex_packet_decode(raw, len, &pkt) != 0) return -1;
-
-    /* TTL check */
-    if (pkt.ttl <= 1) {
-        /* End of the line */
-        return 0;
-    }
-
-    /* Decrement TTL and re-encode */
-    pkt.ttl--;
-
-    uint8_t wire[VEX_MAX_PACKET];
-    int wire_len = vex_packet_encode(&pkt, wire, sizeof(wire));
-    if (wire_len < 0) return -1;
-
-    /* Forward to all peers except source */
-    int relayed = vex_transport_send_to_all(node, wire, (size_t)wire_len, source_fd);
-    node->packets_relayed++;
-
-    char id_hex[17];
-    vex_hex(pkt.packet_id, 8, id_hex);
-    vex_log("MESH", "Relay [%s] TTL=%d → %d peers", id_hex, pkt.ttl, relayed);
-
-    return relayed;
+/* Relay a packet to all peers except the source.
+ * The TTL byte of raw is decremented in place. */
+int vex_mesh_relay(vex_node_t *node, uint8_t *raw, size_t len, int source_fd) {
+    if (vex_packet_validate(raw, len) != 0) return -1;
+    return relay_in_place(node, raw, len, source_fd);
 }
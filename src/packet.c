@@ -5,8 +5,70 @@
 #include <string.h>
 #include <stdio.h>
 
-/* Generate packet ID: first 8 bytes of SHA-512(payload + timestamp + random) */
-void vex_packet_make_id(const uint8_t *payload, uint16_t len, uint8_t *id_out) {
+/* ── Packet IDs ──
+ * IDs only need to be unique and unlinkable to content. The default
+ * scheme runs SipHash-2-4, keyed with a per-thread random key, over the
+ * payload's leading nonce bytes plus a counter: a few dozen cycles instead
+ * of a full SHA-512 over the payload. VEX_ID_SHA512 keeps the old scheme. */
+
+#define ID_NONCE_BYTES 24    /* secretbox nonce at the front of encrypted payloads */
+
+static int id_scheme = VEX_ID_SIPHASH;
+
+static _Thread_local struct {
+    uint64_t k0, k1;
+    uint64_t counter;
+    int      keyed;
+} id_state;
+
+void vex_packet_set_id_scheme(int scheme) {
+    id_scheme = scheme;
+}
+
+#define ROTL64(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+#define SIPROUND(v0, v1, v2, v3) do {                                    \
+        v0 += v1; v1 = ROTL64(v1, 13); v1 ^= v0; v0 = ROTL64(v0, 32);   \
+        v2 += v3; v3 = ROTL64(v3, 16); v3 ^= v2;                        \
+        v0 += v3; v3 = ROTL64(v3, 21); v3 ^= v0;                        \
+        v2 += v1; v1 = ROTL64(v1, 17); v1 ^= v2; v2 = ROTL64(v2, 32);   \
+    } while (0)
+
+static uint64_t le64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+/* SipHash-2-4 of m[0..len) under (k0, k1) */
+static uint64_t siphash24(uint64_t k0, uint64_t k1, const uint8_t *m, size_t len) {
+    uint64_t v0 = k0 ^ 0x736f6d6570736575ULL;
+    uint64_t v1 = k1 ^ 0x646f72616e646f6dULL;
+    uint64_t v2 = k0 ^ 0x6c7967656e657261ULL;
+    uint64_t v3 = k1 ^ 0x7465646279746573ULL;
+    size_t full = len & ~(size_t)7;
+
+    for (size_t i = 0; i < full; i += 8) {
+        uint64_t w = le64(m + i);
+        v3 ^= w;
+        SIPROUND(v0, v1, v2, v3);
+        SIPROUND(v0, v1, v2, v3);
+        v0 ^= w;
+    }
+
+    uint64_t last = (uint64_t)len << 56;
+    for (size_t i = 0; i < (len & 7); i++) last |= (uint64_t)m[full + i] << (8 * i);
+    v3 ^= last;
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    v0 ^= last;
+
+    v2 ^= 0xff;
+    for (int i = 0; i < 4; i++) SIPROUND(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/* Original scheme: first 8 bytes of SHA-512(payload + random nonce) */
+static void make_id_sha512(const uint8_t *payload, uint16_t len, uint8_t *id_out) {
     uint8_t hash_input[VEX_MAX_PAYLOAD + 16];
     uint8_t hash_output[64];
     uint8_t nonce[8];
@@ -19,6 +81,43 @@ void vex_packet_make_id(const uint8_t *payload, uint16_t len, uint8_t *id_out) {
     memcpy(id_out, hash_output, 8);
 }
 
+/* SipHash(key, payload nonce || counter) */
+static void make_id_siphash(const uint8_t *payload, uint16_t len, uint8_t *id_out) {
+    uint8_t input[ID_NONCE_BYTES + 8];
+    size_t n = len < ID_NONCE_BYTES ? len : ID_NONCE_BYTES;
+
+    if (!id_state.keyed) {
+        uint8_t key[16];
+        randombytes(key, sizeof(key));
+        id_state.k0 = le64(key);
+        id_state.k1 = le64(key + 8);
+        id_state.keyed = 1;
+    }
+
+    memcpy(input, payload, n);
+    uint64_t ctr = id_state.counter++;
+    for (int i = 0; i < 8; i++) input[n + i] = (uint8_t)(ctr >> (8 * i));
+
+    uint64_t h = siphash24(id_state.k0, id_state.k1, input, n + 8);
+    for (int i = 0; i < 8; i++) id_out[i] = (uint8_t)(h >> (8 * i));
+}
+
+/* Generate an 8-byte packet ID for a payload using the selected scheme */
+void vex_packet_make_id(const uint8_t *payload, uint16_t len, uint8_t *id_out) {
+    if (id_scheme == VEX_ID_SHA512)
+        make_id_sha512(payload, len, id_out);
+    else
+        make_id_siphash(payload, len, id_out);
+}
+
+static void write_header(uint8_t *buf, uint8_t version, const uint8_t *packet_id,
+                         uint8_t ttl, uint8_t flags) {
+    buf[0] = version;
+    memcpy(buf + 1, packet_id, 8);
+    buf[9] = ttl;
+    buf[10] = flags;
+}
+
 /* Encode packet to wire format. Returns bytes written, or -1 on error */
 int vex_packet_encode(const vex_packet_t *pkt, uint8_t *buf, size_t buf_len) {
     size_t total = VEX_HEADER_SIZE + pkt->payload_len;
@@ -26,10 +125,7 @@ int vex_packet_encode(const vex_packet_t *pkt, uint8_t *buf, size_t buf_len) {
     if (total > buf_len || total > VEX_MAX_PACKET) return -1;
     if (pkt->version != VEX_VERSION) return -1;
 
-    buf[0] = pkt->version;
-    memcpy(buf + 1, pkt->packet_id, 8);
-    buf[9] = pkt->ttl;
-    buf[10] = pkt->flags;
+    write_header(buf, pkt->version, pkt->packet_id, pkt->ttl, pkt->flags);
 
     if (pkt->payload_len > 0) {
         memcpy(buf + VEX_HEADER_SIZE, pkt->payload, pkt->payload_len);
@@ -38,6 +134,14 @@ int vex_packet_encode(const vex_packet_t *pkt, uint8_t *buf, size_t buf_len) {
     return (int)total;
 }
 
+/* Check wire bytes carry a well-formed header without copying anything.
+ * Accepts exactly what vex_packet_decode() accepts. Returns 0 if valid, -1 if not */
+int vex_packet_validate(const uint8_t *buf, size_t len) {
+    if (len < VEX_HEADER_SIZE || len > VEX_MAX_PACKET) return -1;
+    if (buf[0] != VEX_VERSION) return -1;
+    return 0;
+}
+
 /* Decode wire bytes to packet. Returns 0 on success, -1 on error */
 int vex_packet_decode(const uint8_t *buf, size_t len, vex_packet_t *pkt) {
     if (len < VEX_HEADER_SIZE) return -1;
@@ -58,3 +162,31 @@ int vex_packet_decode(const uint8_t *buf, size_t len, vex_packet_t *pkt) {
 
     return 0;
 }
+
+/* Decode wire bytes to a view pointing into buf (no payload copy).
+ * The view is valid only while buf is. Returns 0 on success, -1 on error */
+int vex_packet_decode_view(const uint8_t *buf, size_t len, vex_packet_view_t *view) {
+    if (vex_packet_validate(buf, len) != 0) return -1;
+
+    view->version = buf[0];
+    memcpy(view->packet_id, buf + 1, 8);
+    view->ttl = buf[9];
+    view->flags = buf[10];
+    view->payload = buf + VEX_HEADER_SIZE;
+    view->payload_len = (uint16_t)(len - VEX_HEADER_SIZE);
+
+    return 0;
+}
+
+/* Write only the header for view into buf. The payload is expected to be
+ * in place already at buf + VEX_HEADER_SIZE (view->payload is not read).
+ * Returns total packet length, or -1 on error */
+int vex_packet_encode_header(const vex_packet_view_t *view, uint8_t *buf, size_t buf_len) {
+    size_t total = VEX_HEADER_SIZE + view->payload_len;
+
+    if (total > buf_len || total > VEX_MAX_PACKET) return -1;
+    if (view->version != VEX_VERSION) return -1;
+
+    write_header(buf, view->version, view->packet_id, view->ttl, view->flags);
+    return (int)total;
+}
@@ -0,0 +1,139 @@
+/* pool.c — Refcounted packet buffers shared by receive, relay and queues
+ *
+ * One fixed slab of VEX_POOL_BUFS buffers, each holding a length-prefixed
+ * frame, threaded on a free list. Fanout queues the same buffer on every
+ * peer with one reference each, so a packet relayed to N peers is stored
+ * once. Nothing is allocated after startup: an empty pool is a drop, which
+ * bounds transmit memory under flood at VEX_POOL_BUFS * sizeof(vex_pktbuf_t)
+ * however many peers are backed up.
+ *
+ * With relay worker threads the pool is shared: the free list takes a
+ * lock and reference counts become atomic read-modify-writes. Until then
+ * both are plain, so the single-threaded relay pays for neither. */
+
+#include "vex.h"
+#include <string.h>
+#include <stddef.h>
+
+#if VEX_POOL_BUFS > UINT16_MAX
+#error "VEX_POOL_BUFS must fit the free list's uint16_t links"
+#endif
+
+#define POOL_NONE UINT16_MAX
+
+static vex_pktbuf_t bufs[VEX_POOL_BUFS];
+static uint16_t free_head = POOL_NONE;
+static int ready;
+static int shared;
+static pthread_mutex_t free_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t in_use, peak;
+static uint64_t exhausted;
+
+static uint16_t refs_get(vex_pktbuf_t *b) {
+    return atomic_load_explicit(&b->refs, memory_order_relaxed);
+}
+
+static void refs_set(vex_pktbuf_t *b, uint16_t n) {
+    atomic_store_explicit(&b->refs, n, memory_order_relaxed);
+}
+
+static void pool_init(void) {
+    for (uint32_t i = 0; i < VEX_POOL_BUFS; i++)
+        bufs[i].next_free = i + 1 < VEX_POOL_BUFS ? (uint16_t)(i + 1) : POOL_NONE;
+    free_head = 0;
+    ready = 1;
+}
+
+/* Share the pool between threads (on=1) before any of them use it */
+void vex_pool_set_shared(int on) {
+    if (!ready) pool_init();
+    shared = on;
+}
+
+/* Take an empty buffer with one reference, or NULL if the pool is spent */
+vex_pktbuf_t *vex_pool_alloc(void) {
+    vex_pktbuf_t *b = NULL;
+
+    if (shared) pthread_mutex_lock(&free_lock);
+    else if (!ready) pool_init();
+
+    if (free_head == POOL_NONE) {
+        exhausted++;
+    } else {
+        b = &bufs[free_head];
+        free_head = b->next_free;
+        if (++in_use > peak) peak = in_use;
+    }
+    if (shared) pthread_mutex_unlock(&free_lock);
+
+    if (b) {
+        refs_set(b, 1);
+        b->len = 0;
+    }
+    return b;
+}
+
+/* The buffer whose packet starts at data, if data is one (a receive that
+ * landed in the pool and is now being relayed), else NULL */
+vex_pktbuf_t *vex_pool_owner(const uint8_t *data, size_t len) {
+    const uint8_t *base = (const uint8_t *)bufs;
+    if (data < base || data >= base + sizeof(bufs)) return NULL;
+
+    size_t idx = (size_t)(data - base) / sizeof(vex_pktbuf_t);
+    vex_pktbuf_t *b = &bufs[idx];
+    if (data != b->data + 2 || refs_get(b) == 0 || len + 2 != b->len) return NULL;
+    return b;
+}
+
+/* A referenced buffer holding data as a length-prefixed frame: the pool
+ * buffer data already lives in, else a fresh one it is copied into */
+vex_pktbuf_t *vex_pool_frame(const uint8_t *data, size_t len) {
+    if (len > VEX_MAX_PACKET) return NULL;
+
+    vex_pktbuf_t *b = vex_pool_owner(data, len);
+    if (b) {
+        vex_pool_ref(b);
+        return b;
+    }
+
+    b = vex_pool_alloc();
+    if (!b) return NULL;
+    b->data[0] = (uint8_t)(len >> 8);
+    b->data[1] = (uint8_t)(len & 0xFF);
+    memcpy(b->data + 2, data, len);
+    b->len = (uint16_t)(2 + len);
+    return b;
+}
+
+void vex_pool_ref(vex_pktbuf_t *b) {
+    if (shared) atomic_fetch_add_explicit(&b->refs, 1, memory_order_relaxed);
+    else refs_set(b, (uint16_t)(refs_get(b) + 1));
+}
+
+/* Drop a reference; the last one returns the buffer to the free list */
+void vex_pool_put(vex_pktbuf_t *b) {
+    if (!b) return;
+    if (!shared) {
+        uint16_t left = (uint16_t)(refs_get(b) - 1);
+        refs_set(b, left);
+        if (left > 0) return;
+    } else {
+        /* acq_rel: every other holder's use of the buffer happens before
+         * the last one recycles it */
+        if (atomic_fetch_sub_explicit(&b->refs, 1, memory_order_acq_rel) != 1) return;
+        pthread_mutex_lock(&free_lock);
+    }
+
+    b->next_free = free_head;
+    free_head = (uint16_t)(b - bufs);
+    in_use--;
+    if (shared) pthread_mutex_unlock(&free_lock);
+}
+
+void vex_pool_stats(uint32_t *used, uint32_t *high_water, uint64_t *misses) {
+    if (shared) pthread_mutex_lock(&free_lock);
+    *used = in_use;
+    *high_water = peak;
+    *misses = exhausted;
+    if (shared) pthread_mutex_unlock(&free_lock);
+}
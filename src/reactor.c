@@ -0,0 +1,193 @@
+/* reactor.c — fd readiness loop with per-fd callbacks
+ *
+ * Linux builds use epoll: the kernel keeps the interest set, and a wakeup
+ * returns only the fds that are ready. Other builds (cosmocc) fall back to
+ * poll() over a watch list that is edited in place on add/del rather than
+ * rebuilt each turn. Either way the loop sleeps until an fd is ready or
+ * the caller's timeout expires; with no timeout there are no idle wakeups. */
+
+#include "vex.h"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#if defined(__linux__) && !defined(__COSMOPOLITAN__)
+#define HAVE_EPOLL 1
+#include <sys/epoll.h>
+#endif
+
+#define REACTOR_BATCH 64
+
+#ifdef HAVE_EPOLL
+static uint32_t to_epoll(uint32_t events) {
+    uint32_t ev = 0;
+    if (events & VEX_IO_READ) ev |= EPOLLIN;
+    if (events & VEX_IO_WRITE) ev |= EPOLLOUT;
+    return ev;
+}
+
+static uint32_t from_epoll(uint32_t ev) {
+    uint32_t events = 0;
+    if (ev & EPOLLIN) events |= VEX_IO_READ;
+    if (ev & EPOLLOUT) events |= VEX_IO_WRITE;
+    if (ev & (EPOLLERR | EPOLLHUP)) events |= VEX_IO_ERROR;
+    return events;
+}
+#endif
+
+static short to_poll(uint32_t events) {
+    short ev = 0;
+    if (events & VEX_IO_READ) ev |= POLLIN;
+    if (events & VEX_IO_WRITE) ev |= POLLOUT;
+    return ev;
+}
+
+static uint32_t from_poll(short ev) {
+    uint32_t events = 0;
+    if (ev & POLLIN) events |= VEX_IO_READ;
+    if (ev & POLLOUT) events |= VEX_IO_WRITE;
+    if (ev & (POLLERR | POLLHUP | POLLNVAL)) events |= VEX_IO_ERROR;
+    return events;
+}
+
+int vex_reactor_init(vex_reactor_t *r) {
+    memset(r, 0, sizeof(*r));
+    r->epoll_fd = -1;
+
+#ifdef HAVE_EPOLL
+    r->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (r->epoll_fd < 0)
+        vex_log("REACTOR", "epoll unavailable (%s), using poll()", strerror(errno));
+#endif
+    return 0;
+}
+
+void vex_reactor_close(vex_reactor_t *r) {
+    if (r->epoll_fd >= 0) close(r->epoll_fd);
+    r->epoll_fd = -1;
+    r->npfds = 0;
+}
+
+/* Watch fd for events, replacing any handler already registered for it.
+ * Returns 0, or -1 if the fd cannot be watched (e.g. a regular file). */
+int vex_reactor_add(vex_reactor_t *r, int fd, uint32_t events, vex_io_fn fn, void *ctx) {
+    if (fd < 0 || fd >= VEX_REACTOR_MAX_FDS || !fn) return -1;
+    vex_io_handler_t *h = &r->handlers[fd];
+
+    if (h->fn) {
+        h->fn = fn;
+        h->ctx = ctx;
+        return vex_reactor_mod(r, fd, events);
+    }
+
+#ifdef HAVE_EPOLL
+    if (r->epoll_fd >= 0) {
+        struct epoll_event ev = { .events = to_epoll(events), .data.fd = fd };
+        if (epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            /* A closed-and-reused fd can linger in the set */
+            if (errno != EEXIST || epoll_ctl(r->epoll_fd, EPOLL_CTL_MOD, fd, &ev) < 0)
+                return -1;
+        }
+    } else
+#endif
+    {
+        h->poll_idx = r->npfds++;
+        r->pfds[h->poll_idx].fd = fd;
+        r->pfds[h->poll_idx].events = to_poll(events);
+        r->pfds[h->poll_idx].revents = 0;
+    }
+
+    h->fn = fn;
+    h->ctx = ctx;
+    h->events = events;
+    return 0;
+}
+
+/* Change the events watched on a registered fd */
+int vex_reactor_mod(vex_reactor_t *r, int fd, uint32_t events) {
+    if (fd < 0 || fd >= VEX_REACTOR_MAX_FDS || !r->handlers[fd].fn) return -1;
+    vex_io_handler_t *h = &r->handlers[fd];
+
+    if (h->events == events) return 0;
+#ifdef HAVE_EPOLL
+    if (r->epoll_fd >= 0) {
+        struct epoll_event ev = { .events = to_epoll(events), .data.fd = fd };
+        if (epoll_ctl(r->epoll_fd, EPOLL_CTL_MOD, fd, &ev) < 0) return -1;
+    } else
+#endif
+    {
+        r->pfds[h->poll_idx].events = to_poll(events);
+    }
+    h->events = events;
+    return 0;
+}
+
+/* Stop watching fd. Call before closing it. */
+void vex_reactor_del(vex_reactor_t *r, int fd) {
+    if (fd < 0 || fd >= VEX_REACTOR_MAX_FDS || !r->handlers[fd].fn) return;
+    vex_io_handler_t *h = &r->handlers[fd];
+
+#ifdef HAVE_EPOLL
+    if (r->epoll_fd >= 0) {
+        epoll_ctl(r->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    } else
+#endif
+    {
+        /* Move the last watch into the hole */
+        int last = --r->npfds;
+        if (h->poll_idx != last) {
+            r->pfds[h->poll_idx] = r->pfds[last];
+            r->handlers[r->pfds[last].fd].poll_idx = h->poll_idx;
+        }
+    }
+    memset(h, 0, sizeof(*h));
+}
+
+/* Wait up to timeout_ms (-1 = indefinitely) and dispatch ready fds.
+ * Handlers may add or remove fds, including their own.
+ * Returns the number of fds dispatched, or -1 on error (EINTR included). */
+int vex_reactor_run_once(vex_reactor_t *r, int timeout_ms) {
+    int dispatched = 0;
+
+#ifdef HAVE_EPOLL
+    if (r->epoll_fd >= 0) {
+        struct epoll_event evs[REACTOR_BATCH];
+        int n = epoll_wait(r->epoll_fd, evs, REACTOR_BATCH, timeout_ms);
+        if (n < 0) return -1;
+        r->wakeups++;
+
+        for (int i = 0; i < n; i++) {
+            int fd = evs[i].data.fd;
+            vex_io_handler_t *h = &r->handlers[fd];
+            if (!h->fn) continue;  /* removed by an earlier handler */
+            h->fn(h->ctx, fd, from_epoll(evs[i].events));
+            dispatched++;
+        }
+        return dispatched;
+    }
+#endif
+
+    int n = poll(r->pfds, (nfds_t)r->npfds, timeout_ms);
+    if (n < 0) return -1;
+    r->wakeups++;
+
+    /* Walk backwards and clear revents before dispatch: a del() moves the
+     * last (already visited) watch into the hole, where it is then skipped */
+    for (int i = r->npfds - 1; i >= 0 && n > 0; i--) {
+        if (i >= r->npfds) continue;
+        short re = r->pfds[i].revents;
+        if (!re) continue;
+        r->pfds[i].revents = 0;
+        n--;
+
+        int fd = r->pfds[i].fd;
+        vex_io_handler_t *h = &r->handlers[fd];
+        h->fn(h->ctx, fd, from_poll(re));
+        dispatched++;
+    }
+    return dispatched;
+}
+
+const char *vex_reactor_backend(const vex_reactor_t *r) {
+    return r->epoll_fd >= 0 ? "epoll" : "poll";
+}
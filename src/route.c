@@ -0,0 +1,79 @@
+/* route.c — Distance-vector route cache for directed packets
+ *
+ * Routes are learnt from traffic, AODV style, and never advertised: every
+ * directed packet names its source, so the peer it arrived from is a next
+ * hop back to that source, and the hops it has travelled so far are the
+ * distance. A shorter path replaces a longer one, and the same path
+ * refreshes its entry. An entry that has not been refreshed for
+ * VEX_ROUTE_TTL_SEC expires, on lookup or in the periodic prune. Either
+ * way, packets for that destination go back to flooding until traffic
+ * teaches the node a new route.
+ *
+ * The table is a small unordered array keyed by the destination's
+ * address, the first VEX_ADDR_SIZE bytes of its public key. It is
+ * scanned linearly, and when it is full the stalest entry is replaced. */
+
+#include "vex.h"
+#include <string.h>
+
+void vex_route_init(vex_route_table_t *t) {
+    memset(t, 0, sizeof(*t));
+}
+
+static void route_remove(vex_route_table_t *t, int i) {
+    t->entries[i] = t->entries[--t->count];
+}
+
+static int route_find(const vex_route_table_t *t, const uint8_t *dest) {
+    for (int i = 0; i < t->count; i++)
+        if (memcmp(t->entries[i].dest, dest, VEX_ADDR_SIZE) == 0) return i;
+    return -1;
+}
+
+/* Traffic from dest arrived through peer fd after `hops` hops: keep it if
+ * it is the first route, a shorter one, the same path, or the old route
+ * has gone stale */
+void vex_route_learn(vex_route_table_t *t, const uint8_t *dest, int fd, uint8_t hops, time_t now) {
+    int i = route_find(t, dest);
+    vex_route_t *r;
+
+    if (i >= 0) {
+        r = &t->entries[i];
+        int stale = now - r->updated > VEX_ROUTE_TTL_SEC;
+        if (!stale && r->next_fd != fd && hops >= r->hops) return;
+    } else if (t->count < VEX_ROUTE_CAPACITY) {
+        r = &t->entries[t->count++];
+    } else {
+        r = &t->entries[0];
+        for (int k = 1; k < t->count; k++)
+            if (t->entries[k].updated < r->updated) r = &t->entries[k];
+    }
+
+    memcpy(r->dest, dest, VEX_ADDR_SIZE);
+    r->next_fd = fd;
+    r->hops = hops;
+    r->updated = now;
+}
+
+/* Live route to dest, or NULL */
+const vex_route_t *vex_route_lookup(vex_route_table_t *t, const uint8_t *dest, time_t now) {
+    int i = route_find(t, dest);
+    if (i < 0) return NULL;
+    if (now - t->entries[i].updated > VEX_ROUTE_TTL_SEC) {
+        route_remove(t, i);
+        return NULL;
+    }
+    return &t->entries[i];
+}
+
+/* A peer went away: forget every route through it */
+void vex_route_drop_peer(vex_route_table_t *t, int fd) {
+    for (int i = t->count - 1; i >= 0; i--)
+        if (t->entries[i].next_fd == fd) route_remove(t, i);
+}
+
+/* Expire routes not refreshed for VEX_ROUTE_TTL_SEC */
+void vex_route_prune(vex_route_table_t *t, time_t now) {
+    for (int i = t->count - 1; i >= 0; i--)
+        if (now - t->entries[i].updated > VEX_ROUTE_TTL_SEC) route_remove(t, i);
+}
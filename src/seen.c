@@ -1,73 +1,205 @@
-/* seen.c — LRU deduplication cache for packet IDs */
+/* seen.c — LRU deduplication cache for packet IDs
+ *
+ * Lookup goes through an open-addressing hash table keyed by the 8-byte
+ * packet ID. Expiry uses a timing wheel with one bucket per second: every
+ * entry sits on the list for the second it was added, so expiring a second
+ * or evicting the oldest entry never scans the whole cache. */
 
 #include "vex.h"
+#include "tweetnacl.h"
 #include <string.h>
 #include <time.h>
 
-void vex_seen_init(vex_seen_cache_t *cache) {
-    memset(cache, 0, sizeof(*cache));
-    cache->count = 0;
+#define WHEEL_MASK (VEX_SEEN_WHEEL - 1)
+
+#if VEX_SEEN_WHEEL <= VEX_SEEN_TTL_SEC + 1 || (VEX_SEEN_WHEEL & WHEEL_MASK) != 0
+#error "VEX_SEEN_WHEEL must be a power of two larger than VEX_SEEN_TTL_SEC + 1"
+#endif
+
+static uint64_t id_key(const uint8_t *packet_id) {
+    uint64_t key;
+    memcpy(&key, packet_id, 8);
+    return key;
 }
 
-/* Check if packet_id has been seen. Returns 1 if seen, 0 if new */
-int vex_seen_check(vex_seen_cache_t *cache, const uint8_t *packet_id) {
-    time_t now = time(NULL);
+/* Home slot: keyed 64-bit mix, then map onto [0, VEX_SEEN_SLOTS) */
+static uint32_t home_slot(const vex_seen_cache_t *cache, uint64_t key) {
+    uint64_t h = key ^ cache->seed;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return (uint32_t)(((h >> 32) * (uint64_t)VEX_SEEN_SLOTS) >> 32);
+}
+
+static uint32_t next_slot(uint32_t i) {
+    return (i + 1 == VEX_SEEN_SLOTS) ? 0 : i + 1;
+}
+
+static uint32_t bucket_of(time_t t) {
+    return (uint32_t)((uint64_t)t & WHEEL_MASK);
+}
+
+/* Slot holding key, or VEX_SEEN_NONE */
+static uint32_t find_slot(const vex_seen_cache_t *cache, uint64_t key) {
+    uint32_t i = home_slot(cache, key);
+    while (cache->slots[i] != VEX_SEEN_NONE) {
+        if (cache->entries[cache->slots[i]].id == key) return i;
+        i = next_slot(i);
+    }
+    return VEX_SEEN_NONE;
+}
 
-    for (int i = 0; i < cache->count; i++) {
-        if (!cache->entries[i].active) continue;
+/* Empty slot i and shift later members of its probe run back into the gap,
+ * so lookups never need tombstones */
+static void slot_remove(vex_seen_cache_t *cache, uint32_t i) {
+    uint32_t j = i;
 
-        /* Expired? */
-        if (now - cache->entries[i].timestamp > VEX_SEEN_TTL_SEC) {
-            cache->entries[i].active = 0;
-            continue;
+    cache->slots[i] = VEX_SEEN_NONE;
+    for (;;) {
+        j = next_slot(j);
+        if (cache->slots[j] == VEX_SEEN_NONE) return;
+
+        uint32_t k = home_slot(cache, cache->entries[cache->slots[j]].id);
+        int stays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if (!stays) {
+            cache->slots[i] = cache->slots[j];
+            cache->slots[j] = VEX_SEEN_NONE;
+            i = j;
         }
+    }
+}
+
+static void bucket_unlink(vex_seen_cache_t *cache, uint32_t idx) {
+    vex_seen_entry_t *e = &cache->entries[idx];
+    uint32_t b = bucket_of(e->timestamp);
+
+    if (e->prev != VEX_SEEN_NONE) cache->entries[e->prev].next = e->next;
+    else cache->wheel_head[b] = e->next;
+    if (e->next != VEX_SEEN_NONE) cache->entries[e->next].prev = e->prev;
+    else cache->wheel_tail[b] = e->prev;
+}
+
+static void bucket_append(vex_seen_cache_t *cache, uint32_t idx, time_t t) {
+    vex_seen_entry_t *e = &cache->entries[idx];
+    uint32_t b = bucket_of(t);
+
+    e->timestamp = t;
+    e->next = VEX_SEEN_NONE;
+    e->prev = cache->wheel_tail[b];
+    if (e->prev != VEX_SEEN_NONE) cache->entries[e->prev].next = idx;
+    else cache->wheel_head[b] = idx;
+    cache->wheel_tail[b] = idx;
+}
+
+/* Drop an entry from the table and return it to the free list */
+static void entry_release(vex_seen_cache_t *cache, uint32_t idx) {
+    slot_remove(cache, find_slot(cache, cache->entries[idx].id));
+    cache->entries[idx].next = cache->free_head;
+    cache->free_head = idx;
+    cache->count--;
+}
+
+static void bucket_expire(vex_seen_cache_t *cache, uint32_t b) {
+    uint32_t idx = cache->wheel_head[b];
+    while (idx != VEX_SEEN_NONE) {
+        uint32_t next = cache->entries[idx].next;
+        entry_release(cache, idx);
+        idx = next;
+    }
+    cache->wheel_head[b] = VEX_SEEN_NONE;
+    cache->wheel_tail[b] = VEX_SEEN_NONE;
+}
 
-        if (memcmp(cache->entries[i].packet_id, packet_id, 8) == 0) {
-            return 1;  /* Seen */
+/* Move the wheel forward to `now`, expiring every second that has fallen
+ * more than VEX_SEEN_TTL_SEC behind. A clock that steps backwards leaves
+ * the wheel where it is; entries then simply live a little longer. */
+static void wheel_advance(vex_seen_cache_t *cache, time_t now) {
+    if (now <= cache->wheel_time) return;
+
+    time_t from = cache->wheel_time - VEX_SEEN_TTL_SEC;
+    time_t to = now - VEX_SEEN_TTL_SEC - 1;
+    for (time_t t = from; t <= to && t - from < VEX_SEEN_WHEEL; t++) {
+        bucket_expire(cache, bucket_of(t));
+    }
+    cache->wheel_time = now;
+}
+
+/* Evict the least recently added entry: head of the oldest live bucket.
+ * evict_from remembers where the last search stopped; nothing is ever
+ * added to a bucket older than that, so the scan resumes there. */
+static void evict_oldest(vex_seen_cache_t *cache) {
+    time_t t = cache->wheel_time - VEX_SEEN_TTL_SEC;
+    if (cache->evict_from > t) t = cache->evict_from;
+
+    for (; t <= cache->wheel_time; t++) {
+        uint32_t idx = cache->wheel_head[bucket_of(t)];
+        if (idx != VEX_SEEN_NONE) {
+            bucket_unlink(cache, idx);
+            entry_release(cache, idx);
+            cache->evict_from = t;
+            return;
         }
     }
+}
+
+void vex_seen_init(vex_seen_cache_t *cache) {
+    memset(cache, 0, sizeof(*cache));
+    cache->count = 0;
+
+    for (uint32_t i = 0; i < VEX_SEEN_SLOTS; i++) cache->slots[i] = VEX_SEEN_NONE;
+    for (uint32_t i = 0; i < VEX_SEEN_WHEEL; i++) {
+        cache->wheel_head[i] = VEX_SEEN_NONE;
+        cache->wheel_tail[i] = VEX_SEEN_NONE;
+    }
+
+    /* Thread every entry onto the free list */
+    for (uint32_t i = 0; i < VEX_SEEN_CAPACITY; i++) {
+        cache->entries[i].next = (i + 1 < VEX_SEEN_CAPACITY) ? i + 1 : VEX_SEEN_NONE;
+    }
+    cache->free_head = 0;
 
-    return 0;  /* New */
+    cache->wheel_time = time(NULL);
+    cache->evict_from = cache->wheel_time;
+    randombytes((uint8_t *)&cache->seed, sizeof(cache->seed));
+}
+
+/* Check if packet_id has been seen. Returns 1 if seen, 0 if new */
+int vex_seen_check(vex_seen_cache_t *cache, const uint8_t *packet_id) {
+    wheel_advance(cache, time(NULL));
+    return find_slot(cache, id_key(packet_id)) != VEX_SEEN_NONE;
 }
 
 /* Add a packet_id to the seen cache */
 void vex_seen_add(vex_seen_cache_t *cache, const uint8_t *packet_id) {
-    time_t now = time(NULL);
-
-    /* Find an empty or expired slot */
-    for (int i = 0; i < VEX_SEEN_CAPACITY; i++) {
-        if (!cache->entries[i].active ||
-            (now - cache->entries[i].timestamp > VEX_SEEN_TTL_SEC)) {
-            memcpy(cache->entries[i].packet_id, packet_id, 8);
-            cache->entries[i].timestamp = now;
-            cache->entries[i].active = 1;
-            if (i >= cache->count) cache->count = i + 1;
-            return;
-        }
+    uint64_t key = id_key(packet_id);
+
+    wheel_advance(cache, time(NULL));
+
+    /* Already present — refresh it into the current second */
+    uint32_t slot = find_slot(cache, key);
+    if (slot != VEX_SEEN_NONE) {
+        uint32_t idx = cache->slots[slot];
+        bucket_unlink(cache, idx);
+        bucket_append(cache, idx, cache->wheel_time);
+        return;
     }
 
     /* Cache full — evict oldest */
-    int oldest_idx = 0;
-    time_t oldest_time = cache->entries[0].timestamp;
-    for (int i = 1; i < VEX_SEEN_CAPACITY; i++) {
-        if (cache->entries[i].timestamp < oldest_time) {
-            oldest_time = cache->entries[i].timestamp;
-            oldest_idx = i;
-        }
-    }
+    if (cache->free_head == VEX_SEEN_NONE) evict_oldest(cache);
 
-    memcpy(cache->entries[oldest_idx].packet_id, packet_id, 8);
-    cache->entries[oldest_idx].timestamp = now;
-    cache->entries[oldest_idx].active = 1;
+    uint32_t idx = cache->free_head;
+    cache->free_head = cache->entries[idx].next;
+    cache->entries[idx].id = key;
+    bucket_append(cache, idx, cache->wheel_time);
+    cache->count++;
+
+    /* Insert after the probe run (slot_remove keeps runs gap-free) */
+    uint32_t i = home_slot(cache, key);
+    while (cache->slots[i] != VEX_SEEN_NONE) i = next_slot(i);
+    cache->slots[i] = idx;
 }
 
 /* Remove expired entries */
 void vex_seen_prune(vex_seen_cache_t *cache) {
-    time_t now = time(NULL);
-    for (int i = 0; i < cache->count; i++) {
-        if (cache->entries[i].active &&
-            (now - cache->entries[i].timestamp > VEX_SEEN_TTL_SEC)) {
-            cache->entries[i].active = 0;
-        }
-    }
+    wheel_advance(cache, time(NULL));
 }
@@ -0,0 +1,108 @@
+/* seen_shard.c — Seen cache shared by relay worker threads
+ *
+ * The packet ID picks one of a power-of-two number of shards, and each
+ * shard is an ordinary exact cache or Bloom filter behind its own mutex.
+ * Threads only contend when two packets land on the same shard at once,
+ * and because the lookup and the insert happen under one lock, a packet
+ * that arrives on several threads at once is new to exactly one of them.
+ *
+ * Capacity scales with the shard count: an exact shard keeps
+ * VEX_SEEN_CAPACITY IDs, and a Bloom shard its share of the requested
+ * capacity at the requested false-positive rate. */
+
+#include "vex.h"
+#include "tweetnacl.h"
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t shard_of(const vex_seen_shards_t *s, const uint8_t *packet_id) {
+    uint64_t key;
+    memcpy(&key, packet_id, 8);
+    key ^= s->seed;
+    key *= 0x9e3779b97f4a7c15ULL;
+    return (uint32_t)(key >> 32) & s->mask;
+}
+
+/* Set up `shards` shards (rounded up to a power of two) of the given
+ * backend. Returns 0, or -1 on bad sizes or out of memory. */
+int vex_seen_shards_init(vex_seen_shards_t *s, uint32_t shards, int mode,
+                         uint32_t bloom_capacity, double bloom_fp) {
+    uint32_t n = 1;
+    while (n < shards && n < 1024) n <<= 1;
+
+    memset(s, 0, sizeof(*s));
+    s->shard = calloc(n, sizeof(*s->shard));
+    if (!s->shard) return -1;
+    s->mask = n - 1;
+    s->mode = mode;
+    randombytes((uint8_t *)&s->seed, sizeof(s->seed));
+
+    uint32_t per_shard = bloom_capacity / n ? bloom_capacity / n : 1;
+    s->capacity = (uint64_t)n * (mode == VEX_SEEN_BLOOM ? per_shard : VEX_SEEN_CAPACITY);
+    for (uint32_t i = 0; i < n; i++) {
+        vex_seen_shard_t *sh = &s->shard[i];
+        pthread_mutex_init(&sh->lock, NULL);
+        if (mode == VEX_SEEN_BLOOM) {
+            if (vex_bloom_init(&sh->bloom, per_shard, bloom_fp) != 0) {
+                s->mask = i;               /* free what was made */
+                vex_seen_shards_free(s);
+                return -1;
+            }
+        } else {
+            vex_seen_init(&sh->cache);
+        }
+    }
+    return 0;
+}
+
+void vex_seen_shards_free(vex_seen_shards_t *s) {
+    if (!s->shard) return;
+    for (uint32_t i = 0; i <= s->mask; i++) {
+        if (s->mode == VEX_SEEN_BLOOM) vex_bloom_free(&s->shard[i].bloom);
+        pthread_mutex_destroy(&s->shard[i].lock);
+    }
+    free(s->shard);
+    s->shard = NULL;
+}
+
+/* Look packet_id up and remember it in one step.
+ * Returns 1 if it was already seen, 0 if it is new (and now recorded) */
+int vex_seen_shards_test_add(vex_seen_shards_t *s, const uint8_t *packet_id) {
+    vex_seen_shard_t *sh = &s->shard[shard_of(s, packet_id)];
+    int seen;
+
+    pthread_mutex_lock(&sh->lock);
+    if (s->mode == VEX_SEEN_BLOOM) {
+        seen = vex_bloom_check(&sh->bloom, packet_id);
+        if (!seen) vex_bloom_add(&sh->bloom, packet_id);
+    } else {
+        seen = vex_seen_check(&sh->cache, packet_id);
+        if (!seen) vex_seen_add(&sh->cache, packet_id);
+    }
+    pthread_mutex_unlock(&sh->lock);
+    return seen;
+}
+
+/* Expire old IDs in every shard, one lock at a time */
+void vex_seen_shards_prune(vex_seen_shards_t *s) {
+    for (uint32_t i = 0; i <= s->mask; i++) {
+        vex_seen_shard_t *sh = &s->shard[i];
+        pthread_mutex_lock(&sh->lock);
+        if (s->mode == VEX_SEEN_BLOOM) vex_bloom_prune(&sh->bloom);
+        else vex_seen_prune(&sh->cache);
+        pthread_mutex_unlock(&sh->lock);
+    }
+}
+
+/* IDs remembered across all shards */
+uint64_t vex_seen_shards_count(vex_seen_shards_t *s) {
+    uint64_t total = 0;
+    for (uint32_t i = 0; i <= s->mask; i++) {
+        vex_seen_shard_t *sh = &s->shard[i];
+        pthread_mutex_lock(&sh->lock);
+        total += s->mode == VEX_SEEN_BLOOM ? vex_bloom_count(&sh->bloom)
+                                           : (uint64_t)sh->cache.count;
+        pthread_mutex_unlock(&sh->lock);
+    }
+    return total;
+}
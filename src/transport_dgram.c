@@ -0,0 +1,396 @@
+/* transport_dgram.c — Message-preserving transports: SOCK_SEQPACKET and UDP
+ *
+ * A packet is one datagram, so there is no length prefix to parse and no
+ * partial frame to carry between reads. Peers keep the stream transport's
+ * queues (transport_unix.c); only the syscalls differ:
+ *   - reads take up to VEX_DGRAM_BATCH datagrams per recvmmsg()
+ *   - a flush sends a peer's queued frames with one sendmmsg(), minus
+ *     their 2-byte prefixes
+ *   - over UDP, one sendmmsg() on the shared socket carries every peer's
+ *     queued frames, so a whole fanout costs a single syscall
+ *
+ * SEQPACKET peers listen, accept and connect like stream peers (the Unix
+ * transport opens its sockets with that type). UDP has no connections:
+ * each peer gets its own socket bound to the node's port and connected to
+ * the remote, so peers keep distinct fds and the kernel demuxes inbound
+ * datagrams. A hello (empty datagram) or a well-formed packet from an
+ * unknown address arriving on the shared socket makes a new peer; --peer
+ * announces itself with a hello. Every peer is sent a hello each prune
+ * interval, and peers learned that way are dropped once silent for
+ * VEX_UDP_IDLE_S, so stray senders cannot hold peer slots for good.
+ *
+ * Datagrams are received straight into pooled buffers (pool.c), behind
+ * room for the length prefix, so a relayed packet is queued on every peer
+ * without being copied at all. */
+
+#define _GNU_SOURCE  /* recvmmsg/sendmmsg, getaddrinfo under -std=c11 */
+#include "vex.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#define VEX_DGRAM_BATCH 32          /* datagrams per recvmmsg */
+#define DGRAM_FANOUT    1024        /* messages per fanout sendmmsg (UIO_MAXIOV) */
+
+static struct sockaddr_storage local_addr;   /* the node's UDP address */
+static socklen_t local_len;
+static struct sockaddr_storage peer_addr[VEX_MAX_PEERS];
+static socklen_t peer_addr_len[VEX_MAX_PEERS];
+static uint8_t peer_configured[VEX_MAX_PEERS];    /* from --peer: never expires */
+
+static uint8_t rx_bufs[VEX_DGRAM_BATCH][VEX_MAX_PACKET];   /* when the pool is dry */
+
+/* Parse "host:port", "[v6]:port" or ":port" (wildcard) */
+static int resolve(const char *spec, int passive, struct sockaddr_storage *out, socklen_t *len) {
+    char host[256];
+    const char *colon = strrchr(spec, ':');
+    if (!colon || colon == spec + strlen(spec) - 1) return -1;
+
+    size_t hlen = (size_t)(colon - spec);
+    if (hlen >= sizeof(host)) return -1;
+    memcpy(host, spec, hlen);
+    host[hlen] = '\0';
+    if (hlen >= 2 && host[0] == '[' && host[hlen - 1] == ']') {
+        memmove(host, host + 1, hlen - 2);
+        host[hlen - 2] = '\0';
+    }
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    if (getaddrinfo(host[0] ? host : NULL, colon + 1, &hints, &res) != 0) return -1;
+
+    memcpy(out, res->ai_addr, res->ai_addrlen);
+    *len = res->ai_addrlen;
+    freeaddrinfo(res);
+    return 0;
+}
+
+static int same_addr(const struct sockaddr_storage *a, const struct sockaddr_storage *b) {
+    if (a->ss_family != b->ss_family) return 0;
+    if (a->ss_family == AF_INET) {
+        const struct sockaddr_in *x = (const void *)a, *y = (const void *)b;
+        return x->sin_port == y->sin_port && x->sin_addr.s_addr == y->sin_addr.s_addr;
+    }
+    if (a->ss_family == AF_INET6) {
+        const struct sockaddr_in6 *x = (const void *)a, *y = (const void *)b;
+        return x->sin6_port == y->sin6_port &&
+               memcmp(&x->sin6_addr, &y->sin6_addr, sizeof(x->sin6_addr)) == 0;
+    }
+    return 0;
+}
+
+static void addr_name(const struct sockaddr_storage *a, char *out, size_t len) {
+    char host[64] = "?";
+    uint16_t port = 0;
+    if (a->ss_family == AF_INET) {
+        const struct sockaddr_in *s = (const void *)a;
+        inet_ntop(AF_INET, &s->sin_addr, host, sizeof(host));
+        port = ntohs(s->sin_port);
+    } else if (a->ss_family == AF_INET6) {
+        const struct sockaddr_in6 *s = (const void *)a;
+        inet_ntop(AF_INET6, &s->sin6_addr, host, sizeof(host));
+        port = ntohs(s->sin6_port);
+    }
+    snprintf(out, len, "udp:%s:%u", host, port);
+}
+
+/* A UDP socket on the node's port; shared ones may bind it many times */
+static int udp_socket(void) {
+    int one = 1;
+    int fd = socket(local_addr.ss_family, SOCK_DGRAM, 0);
+    if (fd < 0) return -1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr *)&local_addr, local_len) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Peer socket connected to addr. Returns its slot, or -1 */
+static int udp_add_peer(vex_node_t *node, const struct sockaddr_storage *addr, socklen_t len) {
+    int fd = udp_socket();
+    if (fd < 0) return -1;
+    if (connect(fd, (const struct sockaddr *)addr, len) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    char name[64];
+    addr_name(addr, name, sizeof(name));
+    int slot = vex_transport_add_peer(node, fd, name);
+    if (slot < 0) {
+        close(fd);
+        return -1;
+    }
+    peer_addr[slot] = *addr;
+    peer_addr_len[slot] = len;
+    peer_configured[slot] = 0;
+    node->peers[slot].last_seen = time(NULL);
+    return slot;
+}
+
+/* Whether a datagram from an unknown address may make a peer: a hello, a
+ * packet with a valid header, or a multi-packet frame whose first packet
+ * has one */
+static int udp_hello_or_packet(const uint8_t *buf, size_t len) {
+    if (len == 0) return 1;
+    if (buf[0] != VEX_COALESCED) return vex_packet_validate(buf, len) == 0;
+    size_t plen = len >= 3 ? (size_t)(buf[1] << 8 | buf[2]) : 0;
+    return plen > 0 && 3 + plen <= len && vex_packet_validate(buf + 3, plen) == 0;
+}
+
+/* Bind the node's UDP socket ("host:port" or ":port") as node->listen_fd */
+int vex_transport_udp_init(vex_node_t *node, const char *spec) {
+    if (resolve(spec, 1, &local_addr, &local_len) != 0) {
+        vex_log("TRANSPORT", "Bad UDP address %s (want host:port)", spec);
+        return -1;
+    }
+    node->listen_fd = udp_socket();
+    if (node->listen_fd < 0) {
+        vex_log("TRANSPORT", "UDP bind to %s failed: %s", spec, strerror(errno));
+        return -1;
+    }
+    fcntl(node->listen_fd, F_SETFL, O_NONBLOCK);
+
+    /* Learn the port the kernel picked for ":0" */
+    local_len = sizeof(local_addr);
+    getsockname(node->listen_fd, (struct sockaddr *)&local_addr, &local_len);
+
+    vex_log("TRANSPORT", "Listening on UDP %s", spec);
+    return 0;
+}
+
+/* Add a UDP peer and announce ourselves to it with an empty datagram */
+int vex_transport_udp_connect(vex_node_t *node, const char *spec) {
+    struct sockaddr_storage addr;
+    socklen_t len;
+
+    if (resolve(spec, 0, &addr, &len) != 0) {
+        vex_log("TRANSPORT", "Bad UDP peer address %s", spec);
+        return -1;
+    }
+    int slot = udp_add_peer(node, &addr, len);
+    if (slot < 0) {
+        vex_log("TRANSPORT", "UDP peer %s: %s", spec, strerror(errno));
+        return -1;
+    }
+    peer_configured[slot] = 1;
+    send(node->peers[slot].fd, "", 0, MSG_NOSIGNAL);
+    return 0;
+}
+
+/* Say hello to every UDP peer, so they keep us, and drop learned peers
+ * silent for more than idle_s seconds. Call every few seconds.
+ * Returns peers dropped */
+int vex_transport_udp_prune(vex_node_t *node, time_t idle_s) {
+    time_t now = time(NULL);
+    int dropped = 0;
+
+    for (int i = 0; i < VEX_MAX_PEERS; i++) {
+        vex_peer_t *peer = &node->peers[i];
+        if (!peer->active) continue;
+        if (!peer_configured[i] && now - peer->last_seen > idle_s) {
+            vex_log("TRANSPORT", "Peer %s silent for %lds, dropped",
+                    peer->name, (long)(now - peer->last_seen));
+            vex_transport_close_peer(peer);
+            dropped++;
+            continue;
+        }
+        send(peer->fd, "", 0, MSG_NOSIGNAL);
+    }
+    return dropped;
+}
+
+/* Drain the shared UDP socket: hellos and packets from unknown addresses
+ * create peers (anything else from them is ignored), and any payload is
+ * handed to on_frame as that peer's. Returns peers created */
+int vex_transport_udp_accept(vex_node_t *node, vex_frame_fn on_frame, void *ctx) {
+    struct mmsghdr msgs[VEX_DGRAM_BATCH];
+    struct iovec iov[VEX_DGRAM_BATCH];
+    struct sockaddr_storage from[VEX_DGRAM_BATCH];
+    int created = 0;
+
+    for (int i = 0; i < VEX_DGRAM_BATCH; i++) {
+        iov[i].iov_base = rx_bufs[i];
+        iov[i].iov_len = VEX_MAX_PACKET;
+        memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &from[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+    }
+
+    int n = recvmmsg(node->listen_fd, msgs, VEX_DGRAM_BATCH, MSG_DONTWAIT, NULL);
+    for (int i = 0; i < n; i++) {
+        int slot = -1;
+        for (int p = 0; p < VEX_MAX_PEERS; p++) {
+            if (node->peers[p].active && same_addr(&peer_addr[p], &from[i])) {
+                slot = p;
+                break;
+            }
+        }
+        int truncated = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+        if (slot < 0) {
+            if (truncated || !udp_hello_or_packet(rx_bufs[i], msgs[i].msg_len)) continue;
+            slot = udp_add_peer(node, &from[i], msgs[i].msg_hdr.msg_namelen);
+            if (slot < 0) continue;
+            created++;
+        }
+
+        vex_peer_t *peer = &node->peers[slot];
+        peer->last_seen = time(NULL);
+        if (msgs[i].msg_len > 0 && !truncated && peer->active) {
+            vex_transport_deliver(peer, rx_bufs[i], msgs[i].msg_len, on_frame, ctx);
+        }
+    }
+    return created;
+}
+
+/* Read every waiting datagram from a peer, VEX_DGRAM_BATCH per recvmmsg.
+ * Returns packets delivered, -1 if the peer closed */
+int vex_transport_dgram_read(vex_peer_t *peer, vex_frame_fn on_frame, void *ctx) {
+    struct mmsghdr msgs[VEX_DGRAM_BATCH];
+    struct iovec iov[VEX_DGRAM_BATCH];
+    vex_pktbuf_t *bufs[VEX_DGRAM_BATCH];
+    int udp = vex_transport_mode() == VEX_SOCK_UDP;
+    int frames = 0;
+
+    if (!peer->active) return -1;
+    for (int i = 0; i < VEX_DGRAM_BATCH; i++) {
+        bufs[i] = vex_pool_alloc();
+        iov[i].iov_base = bufs[i] ? bufs[i]->data + 2 : rx_bufs[i];
+        iov[i].iov_len = VEX_MAX_PACKET;
+        memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int n = recvmmsg(peer->fd, msgs, VEX_DGRAM_BATCH, MSG_DONTWAIT, NULL);
+    if (n < 0) {
+        for (int i = 0; i < VEX_DGRAM_BATCH; i++) vex_pool_put(bufs[i]);
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return 0;
+        vex_transport_close_peer(peer);  /* e.g. ECONNREFUSED: nobody at that port */
+        return -1;
+    }
+
+    peer->last_seen = time(NULL);
+    for (int i = 0; i < n && peer->active; i++) {
+        if (msgs[i].msg_len == 0) {
+            /* SEQPACKET: end of stream. UDP: a peer's hello */
+            if (!udp) {
+                frames = -1;
+                vex_transport_close_peer(peer);
+                break;
+            }
+            continue;
+        }
+        if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+            vex_log("TRANSPORT", "Peer %s sent an oversized datagram, dropped", peer->name);
+            continue;
+        }
+
+        uint8_t *pkt = iov[i].iov_base;
+        if (bufs[i]) {
+            /* Make it a queueable frame so relays can share the buffer */
+            bufs[i]->data[0] = (uint8_t)(msgs[i].msg_len >> 8);
+            bufs[i]->data[1] = (uint8_t)(msgs[i].msg_len & 0xFF);
+            bufs[i]->len = (uint16_t)(2 + msgs[i].msg_len);
+        }
+        frames += vex_transport_deliver(peer, pkt, msgs[i].msg_len, on_frame, ctx);
+    }
+
+    /* Queues that took the packet hold their own references */
+    for (int i = 0; i < VEX_DGRAM_BATCH; i++) vex_pool_put(bufs[i]);
+    return frames;
+}
+
+/* Point msgs/iov at the peer's queued frames without their length prefix.
+ * Returns the message count and the queue bytes they cover */
+static int queue_msgs(const vex_peer_t *peer, struct mmsghdr *msgs, struct iovec *iov,
+                      int max, const struct sockaddr_storage *to, socklen_t to_len,
+                      size_t *bytes) {
+    int n = peer->tx_count < max ? peer->tx_count : max;
+    for (int i = 0; i < n; i++) {
+        const vex_pktbuf_t *f = peer->tx_queue[i];
+        iov[i].iov_base = (void *)(f->data + 2);
+        iov[i].iov_len = (size_t)f->len - 2;
+        memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = (void *)to;
+        msgs[i].msg_hdr.msg_namelen = to ? to_len : 0;
+        if (bytes) *bytes += f->len;
+    }
+    return n;
+}
+
+/* Send a peer's queued frames with one sendmmsg on its own socket.
+ * Returns datagrams sent (with *bytes the queue bytes they covered), or
+ * -1 with errno set */
+int vex_dgram_send(vex_peer_t *peer, size_t *bytes) {
+    struct mmsghdr msgs[VEX_PEER_TX_QUEUE];
+    struct iovec iov[VEX_PEER_TX_QUEUE];
+
+    *bytes = 0;
+    int cnt = queue_msgs(peer, msgs, iov, VEX_PEER_TX_QUEUE, NULL, 0, NULL);
+    int n = sendmmsg(peer->fd, msgs, (unsigned)cnt, MSG_NOSIGNAL);
+    for (int i = 0; i < n; i++) *bytes += iov[i].iov_len + 2;
+    return n;
+}
+
+/* UDP fanout: every due peer's queued frames in one sendmmsg on the
+ * shared socket (chunks of DGRAM_FANOUT). Peers left with frames after a
+ * short send are flushed on their own sockets. Returns sendmmsg calls made */
+int vex_dgram_flush_all(vex_node_t *node) {
+    static struct mmsghdr msgs[DGRAM_FANOUT];
+    static struct iovec iov[DGRAM_FANOUT];
+    int owner[VEX_MAX_PEERS], owner_cnt[VEX_MAX_PEERS];
+    int calls = 0;
+    uint64_t now = vex_time_ms();
+
+    for (int first = 0; first < VEX_MAX_PEERS;) {
+        int used = 0, npeers = 0, p = first;
+
+        for (; p < VEX_MAX_PEERS; p++) {
+            vex_peer_t *peer = &node->peers[p];
+            if (!peer->active || peer->tx_count == 0 || peer->tx_want_write ||
+                !vex_transport_tx_due(peer, now))
+                continue;
+            if (used + peer->tx_count > DGRAM_FANOUT) break;
+            int n = queue_msgs(peer, msgs + used, iov + used, peer->tx_count,
+                               &peer_addr[p], peer_addr_len[p], NULL);
+            owner[npeers] = p;
+            owner_cnt[npeers++] = n;
+            used += n;
+        }
+        first = p;
+        if (used == 0) break;
+
+        int sent = sendmmsg(node->listen_fd, msgs, (unsigned)used, MSG_NOSIGNAL);
+        calls++;
+        if (sent < 0) sent = 0;
+
+        /* Retire what went out, peer by peer in the order queued */
+        for (int k = 0; k < npeers; k++) {
+            vex_peer_t *peer = &node->peers[owner[k]];
+            int take = sent < owner_cnt[k] ? sent : owner_cnt[k];
+            size_t bytes = 0;
+            for (int i = 0; i < take; i++)
+                bytes += peer->tx_queue[i]->len;
+            sent -= take;
+            if (vex_transport_tx_done(peer, bytes)) vex_transport_flush(peer);
+        }
+    }
+    return calls;
+}
@@ -5,17 +5,125 @@
 #include "vex.h"
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
 #include <fcntl.h>
 
+static void peer_reset_buffers(vex_peer_t *peer);
+
+static vex_peer_hook_fn peer_hook;
+static void *peer_hook_ctx;
+
+static vex_peer_hook_fn write_hook;
+static void *write_hook_ctx;
+
+static int sock_mode = VEX_SOCK_STREAM;
+static int batching;                 /* queue sends until vex_transport_flush */
+static int tx_high = VEX_PEER_TX_QUEUE;
+static int tx_low = VEX_PEER_TX_QUEUE / 4;
+static int tx_policy = VEX_TX_DROP_OLDEST;
+static int coalesce_window;          /* ms a queue may wait for company */
+static int coalesce_budget;          /* bytes per multi-packet frame, 0 = off */
+static vex_fanout_fn fanout_hook;
+static void *fanout_hook_ctx;
+
+/* Send counters, one block per thread so relay workers never share a
+ * cache line; each block has a single writer and is summed on demand */
+typedef struct {
+    _Alignas(64) _Atomic uint64_t frames;
+    _Atomic uint64_t writes;
+    _Atomic uint64_t drops;
+    _Atomic uint64_t packed;         /* frames merged into multi-packet frames */
+    _Atomic uint64_t coalesced;      /* multi-packet frames built */
+} tx_stats_t;
+
+static tx_stats_t tx_stats[VEX_MAX_THREADS + 1];
+static _Thread_local tx_stats_t *tx_stat = &tx_stats[0];
+
+static void stat_add(_Atomic uint64_t *c, uint64_t n) {
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + n,
+                          memory_order_relaxed);
+}
+
+/* Socket type for everything opened afterwards: VEX_SOCK_STREAM (length
+ * prefixed), VEX_SOCK_SEQPACKET or VEX_SOCK_UDP (one packet per datagram) */
+void vex_transport_set_mode(int mode) {
+    sock_mode = mode;
+}
+
+int vex_transport_mode(void) {
+    return sock_mode;
+}
+
+/* Register a callback for peers coming up and going down */
+void vex_transport_set_peer_hook(vex_peer_hook_fn fn, void *ctx) {
+    peer_hook = fn;
+    peer_hook_ctx = ctx;
+}
+
+/* Register a callback for peers starting (1) or stopping (0) to wait on
+ * socket writability; the caller then calls vex_transport_flush(peer)
+ * when the fd is writable */
+void vex_transport_set_write_hook(vex_peer_hook_fn fn, void *ctx) {
+    write_hook = fn;
+    write_hook_ctx = ctx;
+}
+
+/* Register a callback that carries send_to_all's frames on to peers the
+ * sending node does not own (relay worker threads, the mesh simulator) */
+void vex_transport_set_fanout_hook(vex_fanout_fn fn, void *ctx) {
+    fanout_hook = fn;
+    fanout_hook_ctx = ctx;
+}
+
+/* Count this thread's sends in block index (0 = the main thread, up to
+ * VEX_MAX_THREADS) */
+void vex_transport_set_thread(int index) {
+    if (index >= 0 && index <= VEX_MAX_THREADS) tx_stat = &tx_stats[index];
+}
+
+/* Close a peer's connection and free its slot */
+void vex_transport_close_peer(vex_peer_t *peer) {
+    if (!peer->active) return;
+    if (peer_hook) peer_hook(peer_hook_ctx, peer, 0);
+    if (vex_transport_uring_active()) vex_uring_cancel(peer);
+    peer->active = 0;
+    close(peer->fd);
+    peer_reset_buffers(peer);            /* hand queued frames back to the pool */
+}
+
+/* Take an already-connected stream socket as a peer: non-blocking, empty
+ * buffers, peer hook notified. Returns the peer slot, or -1 if all are taken */
+int vex_transport_add_peer(vex_node_t *node, int fd, const char *name) {
+    for (int i = 0; i < VEX_MAX_PEERS; i++) {
+        vex_peer_t *peer = &node->peers[i];
+        if (peer->active) continue;
+
+        peer->fd = fd;
+        peer->active = 1;
+        peer->last_seen = time(NULL);
+        snprintf(peer->name, sizeof(peer->name), "%s", name);
+        peer_reset_buffers(peer);
+        node->peer_count++;
+
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        if (vex_transport_uring_active()) vex_uring_arm(peer);
+
+        vex_log("TRANSPORT", "Peer %s up (fd=%d)", peer->name, fd);
+        if (peer_hook) peer_hook(peer_hook_ctx, peer, 1);
+        return i;
+    }
+    return -1;
+}
+
 /* Initialize as a listening node on a Unix socket */
 int vex_transport_unix_init(vex_node_t *node, const char *sock_path) {
     struct sockaddr_un addr;
 
-    node->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    node->listen_fd = socket(AF_UNIX, sock_mode == VEX_SOCK_SEQPACKET ? SOCK_SEQPACKET : SOCK_STREAM, 0);
     if (node->listen_fd < 0) {
         vex_log("TRANSPORT", "socket() failed: %s", strerror(errno));
         return -1;
@@ -47,41 +155,36 @@ int vex_transport_unix_init(vex_node_t *node, const char *sock_path) {
     return 0;
 }
 
+/* Accept a waiting connection without making it a peer (relay workers
+ * place it). Returns the fd, or -1 if none is waiting or accept failed */
+int vex_transport_unix_accept_fd(vex_node_t *node) {
+    return accept(node->listen_fd, NULL, NULL);
+}
+
 /* Accept a new peer connection (non-blocking) */
 int vex_transport_unix_accept(vex_node_t *node) {
-    int fd = accept(node->listen_fd, NULL, NULL);
+    int fd = vex_transport_unix_accept_fd(node);
     if (fd < 0) {
         if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
         return -1;
     }
 
-    /* Find empty peer slot */
-    for (int i = 0; i < VEX_MAX_PEERS; i++) {
-        if (!node->peers[i].active) {
-            node->peers[i].fd = fd;
-            node->peers[i].active = 1;
-            node->peers[i].last_seen = time(NULL);
-            snprintf(node->peers[i].name, sizeof(node->peers[i].name), "peer-%d", fd);
-            node->peer_count++;
-
-            /* Non-blocking for reads */
-            fcntl(fd, F_SETFL, O_NONBLOCK);
-
-            vex_log("TRANSPORT", "Accepted peer %s (fd=%d)", node->peers[i].name, fd);
-            return 1;
-        }
+    char name[64];
+    snprintf(name, sizeof(name), "peer-%d", fd);
+    if (vex_transport_add_peer(node, fd, name) < 0) {
+        vex_log("TRANSPORT", "Max peers reached, rejecting connection");
+        close(fd);
+        return 0;
     }
-
-    vex_log("TRANSPORT", "Max peers reached, rejecting connection");
-    close(fd);
-    return 0;
+    return 1;
 }
 
-/* Connect to another node's Unix socket */
-int vex_transport_unix_connect(vex_node_t *node, const char *sock_path) {
+/* Open a connection to another node's Unix socket without making it a
+ * peer. Returns the fd, or -1 */
+int vex_transport_unix_dial(const char *sock_path) {
     struct sockaddr_un addr;
 
-    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    int fd = socket(AF_UNIX, sock_mode == VEX_SOCK_SEQPACKET ? SOCK_SEQPACKET : SOCK_STREAM, 0);
     if (fd < 0) return -1;
 
     memset(&addr, 0, sizeof(addr));
@@ -93,103 +196,634 @@ int vex_transport_unix_connect(vex_node_t *node, const char *sock_path) {
         close(fd);
         return -1;
     }
+    return fd;
+}
+
+/* Connect to another node's Unix socket */
+int vex_transport_unix_connect(vex_node_t *node, const char *sock_path) {
+    int fd = vex_transport_unix_dial(sock_path);
+    if (fd < 0) return -1;
+
+    char name[64];
+    snprintf(name, sizeof(name), "peer@%s", sock_path);
+    if (vex_transport_add_peer(node, fd, name) < 0) {
+        close(fd);
+        return -1;
+    }
+    return 0;
+}
 
-    /* Find empty peer slot */
+/* Queue sends per peer and write them out in one syscall per flush. The
+ * caller must then call vex_transport_flush_all() once per loop turn. */
+void vex_transport_set_batching(int on) {
+    batching = on;
+}
+
+/* Outbound queue limits, in frames. A peer whose queue reaches `high` is
+ * congested: each further frame costs one queued frame of the least
+ * urgent class there, chosen by `policy` (or is itself dropped) until the
+ * queue drains back to `low`.
+ * Returns 0, or -1 if the limits are out of range. */
+int vex_transport_set_queue(int high, int low, int policy) {
+    if (high < 1 || high > VEX_PEER_TX_QUEUE || low < 0 || low >= high) return -1;
+    if (policy != VEX_TX_DROP_OLDEST && policy != VEX_TX_DROP_LOWEST_TTL) return -1;
+    tx_high = high;
+    tx_low = low;
+    tx_policy = policy;
+    return 0;
+}
+
+/* Frames handed to the transport, write syscalls spent on them, and frames
+ * dropped from full queues */
+void vex_transport_counters(uint64_t *frames, uint64_t *writes, uint64_t *dropped) {
+    *frames = *writes = *dropped = 0;
+    for (int i = 0; i <= VEX_MAX_THREADS; i++) {
+        *frames += atomic_load_explicit(&tx_stats[i].frames, memory_order_relaxed);
+        *writes += atomic_load_explicit(&tx_stats[i].writes, memory_order_relaxed);
+        *dropped += atomic_load_explicit(&tx_stats[i].drops, memory_order_relaxed);
+    }
+}
+
+/* Pack queued packets for the same peer into multi-packet frames of up to
+ * `budget` bytes, holding a queue up to window_ms for more to arrive; a
+ * queue that could already fill a frame, or is half way to its high
+ * watermark, goes at once. budget 0 turns coalescing off; window 0 packs
+ * only what a loop turn queued anyway. Both ends must be new enough to
+ * split the frames. Returns 0, or -1 if the limits are out of range */
+int vex_transport_set_coalesce(int window_ms, int budget) {
+    if (window_ms < 0 || window_ms > 1000) return -1;
+    if (budget != 0 && (budget < VEX_COALESCE_MIN || budget > VEX_MAX_PACKET)) return -1;
+    coalesce_window = window_ms;
+    coalesce_budget = budget;
+    return 0;
+}
+
+/* Frames merged into multi-packet frames, and the multi-packet frames */
+void vex_transport_coalesce_counters(uint64_t *packets, uint64_t *frames) {
+    *packets = *frames = 0;
+    for (int i = 0; i <= VEX_MAX_THREADS; i++) {
+        *packets += atomic_load_explicit(&tx_stats[i].packed, memory_order_relaxed);
+        *frames += atomic_load_explicit(&tx_stats[i].coalesced, memory_order_relaxed);
+    }
+}
+
+/* Frames node's peers can still queue before the fullest one reaches its
+ * high watermark. Peers that are full or shedding are left out, so one
+ * neighbour that stops reading cannot hold back the rest; their own drop
+ * policy deals with what they miss. If every peer is full, the emptiest
+ * one sets the pace */
+int vex_transport_room(const vex_node_t *node) {
+    int room = -1, backed_up = 0;
     for (int i = 0; i < VEX_MAX_PEERS; i++) {
-        if (!node->peers[i].active) {
-            node->peers[i].fd = fd;
-            node->peers[i].active = 1;
-            node->peers[i].last_seen = time(NULL);
-            snprintf(node->peers[i].name, sizeof(node->peers[i].name), "peer@%s", sock_path);
-            node->peer_count++;
+        const vex_peer_t *peer = &node->peers[i];
+        if (!peer->active) continue;
+        int left = tx_high - peer->tx_count;
+        if (peer->tx_congested || left <= 0) {
+            if (left > backed_up) backed_up = left;
+        } else if (room < 0 || left < room) {
+            room = left;
+        }
+    }
+    if (room < 0) room = backed_up;
+    return room > 0 ? room : 0;
+}
 
-            fcntl(fd, F_SETFL, O_NONBLOCK);
+/* Tell the write hook when the peer starts or stops waiting on the socket */
+static void tx_watch(vex_peer_t *peer, int on) {
+    if (peer->tx_want_write == on) return;
+    peer->tx_want_write = on;
+    if (write_hook) write_hook(write_hook_ctx, peer, on);
+}
 
-            vex_log("TRANSPORT", "Connected to %s (fd=%d)", sock_path, fd);
-            return 0;
+/* Unlink the frame at queue position pos and drop the queue's reference */
+static void tx_remove(vex_peer_t *peer, int pos) {
+    vex_pool_put(peer->tx_queue[pos]);
+    peer->tx_count--;
+    memmove(peer->tx_queue + pos, peer->tx_queue + pos + 1,
+            (size_t)(peer->tx_count - pos) * sizeof(peer->tx_queue[0]));
+    if (pos == 0) peer->tx_sent = 0;
+}
+
+/* A frame's TTL; for a multi-packet frame, the highest of its packets' */
+static uint8_t frame_ttl(const uint8_t *frame, size_t len) {
+    if (len < 3 || frame[2] != VEX_COALESCED)
+        return len > 2 + VEX_TTL_OFFSET ? frame[2 + VEX_TTL_OFFSET] : 0;
+
+    uint8_t ttl = 0;
+    for (size_t off = 3; off + 2 <= len;) {
+        size_t plen = (size_t)(frame[off] << 8 | frame[off + 1]);
+        if (plen > VEX_TTL_OFFSET && off + 2 + plen <= len && frame[off + 2 + VEX_TTL_OFFSET] > ttl)
+            ttl = frame[off + 2 + VEX_TTL_OFFSET];
+        off += 2 + plen;
+    }
+    return ttl;
+}
+
+/* How urgent a packet's priority class is, bulk 0 to urgent 3 */
+static const uint8_t prio_urgency[VEX_PRIO_CLASSES] = { 1, 0, 2, 3 };  /* by VEX_PRIO_* */
+
+static uint8_t packet_urgency(const uint8_t *pkt, size_t len) {
+    if (len < VEX_HEADER_SIZE) return 0;
+    return prio_urgency[(pkt[VEX_HEADER_SIZE - 1] & VEX_FLAG_PRIO_MASK) >> VEX_FLAG_PRIO_SHIFT];
+}
+
+/* A frame's urgency; for a multi-packet frame, its most urgent packet's */
+static uint8_t frame_urgency(const uint8_t *frame, size_t len) {
+    if (len < 3 || frame[2] != VEX_COALESCED)
+        return len > 2 ? packet_urgency(frame + 2, len - 2) : 0;
+
+    uint8_t urgency = 0;
+    for (size_t off = 3; off + 2 <= len;) {
+        size_t plen = (size_t)(frame[off] << 8 | frame[off + 1]);
+        if (off + 2 + plen <= len && packet_urgency(frame + off + 2, plen) > urgency)
+            urgency = packet_urgency(frame + off + 2, plen);
+        off += 2 + plen;
+    }
+    return urgency;
+}
+
+/* Make room in a queue at its high watermark for frame b. The least urgent
+ * class queued sheds first, by the drop policy within it, so a full queue
+ * still carries urgent packets. Frames partly written or in an async send
+ * are never dropped. Returns 0 if a queued frame was dropped, -1 if the
+ * new one should be. */
+static int tx_make_room(vex_peer_t *peer, const vex_pktbuf_t *b) {
+    int first = peer->tx_sent > 0 ? 1 : 0;
+    if (first < peer->tx_inflight) first = peer->tx_inflight;
+    if (first >= peer->tx_count) return -1;
+
+    uint8_t least = 0xFF, urgency = frame_urgency(b->data, b->len);
+    for (int i = first; i < peer->tx_count; i++) {
+        uint8_t u = frame_urgency(peer->tx_queue[i]->data, peer->tx_queue[i]->len);
+        if (u < least) least = u;
+    }
+    if (urgency < least) return -1;
+
+    int victim = -1;
+    uint8_t lowest = 0xFF;
+    for (int i = first; i < peer->tx_count; i++) {
+        const vex_pktbuf_t *f = peer->tx_queue[i];
+        if (frame_urgency(f->data, f->len) != least) continue;
+        if (tx_policy != VEX_TX_DROP_LOWEST_TTL) {
+            victim = i;
+            break;
+        }
+        uint8_t t = frame_ttl(f->data, f->len);
+        if (t < lowest) {
+            lowest = t;
+            victim = i;
         }
     }
+    if (tx_policy == VEX_TX_DROP_LOWEST_TTL && urgency == least &&
+        frame_ttl(b->data, b->len) < lowest)
+        return -1;
 
-    close(fd);
-    return -1;
+    tx_remove(peer, victim);
+    return 0;
 }
 
-/* Send data to a specific peer */
-int vex_transport_send_to_peer(vex_peer_t *peer, const uint8_t *data, size_t len) {
-    if (!peer->active || peer->fd < 0) return -1;
+/* Describe the peer's queued bytes as an iovec array (VEX_PEER_TX_QUEUE
+ * entries), resuming inside a partly written oldest frame. Returns the count */
+int vex_transport_tx_iov(const vex_peer_t *peer, struct iovec *iov) {
+    for (int i = 0; i < peer->tx_count; i++) {
+        const vex_pktbuf_t *f = peer->tx_queue[i];
+        iov[i].iov_base = (void *)f->data;
+        iov[i].iov_len = f->len;
+    }
+    if (peer->tx_count > 0) {
+        iov[0].iov_base = (uint8_t *)iov[0].iov_base + peer->tx_sent;
+        iov[0].iov_len -= peer->tx_sent;
+    }
+    return peer->tx_count;
+}
 
-    /* Length-prefixed: 2 bytes big-endian length + payload */
-    uint8_t header[2];
-    header[0] = (uint8_t)(len >> 8);
-    header[1] = (uint8_t)(len & 0xFF);
+/* Account n bytes of the queue as written: retire whole frames, remember
+ * where a partly written one stopped. Returns 1 if frames remain, else 0 */
+int vex_transport_tx_done(vex_peer_t *peer, size_t n) {
+    peer->tx_inflight = 0;
+    while (n > 0 && peer->tx_count > 0) {
+        const vex_pktbuf_t *f = peer->tx_queue[0];
+        size_t rest = (size_t)(f->len - peer->tx_sent);
+        if (n < rest) {
+            peer->tx_sent += (uint16_t)n;
+            break;
+        }
+        n -= rest;
+        tx_remove(peer, 0);
+    }
+    if (peer->tx_count == 0) peer->tx_hold_until = 0;
 
-    ssize_t n = write(peer->fd, header, 2);
-    if (n != 2) {
-        peer->active = 0;
-        close(peer->fd);
+    if (peer->tx_congested && peer->tx_count <= tx_low) {
+        peer->tx_congested = 0;
+        vex_log("TRANSPORT", "Peer %s drained to %d queued frames (%llu dropped so far)",
+                peer->name, peer->tx_count, (unsigned long long)peer->tx_dropped);
+    }
+    return peer->tx_count > 0;
+}
+
+/* Replace runs of queued frames that together fit the coalescing budget
+ * with one multi-packet frame each. Frames already partly written or in
+ * an async send stay as they are, and so does a frame with no room for
+ * company. An empty pool leaves the rest unpacked */
+static void tx_pack(vex_peer_t *peer) {
+    if (!coalesce_budget) return;
+    int first = peer->tx_sent > 0 ? 1 : 0;
+    if (first < peer->tx_inflight) first = peer->tx_inflight;
+
+    int out = first;
+    for (int i = first; i < peer->tx_count;) {
+        size_t body = 1;
+        int end = i;
+        while (end < peer->tx_count && peer->tx_queue[end]->data[2] != VEX_COALESCED &&
+               body + peer->tx_queue[end]->len <= (size_t)coalesce_budget)
+            body += peer->tx_queue[end++]->len;
+
+        vex_pktbuf_t *agg = end - i >= 2 ? vex_pool_alloc() : NULL;
+        if (!agg) {
+            peer->tx_queue[out++] = peer->tx_queue[i++];
+            continue;
+        }
+
+        agg->data[0] = (uint8_t)(body >> 8);
+        agg->data[1] = (uint8_t)(body & 0xFF);
+        agg->data[2] = VEX_COALESCED;
+        agg->len = 3;
+        stat_add(&tx_stat->packed, (uint64_t)(end - i));
+        stat_add(&tx_stat->coalesced, 1);
+        for (; i < end; i++) {
+            vex_pktbuf_t *f = peer->tx_queue[i];
+            memcpy(agg->data + agg->len, f->data, f->len);
+            agg->len = (uint16_t)(agg->len + f->len);
+            vex_pool_put(f);
+        }
+        peer->tx_queue[out++] = agg;
+    }
+    peer->tx_count = (uint16_t)out;
+}
+
+/* Whether a peer's queue should be written this turn: always, unless
+ * coalescing holds it for more packets and another like the last one
+ * queued would still fit the frame. A queue that is due is packed.
+ * Returns 1 if due, 0 if held */
+int vex_transport_tx_due(vex_peer_t *peer, uint64_t now_ms) {
+    if (coalesce_budget && peer->tx_hold_until > now_ms && peer->tx_count > 0 &&
+        peer->tx_count < tx_high / 2) {
+        size_t bytes = 1;
+        for (int i = 0; i < peer->tx_count; i++) bytes += peer->tx_queue[i]->len;
+        if (bytes + peer->tx_queue[peer->tx_count - 1]->len <= (size_t)coalesce_budget)
+            return 0;
+    }
+    tx_pack(peer);
+    return 1;
+}
+
+/* When the first held queue of node's peers comes due, in vex_time_ms()
+ * terms, or 0 if none is held */
+uint64_t vex_transport_next_due(const vex_node_t *node) {
+    uint64_t due = 0;
+    if (!coalesce_budget || !coalesce_window) return 0;
+    for (int i = 0; i < VEX_MAX_PEERS; i++) {
+        const vex_peer_t *peer = &node->peers[i];
+        if (peer->active && peer->tx_count > 0 && !peer->tx_want_write &&
+            (!due || peer->tx_hold_until < due))
+            due = peer->tx_hold_until;
+    }
+    return due;
+}
+
+/* Write out as much of a peer's queue as the socket will take, in one
+ * gathered sendmsg (a writev that cannot raise SIGPIPE when the peer has
+ * gone, which would take every relay thread down with it). Waits for
+ * writability through the write hook while frames remain.
+ * Under io_uring the queue is submitted as one async send instead.
+ * Returns 0 when the queue is empty, 1 if frames remain, -1 if the peer closed */
+int vex_transport_flush(vex_peer_t *peer) {
+    if (!peer->active) return -1;
+    if (peer->tx_count == 0) return 0;
+    tx_pack(peer);
+
+    if (vex_transport_uring_active()) {
+        if (!peer->tx_inflight && vex_uring_send(peer) == 0 && vex_uring_submit() > 0)
+            stat_add(&tx_stat->writes, 1);
+        return 1;
+    }
+
+    ssize_t n;
+    size_t done = 0;
+    if (sock_mode != VEX_SOCK_STREAM) {
+        n = vex_dgram_send(peer, &done);  /* one sendmmsg, a datagram per frame */
+    } else {
+        struct iovec iov[VEX_PEER_TX_QUEUE];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = (size_t)vex_transport_tx_iov(peer, iov);
+        n = sendmsg(peer->fd, &msg, MSG_NOSIGNAL);
+        done = n > 0 ? (size_t)n : 0;
+    }
+    stat_add(&tx_stat->writes, 1);
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            tx_watch(peer, 1);
+            return 1;
+        }
+        vex_transport_close_peer(peer);
         return -1;
     }
 
-    n = write(peer->fd, data, len);
-    if (n != (ssize_t)len) {
-        peer->active = 0;
-        close(peer->fd);
+    int more = vex_transport_tx_done(peer, done);
+    tx_watch(peer, more);
+    return more;
+}
+
+/* Flush every peer with queued frames, but for queues coalescing still
+ * holds. Under io_uring all their sends go to the kernel in a single
+ * submit, and over UDP in a single sendmmsg. */
+void vex_transport_flush_all(vex_node_t *node) {
+    if (sock_mode == VEX_SOCK_UDP) {
+        stat_add(&tx_stat->writes, (uint64_t)vex_dgram_flush_all(node));
+        return;
+    }
+
+    uint64_t now = coalesce_window ? vex_time_ms() : 0;
+    if (vex_transport_uring_active()) {
+        int queued = 0;
+        for (int i = 0; i < VEX_MAX_PEERS; i++) {
+            vex_peer_t *peer = &node->peers[i];
+            if (peer->active && peer->tx_count > 0 && !peer->tx_inflight &&
+                vex_transport_tx_due(peer, now) && vex_uring_send(peer) == 0)
+                queued++;
+        }
+        if (queued && vex_uring_submit() > 0) stat_add(&tx_stat->writes, 1);
+        return;
+    }
+
+    for (int i = 0; i < VEX_MAX_PEERS; i++) {
+        if (node->peers[i].active && node->peers[i].tx_count > 0 &&
+            !node->peers[i].tx_want_write && vex_transport_tx_due(&node->peers[i], now))
+            vex_transport_flush(&node->peers[i]);
+    }
+}
+
+/* Queue a pooled frame on a peer, taking a reference, and flush at once
+ * when batching is off. A slow peer keeps its connection; its full queue
+ * sheds frames by the drop policy instead. Returns 0 if the frame was
+ * queued or written, -1 if it was dropped or the peer is gone */
+static int tx_enqueue(vex_peer_t *peer, vex_pktbuf_t *b) {
+    if (!peer->active || peer->fd < 0) return -1;
+    stat_add(&tx_stat->frames, 1);
+    if (!b) {                            /* pool exhausted */
+        peer->tx_dropped++;
+        stat_add(&tx_stat->drops, 1);
         return -1;
     }
 
+    /* Shedding goes on until tx_done sees the queue back down to tx_low */
+    if (peer->tx_count >= tx_high || peer->tx_congested) {
+        if (!peer->tx_congested) {
+            peer->tx_congested = 1;
+            vex_log("TRANSPORT", "Peer %s is slow, %d frames queued, shedding %s",
+                    peer->name, peer->tx_count,
+                    tx_policy == VEX_TX_DROP_LOWEST_TTL ? "lowest TTL" : "oldest");
+        }
+        peer->tx_dropped++;
+        stat_add(&tx_stat->drops, 1);
+        if (tx_make_room(peer, b) != 0)
+            return -1;
+    }
+
+    vex_pool_ref(b);
+    if (coalesce_window && !peer->tx_hold_until)
+        peer->tx_hold_until = vex_time_ms() + (uint64_t)coalesce_window;
+    peer->tx_queue[peer->tx_count++] = b;
+    if (peer->tx_count > peer->tx_peak) peer->tx_peak = peer->tx_count;
+
+    if (!batching && !peer->tx_want_write && !peer->tx_inflight &&
+        vex_transport_flush(peer) < 0)
+        return -1;
     return 0;
 }
 
-/* Send data to all active peers except one (source) */
+/* Send data to a specific peer */
+int vex_transport_send_to_peer(vex_peer_t *peer, const uint8_t *data, size_t len) {
+    if (!peer->active || peer->fd < 0) return -1;
+    if (len > VEX_MAX_PACKET) return -1;
+
+    vex_pktbuf_t *b = vex_pool_frame(data, len);
+    int rc = tx_enqueue(peer, b);
+    vex_pool_put(b);
+    return rc;
+}
+
+/* Send data to all active peers except one (source). Every queue shares
+ * one pooled copy of the frame, as do peers reached by the fanout hook. */
 int vex_transport_send_to_all(vex_node_t *node, const uint8_t *data, size_t len, int except_fd) {
+    if (len > VEX_MAX_PACKET) return 0;
+
+    vex_pktbuf_t *b = NULL;
     int sent = 0;
     for (int i = 0; i < VEX_MAX_PEERS; i++) {
         if (node->peers[i].active && node->peers[i].fd != except_fd) {
-            if (vex_transport_send_to_peer(&node->peers[i], data, len) == 0) {
+            if (!b) b = vex_pool_frame(data, len);
+            if (tx_enqueue(&node->peers[i], b) == 0) {
                 sent++;
             }
         }
     }
+    if (fanout_hook) {
+        if (!b) b = vex_pool_frame(data, len);
+        if (b) sent += fanout_hook(fanout_hook_ctx, node, b, except_fd);
+    }
+    vex_pool_put(b);
+    return sent;
+}
+
+/* Queue an already pooled frame on all active peers of node except one,
+ * leaving the caller's reference alone. Returns the peers it was queued on */
+int vex_transport_send_buf(vex_node_t *node, vex_pktbuf_t *b, int except_fd) {
+    int sent = 0;
+    for (int i = 0; i < VEX_MAX_PEERS; i++) {
+        if (node->peers[i].active && node->peers[i].fd != except_fd &&
+            tx_enqueue(&node->peers[i], b) == 0)
+            sent++;
+    }
     return sent;
 }
 
-/* Read a packet from a peer (non-blocking).
- * Returns bytes read, 0 if nothing available, -1 on error/disconnect */
-int vex_transport_unix_read(vex_peer_t *peer, uint8_t *buf, size_t buf_len) {
+#define RX_MASK (VEX_PEER_RX_BUF - 1)
+
+#if (VEX_PEER_RX_BUF & RX_MASK) != 0 || VEX_PEER_RX_BUF < VEX_MAX_PACKET + 2
+#error "VEX_PEER_RX_BUF must be a power of two that holds a full frame"
+#endif
+
+static void peer_reset_buffers(vex_peer_t *peer) {
+    while (peer->tx_count > 0) vex_pool_put(peer->tx_queue[--peer->tx_count]);
+    peer->tx_sent = 0;
+    peer->tx_peak = 0;
+    peer->tx_congested = 0;
+    peer->tx_want_write = 0;
+    peer->tx_inflight = 0;
+    peer->tx_dropped = 0;
+    peer->tx_hold_until = 0;
+    peer->rx_head = 0;
+    peer->rx_len = 0;
+    peer->rx_state = VEX_RX_LEN_HI;
+    peer->rx_frame_len = 0;
+    peer->rx_frame_have = 0;
+}
+
+static uint8_t rx_byte(const vex_peer_t *peer, uint32_t i) {
+    return peer->rx_ring[(peer->rx_head + i) & RX_MASK];
+}
+
+static void rx_consume(vex_peer_t *peer, uint32_t n) {
+    peer->rx_head = (peer->rx_head + n) & RX_MASK;
+    peer->rx_len -= n;
+}
+
+/* Hand a received frame to on_frame, one packet at a time: a multi-packet
+ * frame is split first, its packets passed in place. A length that runs
+ * past the frame ends it. Returns packets delivered */
+int vex_transport_deliver(vex_peer_t *peer, uint8_t *frame, size_t len,
+                          vex_frame_fn on_frame, void *ctx) {
+    if (len == 0 || frame[0] != VEX_COALESCED) {
+        on_frame(ctx, peer, frame, len);
+        return 1;
+    }
+
+    int packets = 0;
+    size_t off = 1;
+    while (off < len && peer->active) {
+        size_t plen = off + 2 <= len ? (size_t)(frame[off] << 8 | frame[off + 1]) : 0;
+        if (plen == 0 || off + 2 + plen > len) {
+            vex_log("TRANSPORT", "Peer %s sent a malformed coalesced frame, rest dropped",
+                    peer->name);
+            break;
+        }
+        on_frame(ctx, peer, frame + off + 2, plen);
+        packets++;
+        off += 2 + plen;
+    }
+    return packets;
+}
+
+/* Parse every complete frame in the ring, resuming mid-frame where the last
+ * read stopped. Frames that sit contiguously in the ring are handed over in
+ * place; only one split by the wrap is copied into rx_frame first.
+ * Returns packets delivered, or -1 on a bad length (peer closed). */
+static int rx_parse(vex_peer_t *peer, vex_frame_fn on_frame, void *ctx) {
+    int frames = 0;
+
+    while (peer->active && peer->rx_len > 0) {
+        if (peer->rx_state == VEX_RX_LEN_HI) {
+            /* Fast path: header and frame all present and unwrapped */
+            if (peer->rx_len >= 2) {
+                uint16_t len = (uint16_t)(rx_byte(peer, 0) << 8 | rx_byte(peer, 1));
+                uint32_t body = (peer->rx_head + 2) & RX_MASK;
+                if (len > 0 && len <= VEX_MAX_PACKET && peer->rx_len >= 2u + len &&
+                    body + len <= VEX_PEER_RX_BUF) {
+                    frames += vex_transport_deliver(peer, peer->rx_ring + body, len,
+                                                    on_frame, ctx);
+                    rx_consume(peer, 2u + len);
+                    continue;
+                }
+            }
+            peer->rx_frame_len = (uint16_t)(rx_byte(peer, 0) << 8);
+            peer->rx_state = VEX_RX_LEN_LO;
+            rx_consume(peer, 1);
+        } else if (peer->rx_state == VEX_RX_LEN_LO) {
+            peer->rx_frame_len |= rx_byte(peer, 0);
+            rx_consume(peer, 1);
+            if (peer->rx_frame_len > VEX_MAX_PACKET) {
+                vex_log("TRANSPORT", "Peer %s sent a %u-byte frame, dropping peer",
+                        peer->name, peer->rx_frame_len);
+                vex_transport_close_peer(peer);
+                return -1;
+            }
+            peer->rx_frame_have = 0;
+            peer->rx_state = peer->rx_frame_len ? VEX_RX_BODY : VEX_RX_LEN_HI;
+        } else {
+            /* Copy up to the end of the frame or of the ring's first run */
+            uint32_t want = peer->rx_frame_len - peer->rx_frame_have;
+            uint32_t run = VEX_PEER_RX_BUF - peer->rx_head;
+            uint32_t n = want;
+            if (n > peer->rx_len) n = peer->rx_len;
+            if (n > run) n = run;
+
+            memcpy(peer->rx_frame + peer->rx_frame_have, peer->rx_ring + peer->rx_head, n);
+            peer->rx_frame_have += (uint16_t)n;
+            rx_consume(peer, n);
+
+            if (peer->rx_frame_have == peer->rx_frame_len) {
+                peer->rx_state = VEX_RX_LEN_HI;
+                frames += vex_transport_deliver(peer, peer->rx_frame, peer->rx_frame_len,
+                                                on_frame, ctx);
+            }
+        }
+    }
+    return frames;
+}
+
+/* Append bytes a completion-based backend already received to the peer's
+ * ring, parsing as the ring fills. Returns frames delivered, -1 if the
+ * peer was closed on a bad frame */
+int vex_transport_rx_feed(vex_peer_t *peer, const uint8_t *data, size_t len,
+                          vex_frame_fn on_frame, void *ctx) {
+    int frames = 0;
+
+    peer->last_seen = time(NULL);
+    while (len > 0 && peer->active) {
+        uint32_t tail = (peer->rx_head + peer->rx_len) & RX_MASK;
+        uint32_t n = VEX_PEER_RX_BUF - peer->rx_len;
+        if (n > VEX_PEER_RX_BUF - tail) n = VEX_PEER_RX_BUF - tail;
+        if (n > len) n = (uint32_t)len;
+
+        memcpy(peer->rx_ring + tail, data, n);
+        peer->rx_len += n;
+        data += n;
+        len -= n;
+
+        int got = rx_parse(peer, on_frame, ctx);
+        if (got < 0) return -1;
+        frames += got;
+    }
+    return frames;
+}
+
+/* Read from a peer with whichever framing the transport mode uses */
+int vex_transport_read(vex_peer_t *peer, vex_frame_fn on_frame, void *ctx) {
+    if (sock_mode != VEX_SOCK_STREAM) return vex_transport_dgram_read(peer, on_frame, ctx);
+    return vex_transport_unix_read(peer, on_frame, ctx);
+}
+
+/* Read everything available from a peer (non-blocking) in one readv() into
+ * its ring, then hand each complete frame to on_frame.
+ * Returns frames delivered (0 if none complete yet), -1 if the peer closed */
+int vex_transport_unix_read(vex_peer_t *peer, vex_frame_fn on_frame, void *ctx) {
     if (!peer->active) return -1;
 
-    /* Read 2-byte length header */
-    uint8_t header[2];
-    ssize_t n = read(peer->fd, header, 2);
+    uint32_t tail = (peer->rx_head + peer->rx_len) & RX_MASK;
+    uint32_t space = VEX_PEER_RX_BUF - peer->rx_len;
+    uint32_t first = VEX_PEER_RX_BUF - tail;
+    if (first > space) first = space;
+
+    struct iovec iov[2] = {
+        { peer->rx_ring + tail, first },
+        { peer->rx_ring, space - first },
+    };
+    ssize_t n = readv(peer->fd, iov, space > first ? 2 : 1);
     if (n == 0) {
         /* Peer disconnected */
-        peer->active = 0;
-        close(peer->fd);
+        vex_transport_close_peer(peer);
         return -1;
     }
     if (n < 0) {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
-        peer->active = 0;
-        close(peer->fd);
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return 0;
+        vex_transport_close_peer(peer);
         return -1;
     }
-    if (n != 2) return -1;
-
-    uint16_t pkt_len = ((uint16_t)header[0] << 8) | header[1];
-    if (pkt_len > buf_len || pkt_len > VEX_MAX_PACKET) return -1;
-
-    /* Read payload */
-    size_t total = 0;
-    while (total < pkt_len) {
-        n = read(peer->fd, buf + total, pkt_len - total);
-        if (n <= 0) {
-            peer->active = 0;
-            close(peer->fd);
-            return -1;
-        }
-        total += n;
-    }
 
+    peer->rx_len += (uint32_t)n;
     peer->last_seen = time(NULL);
-    return (int)pkt_len;
+    return rx_parse(peer, on_frame, ctx);
 }
@@ -0,0 +1,451 @@
+/* transport_uring.c — io_uring backend for the socket transport
+ *
+ * Built with make URING=1 on Linux. Peers, framing and queues stay in
+ * transport_unix.c; this file only moves their bytes:
+ *   - each peer has one multishot recv armed, drawing from a ring of
+ *     provided buffers, so receiving needs no syscall per read
+ *   - a flush turns each peer's queue into one sendmsg SQE, and all of
+ *     them reach the kernel in a single io_uring_enter
+ * The ring fd goes in the reactor; it is readable while completions wait.
+ * Without URING=1, or if the kernel refuses the ring or the buffer ring,
+ * or has the buffer ring but not multishot recv (5.19), init fails and
+ * the caller keeps the epoll/poll path.
+ *
+ * A peer closed with a send in flight keeps the frames of that send
+ * referenced until its completion arrives, since the kernel may still be
+ * reading them; only then do they go back to the pool. */
+
+#define _GNU_SOURCE  /* syscall(), MAP_ANONYMOUS, MAP_POPULATE under -std=c11 */
+#include "vex.h"
+
+#if defined(VEX_URING) && defined(__linux__)
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#define URING_ENTRIES  512         /* SQ size; CQ is twice that */
+#define URING_BUFS     256         /* provided receive buffers, power of two */
+#define URING_BUF_SIZE 4096
+#define URING_BGID     0
+
+/* user_data: op in the top byte, peer generation, peer slot in the low 32 bits */
+#define UD_RECV   1ULL
+#define UD_SEND   2ULL
+#define UD_CANCEL 3ULL
+#define UD_PROBE  4ULL
+#define UD(op, gen, idx) ((op) << 56 | ((uint64_t)(gen) & 0xFFFFFF) << 32 | (uint32_t)(idx))
+
+static struct {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned sq_entries;
+    unsigned sq_pending;            /* SQEs filled but not yet submitted */
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    void  *sq_map, *cq_map;
+    size_t sq_map_len, cq_map_len, sqes_len;
+
+    struct io_uring_buf_ring *br;
+    uint8_t *bufs;
+    uint16_t br_tail;
+
+    vex_node_t  *node;
+    vex_frame_fn on_frame;
+    void        *on_frame_ctx;
+    uint64_t     enters;
+} ring = { .fd = -1 };
+
+/* Per peer slot: generation (stale completions are ignored) and the
+ * sendmsg arguments, which must stay put until the send completes */
+static uint32_t peer_gen[VEX_MAX_PEERS];
+static struct msghdr tx_msg[VEX_MAX_PEERS];
+static struct iovec  tx_iov[VEX_MAX_PEERS][VEX_PEER_TX_QUEUE];
+
+/* Frames of sends still in flight on closed peers, each set released by
+ * the completion whose user_data it names */
+#define URING_ORPHANS (2 * VEX_MAX_PEERS)
+
+static struct {
+    uint64_t      user_data;        /* 0 = entry unused */
+    uint16_t      count;
+    vex_pktbuf_t *frames[VEX_PEER_TX_QUEUE];
+} orphans[URING_ORPHANS];
+
+static int sys_enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+    ring.enters++;
+    return (int)syscall(__NR_io_uring_enter, ring.fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int peer_index(const vex_peer_t *peer) {
+    return (int)(peer - ring.node->peers);
+}
+
+/* Next free SQE, submitting what is pending if the SQ is full */
+static struct io_uring_sqe *get_sqe(void) {
+    unsigned tail = *ring.sq_tail;
+    if (tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) >= ring.sq_entries) {
+        vex_uring_submit();
+        if (tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) >= ring.sq_entries)
+            return NULL;
+    }
+    unsigned idx = tail & *ring.sq_mask;
+    struct io_uring_sqe *sqe = &ring.sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    ring.sq_array[idx] = idx;
+    __atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring.sq_pending++;
+    return sqe;
+}
+
+/* Hand a receive buffer back to the kernel; published at the end of a reap */
+static void buf_recycle(uint16_t bid) {
+    struct io_uring_buf *b = &ring.br->bufs[ring.br_tail & (URING_BUFS - 1)];
+    b->addr = (uint64_t)(uintptr_t)(ring.bufs + (size_t)bid * URING_BUF_SIZE);
+    b->len = URING_BUF_SIZE;
+    b->bid = bid;
+    ring.br_tail++;
+}
+
+static int setup_buf_ring(void) {
+    size_t len = URING_BUFS * sizeof(struct io_uring_buf);
+    ring.br = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring.br == MAP_FAILED) {
+        ring.br = NULL;
+        return -1;
+    }
+    ring.bufs = malloc((size_t)URING_BUFS * URING_BUF_SIZE);
+    if (!ring.bufs) return -1;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring.br;
+    reg.ring_entries = URING_BUFS;
+    reg.bgid = URING_BGID;
+    if (syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        return -1;
+
+    for (uint16_t i = 0; i < URING_BUFS; i++) buf_recycle(i);
+    __atomic_store_n(&ring.br->tail, ring.br_tail, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* Wait for the next completion and take it off the CQ, handing back any
+ * receive buffer it used. Returns 0, or -1 on error */
+static int probe_cqe(struct io_uring_cqe *out) {
+    unsigned head = *ring.cq_head;
+    while (head == __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) {
+        int n = sys_enter(ring.sq_pending, 1, IORING_ENTER_GETEVENTS);
+        if (n < 0 && errno != EINTR) return -1;
+        if (n > 0) ring.sq_pending -= (unsigned)n;
+    }
+    *out = ring.cqes[head & *ring.cq_mask];
+    __atomic_store_n(ring.cq_head, head + 1, __ATOMIC_RELEASE);
+    if (out->flags & IORING_CQE_F_BUFFER)
+        buf_recycle((uint16_t)(out->flags >> IORING_CQE_BUFFER_SHIFT));
+    return 0;
+}
+
+/* Provided buffer rings came in 5.19, multishot recv only in 6.0: arm one
+ * on a socketpair, send a byte and see what completes. Returns 0 if the
+ * recv delivered it and stayed armed */
+static int probe_multishot(void) {
+    int sv[2], ok = 0;
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return -1;
+
+    struct io_uring_sqe *sqe = get_sqe();
+    if (sqe) {
+        struct io_uring_cqe cqe;
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = sv[0];
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = URING_BGID;
+        sqe->user_data = UD(UD_PROBE, 0, 0);
+
+        if (write(sv[1], "x", 1) == 1 && probe_cqe(&cqe) == 0) {
+            ok = cqe.res == 1 && (cqe.flags & IORING_CQE_F_MORE);
+            /* Still armed: end of stream makes it complete for good */
+            if (cqe.flags & IORING_CQE_F_MORE) {
+                shutdown(sv[1], SHUT_WR);
+                while (probe_cqe(&cqe) == 0 && (cqe.flags & IORING_CQE_F_MORE)) {}
+            }
+        }
+    }
+    close(sv[0]);
+    close(sv[1]);
+    __atomic_store_n(&ring.br->tail, ring.br_tail, __ATOMIC_RELEASE);
+    return ok ? 0 : -1;
+}
+
+/* Set up the ring and buffers. Returns 0 with io_uring in use, -1 if the
+ * kernel lacks what is needed (the caller stays on the epoll/poll path) */
+int vex_transport_uring_init(vex_node_t *node, vex_frame_fn on_frame, void *ctx) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    ring.fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (ring.fd < 0) {
+        vex_log("URING", "io_uring_setup failed (%s)", strerror(errno));
+        return -1;
+    }
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        vex_log("URING", "kernel too old (no single mmap)");
+        vex_transport_uring_close();
+        return -1;
+    }
+
+    ring.sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring.cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (ring.cq_map_len > ring.sq_map_len) ring.sq_map_len = ring.cq_map_len;
+    ring.sq_map = mmap(NULL, ring.sq_map_len, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+    ring.sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring.sqes = mmap(NULL, ring.sqes_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+    if (ring.sq_map == MAP_FAILED || ring.sqes == MAP_FAILED) {
+        if (ring.sq_map == MAP_FAILED) ring.sq_map = NULL;
+        if (ring.sqes == MAP_FAILED) ring.sqes = NULL;
+        vex_transport_uring_close();
+        return -1;
+    }
+    ring.cq_map = ring.sq_map;
+
+    uint8_t *sq = ring.sq_map, *cq = ring.cq_map;
+    ring.sq_head = (unsigned *)(sq + p.sq_off.head);
+    ring.sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring.sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring.sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring.sq_entries = p.sq_entries;
+    ring.cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring.cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring.cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    if (setup_buf_ring() != 0) {
+        vex_log("URING", "provided buffer ring unavailable (%s)", strerror(errno));
+        vex_transport_uring_close();
+        return -1;
+    }
+    if (probe_multishot() != 0) {
+        vex_log("URING", "kernel too old (no multishot recv)");
+        vex_transport_uring_close();
+        return -1;
+    }
+
+    ring.node = node;
+    ring.on_frame = on_frame;
+    ring.on_frame_ctx = ctx;
+
+    /* Peers connected before init move over to the ring */
+    for (int i = 0; i < VEX_MAX_PEERS; i++)
+        if (node->peers[i].active) vex_uring_arm(&node->peers[i]);
+
+    vex_log("URING", "io_uring transport: %u SQEs, %d x %d B receive buffers",
+            p.sq_entries, URING_BUFS, URING_BUF_SIZE);
+    return 0;
+}
+
+void vex_transport_uring_close(void) {
+    if (ring.sqes) munmap(ring.sqes, ring.sqes_len);
+    if (ring.sq_map) munmap(ring.sq_map, ring.sq_map_len);
+    if (ring.br) munmap(ring.br, URING_BUFS * sizeof(struct io_uring_buf));
+    free(ring.bufs);
+    if (ring.fd >= 0) close(ring.fd);
+    memset(&ring, 0, sizeof(ring));
+    ring.fd = -1;
+}
+
+int vex_transport_uring_active(void) {
+    return ring.node != NULL;
+}
+
+int vex_transport_uring_fd(void) {
+    return ring.fd;
+}
+
+uint64_t vex_transport_uring_enters(void) {
+    return ring.enters;
+}
+
+/* Submit every pending SQE. Returns how many went in, or -1 */
+int vex_uring_submit(void) {
+    if (ring.sq_pending == 0) return 0;
+    int n = sys_enter(ring.sq_pending, 0, 0);
+    if (n < 0) return -1;
+    ring.sq_pending -= (unsigned)n;
+    return n;
+}
+
+/* Arm a multishot recv for a new peer. The socket is made blocking so
+ * that sends wait in the kernel (poll-driven) instead of failing EAGAIN. */
+void vex_uring_arm(vex_peer_t *peer) {
+    int idx = peer_index(peer);
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe) {
+        vex_log("URING", "SQ full, dropping peer %s", peer->name);
+        vex_transport_close_peer(peer);
+        return;
+    }
+
+    fcntl(peer->fd, F_SETFL, fcntl(peer->fd, F_GETFL) & ~O_NONBLOCK);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = peer->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+    sqe->user_data = UD(UD_RECV, peer_gen[idx], idx);
+    vex_uring_submit();
+}
+
+/* Queue (not submit) one sendmsg for everything in the peer's queue.
+ * Returns 0 if queued, -1 if the SQ is full (retried on a later flush) */
+int vex_uring_send(vex_peer_t *peer) {
+    int idx = peer_index(peer);
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe) return -1;
+
+    int cnt = vex_transport_tx_iov(peer, tx_iov[idx]);
+    memset(&tx_msg[idx], 0, sizeof(tx_msg[idx]));
+    tx_msg[idx].msg_iov = tx_iov[idx];
+    tx_msg[idx].msg_iovlen = (size_t)cnt;
+    peer->tx_inflight = (uint16_t)cnt;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = peer->fd;
+    sqe->addr = (uint64_t)(uintptr_t)&tx_msg[idx];
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = UD(UD_SEND, peer_gen[idx], idx);
+    return 0;
+}
+
+/* Keep a reference on each frame of a closing peer's send in flight,
+ * until the completion named by user_data. With no entry free they are
+ * never released: a leak, but not a buffer reused under the kernel */
+static void orphan_pin(const vex_peer_t *peer, uint64_t user_data) {
+    int k = 0;
+    while (k < URING_ORPHANS && orphans[k].user_data) k++;
+    if (k == URING_ORPHANS) vex_log("URING", "no room to track a cancelled send, frames held");
+
+    for (int i = 0; i < peer->tx_inflight && i < peer->tx_count; i++) {
+        vex_pool_ref(peer->tx_queue[i]);
+        if (k < URING_ORPHANS) orphans[k].frames[orphans[k].count++] = peer->tx_queue[i];
+    }
+    if (k < URING_ORPHANS && orphans[k].count) orphans[k].user_data = user_data;
+}
+
+/* A send completed: if it was a closed peer's, its frames can go */
+static void orphan_release(uint64_t user_data) {
+    for (int k = 0; k < URING_ORPHANS; k++) {
+        if (orphans[k].user_data != user_data) continue;
+        for (int i = 0; i < orphans[k].count; i++) vex_pool_put(orphans[k].frames[i]);
+        orphans[k].count = 0;
+        orphans[k].user_data = 0;
+        return;
+    }
+}
+
+/* Cancel everything outstanding on a closing peer's fd; completions still
+ * in flight carry the old generation and are ignored, but for releasing
+ * the frames of a send the cancel cut short (or that finished anyway) */
+void vex_uring_cancel(vex_peer_t *peer) {
+    int idx = peer_index(peer);
+    if (peer->tx_inflight) orphan_pin(peer, UD(UD_SEND, peer_gen[idx], idx));
+    peer_gen[idx]++;
+    peer->tx_inflight = 0;
+
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe) return;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = peer->fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = UD(UD_CANCEL, 0, idx);
+    vex_uring_submit();  /* must reach the kernel before the fd is closed */
+}
+
+static void on_recv(vex_peer_t *peer, const struct io_uring_cqe *cqe) {
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        uint16_t bid = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        if (cqe->res > 0 && peer)
+            vex_transport_rx_feed(peer, ring.bufs + (size_t)bid * URING_BUF_SIZE,
+                                  (size_t)cqe->res, ring.on_frame, ring.on_frame_ctx);
+        buf_recycle(bid);
+    }
+    if (!peer || !peer->active) return;
+
+    if (cqe->res == 0 || (cqe->res < 0 && cqe->res != -ENOBUFS)) {
+        vex_transport_close_peer(peer);
+        return;
+    }
+    if (!(cqe->flags & IORING_CQE_F_MORE)) vex_uring_arm(peer);  /* out of buffers */
+}
+
+static void on_send(vex_peer_t *peer, const struct io_uring_cqe *cqe) {
+    if (cqe->res < 0 && cqe->res != -EAGAIN && cqe->res != -EINTR) {
+        vex_transport_close_peer(peer);
+        return;
+    }
+    vex_transport_tx_done(peer, cqe->res > 0 ? (size_t)cqe->res : 0);
+}
+
+/* Handle every completion waiting, after blocking for one if wait is set.
+ * Returns completions handled, or -1 on error */
+int vex_transport_uring_reap(int wait) {
+    if (!ring.node) return -1;
+    if (wait || ring.sq_pending) {
+        int n = sys_enter(ring.sq_pending, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0);
+        if (n < 0 && errno != EINTR) return -1;
+        if (n > 0) ring.sq_pending -= (unsigned)n;
+    }
+
+    int handled = 0;
+    unsigned head = *ring.cq_head;
+    while (head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe cqe = ring.cqes[head & *ring.cq_mask];
+        head++;
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+        handled++;
+
+        uint64_t op = cqe.user_data >> 56;
+        uint32_t idx = (uint32_t)cqe.user_data;
+        uint32_t gen = (uint32_t)(cqe.user_data >> 32) & 0xFFFFFF;
+        vex_peer_t *peer = NULL;
+        if (idx < VEX_MAX_PEERS && ring.node->peers[idx].active &&
+            (peer_gen[idx] & 0xFFFFFF) == gen)
+            peer = &ring.node->peers[idx];
+
+        if (op == UD_RECV) on_recv(peer, &cqe);
+        else if (op == UD_SEND && peer) on_send(peer, &cqe);
+        else if (op == UD_SEND) orphan_release(cqe.user_data);
+    }
+
+    __atomic_store_n(&ring.br->tail, ring.br_tail, __ATOMIC_RELEASE);
+    return handled;
+}
+
+#else  /* no io_uring in this build */
+
+int vex_transport_uring_init(vex_node_t *node, vex_frame_fn on_frame, void *ctx) {
+    (void)node; (void)on_frame; (void)ctx;
+    vex_log("URING", "not built in (make URING=1)");
+    return -1;
+}
+
+int  vex_transport_uring_active(void) { return 0; }
+int  vex_transport_uring_fd(void) { return -1; }
+int  vex_transport_uring_reap(int wait) { (void)wait; return -1; }
+void vex_transport_uring_close(void) {}
+uint64_t vex_transport_uring_enters(void) { return 0; }
+void vex_uring_arm(vex_peer_t *peer) { (void)peer; }
+int  vex_uring_send(vex_peer_t *peer) { (void)peer; return -1; }
+int  vex_uring_submit(void) { return -1; }
+void vex_uring_cancel(vex_peer_t *peer) { (void)peer; }
+
+#endif
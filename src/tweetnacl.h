@@ -24,6 +24,8 @@
 #define crypto_secretbox_NONCEBYTES 24
 #define crypto_secretbox_ZEROBYTES 32
 #define crypto_secretbox_BOXZEROBYTES 16
+#define crypto_stream_salsa20_KEYBYTES 32
+#define crypto_stream_salsa20_NONCEBYTES 8
 
 typedef unsigned char u8;
 typedef unsigned long long u64;
@@ -40,6 +42,18 @@ int crypto_sign_keypair(u8 *pk, u8 *sk);
 int crypto_sign(u8 *sm, u64 *smlen, const u8 *m, u64 n, const u8 *sk);
 int crypto_sign_open(u8 *m, u64 *mlen, const u8 *sm, u64 n, const u8 *pk);
 
+int crypto_stream_salsa20(u8 *c, u64 d, const u8 *n, const u8 *k);
+int crypto_stream_salsa20_xor(u8 *c, const u8 *m, u64 b, const u8 *n, const u8 *k);
+int crypto_onetimeauth(u8 *out, const u8 *m, u64 n, const u8 *k);
+
+/* TweetNaCl's own kernels; the public names above dispatch through
+ * crypto_accel.c and fall back to these */
+int crypto_stream_salsa20_xor_ref(u8 *c, const u8 *m, u64 b, const u8 *n, const u8 *k);
+int crypto_onetimeauth_ref(u8 *out, const u8 *m, u64 n, const u8 *k);
+
+int crypto_scalarmult(u8 *q, const u8 *n, const u8 *p);
+int crypto_scalarmult_base(u8 *q, const u8 *n);
+
 int crypto_hash(u8 *out, const u8 *m, u64 n);
 void randombytes(u8 *x, u64 xlen);
 
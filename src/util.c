@@ -1,12 +1,20 @@
 /* util.c — Logging and utility functions */
 
+#define _POSIX_C_SOURCE 200809L  /* localtime_r, flockfile under -std=c11 */
 #include "vex.h"
+#include "tweetnacl.h"
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
+#include <errno.h>
 #include <time.h>
+#include <pthread.h>
 #include <sys/time.h>
 #include <fcntl.h>
 #include <unistd.h>
+#if defined(__linux__) || defined(__COSMOPOLITAN__)
+#include <sys/random.h>
+#endif
 
 /* Hex encode bytes */
 void vex_hex(const uint8_t *data, size_t len, char *out) {
@@ -21,11 +29,14 @@ void vex_hex(const uint8_t *data, size_t len, char *out) {
 /* Log with component tag */
 void vex_log(const char *component, const char *fmt, ...) {
     struct timeval tv;
+    struct tm tm;
     gettimeofday(&tv, NULL);
-    struct tm *tm = localtime(&tv.tv_sec);
+    localtime_r(&tv.tv_sec, &tm);
 
+    /* One line per call even with relay threads logging at once */
+    flockfile(stderr);
     fprintf(stderr, "[%02d:%02d:%02d] [%s] ",
-            tm->tm_hour, tm->tm_min, tm->tm_sec, component);
+            tm.tm_hour, tm.tm_min, tm.tm_sec, component);
 
     va_list args;
     va_start(args, fmt);
@@ -33,6 +44,7 @@ void vex_log(const char *component, const char *fmt, ...) {
     va_end(args);
 
     fprintf(stderr, "\n");
+    funlockfile(stderr);
 }
 
 /* Current time in milliseconds */
@@ -42,15 +54,96 @@ uint64_t vex_time_ms(void) {
     return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
 }
 
-/* randombytes — read from /dev/urandom */
-void randombytes(unsigned char *x, unsigned long long xlen) {
+/* ── randombytes — buffered fast-key-erasure generator ──
+ * A 32-byte Salsa20 key, seeded once from getrandom(), expands into
+ * RNG_POOL_BYTES of output per refill. The first 32 bytes of every block
+ * replace the key and served bytes are wiped, so a later memory leak can't
+ * reveal earlier output. State is per thread; a fork handler drops the
+ * child's copy so parent and child never share a stream. */
+
+#define RNG_POOL_BYTES 512
+
+static _Thread_local struct {
+    uint8_t buf[crypto_stream_salsa20_KEYBYTES + RNG_POOL_BYTES];  /* key || pool */
+    size_t  avail;           /* unserved pool bytes, taken from the end */
+    int     seeded;
+} rng;
+
+static pthread_once_t rng_atfork_once = PTHREAD_ONCE_INIT;
+
+static void rng_forget(void) {
+    memset(&rng, 0, sizeof(rng));
+}
+
+static void rng_register_atfork(void) {
+    pthread_atfork(NULL, NULL, rng_forget);
+}
+
+/* Fill x from the kernel. Returns 0 on success, -1 if no source worked */
+static int os_random(uint8_t *x, size_t len) {
+    size_t got = 0;
+
+#if defined(__linux__) || defined(__COSMOPOLITAN__)
+    while (got < len) {
+        ssize_t n = getrandom(x + got, len - got, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        got += (size_t)n;
+    }
+    if (got == len) return 0;
+#endif
+
     int fd = open("/dev/urandom", O_RDONLY);
-    if (fd < 0) {
-        /* Fallback: terrible but non-crashing */
-        for (unsigned long long i = 0; i < xlen; i++)
-            x[i] = (unsigned char)(time(NULL) ^ (i * 2654435761U));
-        return;
+    if (fd < 0) return -1;
+    for (got = 0; got < len; ) {
+        ssize_t n = read(fd, x + got, len - got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += (size_t)n;
     }
-    read(fd, x, xlen);
     close(fd);
+    return got == len ? 0 : -1;
+}
+
+static void rng_seed(void) {
+    pthread_once(&rng_atfork_once, rng_register_atfork);
+
+    if (os_random(rng.buf, crypto_stream_salsa20_KEYBYTES) != 0) {
+        /* Fallback: terrible but non-crashing */
+        vex_log("UTIL", "No OS entropy source, falling back to time-based seed");
+        for (size_t i = 0; i < crypto_stream_salsa20_KEYBYTES; i++)
+            rng.buf[i] ^= (uint8_t)(time(NULL) ^ (i * 2654435761U) ^ (uintptr_t)&rng);
+    }
+    rng.avail = 0;
+    rng.seeded = 1;
+}
+
+/* Expand the current key into a fresh key and a full pool */
+static void rng_refill(void) {
+    static const uint8_t nonce[crypto_stream_salsa20_NONCEBYTES];  /* key is single-use */
+    uint8_t key[crypto_stream_salsa20_KEYBYTES];
+
+    memcpy(key, rng.buf, sizeof(key));
+    crypto_stream_salsa20(rng.buf, sizeof(rng.buf), nonce, key);
+    memset(key, 0, sizeof(key));
+    rng.avail = RNG_POOL_BYTES;
+}
+
+void randombytes(unsigned char *x, unsigned long long xlen) {
+    if (!rng.seeded) rng_seed();
+
+    while (xlen > 0) {
+        if (rng.avail == 0) rng_refill();
+
+        size_t take = rng.avail < xlen ? rng.avail : (size_t)xlen;
+        uint8_t *src = rng.buf + crypto_stream_salsa20_KEYBYTES + RNG_POOL_BYTES - rng.avail;
+        memcpy(x, src, take);
+        memset(src, 0, take);
+
+        rng.avail -= take;
+        x += take;
+        xlen -= take;
+    }
 }
@@ -7,16 +7,39 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/uio.h>
 
 /* ── Protocol constants ── */
 #define VEX_VERSION       0x01
 #define VEX_MAX_PACKET    512
 #define VEX_HEADER_SIZE   11        /* version(1) + packet_id(8) + ttl(1) + flags(1) */
 #define VEX_MAX_PAYLOAD   (VEX_MAX_PACKET - VEX_HEADER_SIZE)
+#define VEX_TTL_OFFSET    9         /* TTL byte within the wire header */
+#define VEX_SEAL_OVERHEAD 40        /* secretbox nonce(24) + MAC(16) in front of ciphertext */
+#define VEX_MSG_OFFSET    (VEX_HEADER_SIZE + VEX_SEAL_OVERHEAD)  /* plaintext slot in a wire buffer */
 #define VEX_DEFAULT_TTL   7
+#ifndef VEX_SEEN_CAPACITY
 #define VEX_SEEN_CAPACITY 1000
+#endif
 #define VEX_SEEN_TTL_SEC  60
+#define VEX_SEEN_SLOTS    (VEX_SEEN_CAPACITY * 2)  /* hash slots, load factor <= 0.5 */
+#define VEX_SEEN_WHEEL    64        /* 1s expiry buckets, must exceed VEX_SEEN_TTL_SEC */
+#define VEX_SEEN_NONE     UINT32_MAX
+#define VEX_BLOOM_SLICES  4         /* rotating filter generations */
+#define VEX_BLOOM_DEFAULT_CAPACITY 500000
+#define VEX_BLOOM_DEFAULT_FP       0.0001
+#ifndef VEX_MAX_PEERS
 #define VEX_MAX_PEERS     32
+#endif
+#define VEX_PEER_RX_BUF   4096      /* per-peer receive ring, power of two */
+#define VEX_PEER_TX_QUEUE 64        /* per-peer outbound frames */
+#ifndef VEX_POOL_BUFS
+#define VEX_POOL_BUFS     1024      /* shared packet buffers, the transmit memory cap */
+#endif
+#define VEX_MAX_THREADS   64        /* relay worker threads (--threads) */
 #define VEX_BLE_MAX_CONN  5
 #define VEX_SCAN_INTERVAL 15        /* seconds */
 #define VEX_KEY_ROTATE    3600      /* seconds — ephemeral key rotation */
@@ -25,6 +48,85 @@
 #define VEX_FLAG_ENCRYPTED    (1 << 0)
 #define VEX_FLAG_BROADCAST    (1 << 1)
 #define VEX_FLAG_ACK_REQ      (1 << 2)
+#define VEX_FLAG_PRIO_SHIFT   3         /* bits 3-4: priority, VEX_PRIO_* */
+#define VEX_FLAG_PRIO_MASK    (3 << VEX_FLAG_PRIO_SHIFT)
+#define VEX_FLAG_FRAGMENT     (1 << 6)  /* one piece of a message too long for a packet */
+#define VEX_FLAG_DIRECTED     (1 << 7)  /* unicast: payload starts with a directed header */
+
+/* ── Directed packets ──
+ * Payload: dest(8) | src(8) | initial TTL(1) | sealed message or an ack's
+ * packet ID. Addresses are the first VEX_ADDR_SIZE bytes of a node's
+ * public key. */
+#define VEX_ADDR_SIZE         8
+#define VEX_DIRECTED_HDR      (2 * VEX_ADDR_SIZE + 1)
+#define VEX_ROUTE_CAPACITY    256   /* destinations a node keeps routes to */
+#define VEX_ROUTE_TTL_SEC     120   /* a route not refreshed for this long expires */
+
+/* ── Fragments ──
+ * A long broadcast message goes out as up to VEX_FRAG_MAX_COUNT packets,
+ * each sealed on its own with message ID(8) | index(1) | count(1) in
+ * front of its piece of the message. Relays see ordinary packets with
+ * their own packet IDs, so dedup is per fragment. */
+#define VEX_FRAG_HDR          10
+#define VEX_FRAG_DATA         (VEX_MAX_PAYLOAD - VEX_SEAL_OVERHEAD - VEX_FRAG_HDR)
+#define VEX_FRAG_MAX_COUNT    255
+#define VEX_MAX_MESSAGE       (VEX_FRAG_MAX_COUNT * VEX_FRAG_DATA)
+#define VEX_FRAG_SLOTS        32    /* messages being reassembled at once */
+#define VEX_FRAG_TIMEOUT_SEC  30    /* a message incomplete for this long is dropped */
+#ifndef VEX_FRAG_MEMORY
+#define VEX_FRAG_MEMORY       (1 << 20)  /* bytes of reassembly buffers, all messages */
+#endif
+
+/* ── Priorities (flag bits 3-4) ──
+ * 0 is normal so packets from nodes without QoS keep their place */
+#define VEX_PRIO_NORMAL       0
+#define VEX_PRIO_BULK         1
+#define VEX_PRIO_HIGH         2
+#define VEX_PRIO_URGENT       3
+#define VEX_PRIO_CLASSES      4
+
+/* ── QoS relay schedulers (vex_mesh_set_qos) ── */
+#define VEX_QOS_OFF           0     /* relay in arrival order, straight to the peers */
+#define VEX_QOS_STRICT        1     /* always the most urgent class first */
+#define VEX_QOS_WEIGHTED      2     /* round robin, 8:4:2:1 from urgent to bulk */
+#ifndef VEX_QOS_QUEUE
+#define VEX_QOS_QUEUE         128   /* relays a node holds for the scheduler, all classes */
+#endif
+
+/* ── Outbound queue drop policies (queue at its high watermark) ── */
+#define VEX_TX_DROP_OLDEST    0     /* drop the oldest queued frame */
+#define VEX_TX_DROP_LOWEST_TTL 1    /* drop the frame with the fewest hops left */
+
+/* ── Relay policies (vex_mesh_set_relay_policy) ── */
+#define VEX_RELAY_FLOOD       0     /* relay every new packet at once */
+#define VEX_RELAY_COUNTER     1     /* hold a random delay, skip if enough copies heard */
+#define VEX_RELAY_GOSSIP      2     /* relay with a fixed probability */
+#ifndef VEX_RELAY_PENDING
+#define VEX_RELAY_PENDING     64    /* packets a counter-policy node holds at once */
+#endif
+#define VEX_RELAY_DEFAULT_DELAY_MS 20
+#define VEX_RELAY_DEFAULT_COUNT    3
+#define VEX_GOSSIP_DEFAULT_PROB    0.65
+
+/* ── Frame coalescing (vex_transport_set_coalesce) ──
+ * A multi-packet frame starts with VEX_COALESCED where a packet has its
+ * version byte, then holds each packet as 2-byte length | packet. The
+ * whole frame still fits VEX_MAX_PACKET, so receivers need no bigger
+ * buffers. */
+#define VEX_COALESCED         0xC5
+#define VEX_COALESCE_MIN      64    /* smallest size budget worth packing into */
+
+/* ── Transport socket modes ── */
+#define VEX_SOCK_STREAM       0     /* AF_UNIX stream, 2-byte length prefix */
+#define VEX_SOCK_SEQPACKET    1     /* AF_UNIX SOCK_SEQPACKET, a packet per message */
+#define VEX_SOCK_UDP          2     /* UDP, a packet per datagram */
+#ifndef VEX_UDP_IDLE_S
+#define VEX_UDP_IDLE_S        60    /* learned UDP peers silent this long are dropped */
+#endif
+
+/* ── Packet ID schemes ── */
+#define VEX_ID_SIPHASH        0     /* keyed SipHash-2-4 of nonce + counter (default) */
+#define VEX_ID_SHA512         1     /* SHA-512 of payload + random nonce (original) */
 
 /* ── GATT UUIDs ── */
 #define VEX_SERVICE_UUID  "0000vc01-0000-1000-8000-00805f9b34fb"
@@ -42,19 +144,94 @@ typedef struct {
     uint16_t payload_len;
 } vex_packet_t;
 
-/* ── Seen cache (deduplication) ── */
+/* Non-owning view: decoded header plus a pointer into the caller's buffer */
 typedef struct {
+    uint8_t  version;
     uint8_t  packet_id[8];
+    uint8_t  ttl;
+    uint8_t  flags;
+    const uint8_t *payload;
+    uint16_t payload_len;
+} vex_packet_view_t;
+
+/* ── Seen cache (deduplication) ──
+ * Open-addressing hash table (linear probing) of entry indices, keyed by
+ * the packet ID as a uint64_t. Entries are also threaded onto a timing
+ * wheel of one-second buckets in insertion order, so expiry and LRU
+ * eviction pop from the oldest bucket instead of scanning. */
+typedef struct {
+    uint64_t id;
     time_t   timestamp;
-    int      active;
+    uint32_t prev;           /* bucket list links, VEX_SEEN_NONE = end */
+    uint32_t next;           /* doubles as free-list link when unused */
 } vex_seen_entry_t;
 
 typedef struct {
     vex_seen_entry_t entries[VEX_SEEN_CAPACITY];
+    uint32_t slots[VEX_SEEN_SLOTS];        /* entry index or VEX_SEEN_NONE */
+    uint32_t wheel_head[VEX_SEEN_WHEEL];   /* oldest entry in each bucket */
+    uint32_t wheel_tail[VEX_SEEN_WHEEL];   /* newest entry in each bucket */
+    uint32_t free_head;
+    time_t   wheel_time;     /* newest second the wheel has advanced to */
+    time_t   evict_from;     /* no live entry is older than this second */
+    uint64_t seed;           /* per-cache hash key */
     int count;
 } vex_seen_cache_t;
 
+/* Seen cache backends, selected per node at startup */
+#define VEX_SEEN_EXACT    0         /* hash table above, VEX_SEEN_CAPACITY IDs */
+#define VEX_SEEN_BLOOM    1         /* rotating Bloom filter, sized at runtime */
+
+typedef struct {
+    uint64_t *bits;                           /* VEX_BLOOM_SLICES x slice_words */
+    uint32_t  slice_words;
+    uint32_t  slice_bits;
+    uint32_t  slice_capacity;                 /* items per slice before early rotation */
+    uint32_t  slice_set[VEX_BLOOM_SLICES];    /* bits set, for the FP estimate */
+    uint32_t  slice_items[VEX_BLOOM_SLICES];
+    int       hashes;
+    int       current;
+    int       rotate_sec;
+    time_t    rotated_at;
+    double    target_fp;
+    uint64_t  early_rotations;
+    uint64_t  seed;
+} vex_bloom_t;
+
+/* Seen cache split by packet-ID hash for relay worker threads: each shard
+ * is one of the backends above behind its own lock, so a lookup and its
+ * insert are a single step and a packet is new to exactly one thread */
+typedef struct {
+    pthread_mutex_t  lock;
+    vex_seen_cache_t cache;          /* VEX_SEEN_EXACT */
+    vex_bloom_t      bloom;          /* VEX_SEEN_BLOOM */
+} vex_seen_shard_t;
+
+typedef struct {
+    vex_seen_shard_t *shard;
+    uint32_t mask;                   /* shard count - 1, a power of two */
+    int      mode;                   /* VEX_SEEN_EXACT or VEX_SEEN_BLOOM */
+    uint64_t capacity;               /* IDs across all shards */
+    uint64_t seed;
+} vex_seen_shards_t;
+
 /* ── Peer ── */
+
+/* Stream frame parser states: 2-byte big-endian length, then the frame */
+#define VEX_RX_LEN_HI     0
+#define VEX_RX_LEN_LO     1
+#define VEX_RX_BODY       2
+
+/* Pooled packet buffer: a frame (2-byte length prefix and the packet)
+ * shared by reference between the receive path and any number of peer
+ * queues */
+typedef struct {
+    _Atomic uint16_t refs;   /* 0 = on the free list */
+    uint16_t len;            /* bytes in data, prefix included */
+    uint16_t next_free;
+    uint8_t  data[2 + VEX_MAX_PACKET];
+} vex_pktbuf_t;
+
 typedef struct {
     int      fd;             /* socket fd or BLE handle */
     char     name[64];
@@ -62,8 +239,143 @@ typedef struct {
     int      active;
     int      rssi;
     time_t   last_seen;
+
+    /* Receive side: bytes read but not yet parsed, and the parser's place */
+    uint8_t  rx_ring[VEX_PEER_RX_BUF];
+    uint32_t rx_head;        /* offset of the oldest unparsed byte */
+    uint32_t rx_len;         /* unparsed bytes in the ring */
+    int      rx_state;       /* VEX_RX_* */
+    uint16_t rx_frame_len;
+    uint16_t rx_frame_have;
+    uint8_t  rx_frame[VEX_MAX_PACKET];  /* reassembly for frames split by the wrap */
+
+    /* Send side: bounded queue of frames not yet written, oldest first.
+     * Each entry holds one reference on a pooled buffer. */
+    vex_pktbuf_t *tx_queue[VEX_PEER_TX_QUEUE];
+    uint16_t tx_count;       /* frames queued */
+    uint16_t tx_sent;        /* bytes of the oldest frame already written */
+    uint16_t tx_peak;        /* deepest the queue has been */
+    int      tx_congested;   /* hit the high watermark, not yet back to low */
+    int      tx_want_write;  /* waiting for the socket to become writable */
+    uint16_t tx_inflight;    /* oldest frames handed to an async send */
+    uint64_t tx_dropped;     /* frames discarded by the drop policy */
+    uint64_t tx_hold_until;  /* coalescing: ms the queue may wait until, 0 = empty */
 } vex_peer_t;
 
+/* Called for each complete frame a transport read produces */
+typedef void (*vex_frame_fn)(void *ctx, vex_peer_t *peer, uint8_t *frame, size_t len);
+
+/* ── Reactor ──
+ * Readiness loop over epoll (Linux) or poll() (portable builds). Handlers
+ * live in a table indexed by fd and are called only for ready fds. */
+#define VEX_REACTOR_MAX_FDS 1024
+#define VEX_IO_READ       (1 << 0)
+#define VEX_IO_WRITE      (1 << 1)
+#define VEX_IO_ERROR      (1 << 2)  /* hangup or error, always reported */
+
+typedef void (*vex_io_fn)(void *ctx, int fd, uint32_t events);
+
+typedef struct {
+    vex_io_fn fn;            /* NULL = slot unused */
+    void     *ctx;
+    uint32_t  events;
+    int       poll_idx;      /* index in pfds (poll backend) */
+} vex_io_handler_t;
+
+typedef struct {
+    int              epoll_fd;                   /* -1 = poll() backend */
+    vex_io_handler_t handlers[VEX_REACTOR_MAX_FDS];
+    struct pollfd    pfds[VEX_REACTOR_MAX_FDS];  /* poll backend watch list */
+    int              npfds;
+    uint64_t         wakeups;
+} vex_reactor_t;
+
+/* Transport peer lifecycle hook: up=1 after a peer connects, up=0 just
+ * before its fd is closed. The same signature serves the write hook, where
+ * up=1 means the peer's queue is waiting for the socket to be writable. */
+typedef void (*vex_peer_hook_fn)(void *ctx, vex_peer_t *peer, int up);
+
+/* ── Route cache ── */
+typedef struct {
+    uint8_t  dest[VEX_ADDR_SIZE];
+    int      next_fd;            /* peer the route leaves by */
+    uint8_t  hops;
+    time_t   updated;
+} vex_route_t;
+
+typedef struct {
+    vex_route_t entries[VEX_ROUTE_CAPACITY];
+    int         count;
+} vex_route_table_t;
+
+/* ── Reassembly table ──
+ * One slot per message in progress, its buffer sized for count fragments.
+ * Shared by relay worker threads, hence the lock. */
+typedef struct {
+    uint8_t  msg_id[8];
+    uint8_t  count;          /* 0 = slot free */
+    uint8_t  have;
+    uint64_t got[4];         /* bitmap of fragment indices received */
+    uint16_t last_len;       /* bytes in the final fragment */
+    time_t   started;
+    uint8_t *data;           /* count * VEX_FRAG_DATA */
+} vex_frag_msg_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    vex_frag_msg_t  msg[VEX_FRAG_SLOTS];
+    size_t   memory;         /* bytes held in data buffers */
+    uint64_t completed;
+    uint64_t expired;        /* timed out before every fragment came */
+    uint64_t evicted;        /* pushed out to stay under VEX_FRAG_MEMORY */
+    uint64_t rejected;       /* malformed or inconsistent fragments */
+} vex_frag_table_t;
+
+/* ── QoS relay queue ──
+ * Relays wait in per-class FIFOs of slot indices until the scheduler
+ * passes them to the transport */
+typedef struct {
+    uint64_t queued_ms;
+    int      source_fd;
+    uint16_t len;
+    uint8_t  data[VEX_MAX_PACKET];
+} vex_qos_slot_t;
+
+typedef struct {
+    uint16_t fifo[VEX_QOS_QUEUE];    /* oldest at head */
+    uint16_t head;
+    uint16_t count;
+    uint64_t relayed;
+    uint64_t shed;                   /* dropped for room, this class's or a more urgent one's */
+    uint64_t wait_ms_total;          /* time queued, summed over relayed */
+    uint64_t wait_ms_max;
+} vex_qos_class_t;
+
+typedef struct {
+    int             mode;            /* VEX_QOS_STRICT or VEX_QOS_WEIGHTED */
+    vex_qos_slot_t  slot[VEX_QOS_QUEUE];
+    uint16_t        free_slot[VEX_QOS_QUEUE];
+    int             count;
+    vex_qos_class_t cls[VEX_PRIO_CLASSES];   /* by rank, urgent first */
+} vex_qos_t;
+
+/* ── Counter-policy relay queue ── */
+typedef struct {
+    uint64_t due_ms;
+    int      source_fd;
+    uint16_t len;
+    uint8_t  copies;             /* times heard, the first included */
+    uint8_t  data[VEX_MAX_PACKET];
+} vex_relay_pending_t;
+
+/* Held packets, with a min-heap of slot indices ordered by due time */
+typedef struct {
+    vex_relay_pending_t slot[VEX_RELAY_PENDING];
+    uint16_t heap[VEX_RELAY_PENDING];
+    uint16_t free_slot[VEX_RELAY_PENDING];
+    int      count;
+} vex_relay_queue_t;
+
 /* ── Node state ── */
 typedef struct {
     /* Identity */
@@ -82,12 +394,25 @@ typedef struct {
 
     /* Dedup */
     vex_seen_cache_t seen;
+    vex_bloom_t      seen_bloom;
+    int              seen_mode;      /* VEX_SEEN_EXACT or VEX_SEEN_BLOOM */
+    vex_seen_shards_t *seen_shared;  /* set: replaces both, shared across threads */
+
+    /* Directed packets */
+    vex_route_table_t routes;
+
+    /* Long messages being put back together (shared with relay workers) */
+    vex_frag_table_t *frags;
 
     /* Stats */
     uint64_t packets_sent;
     uint64_t packets_received;
     uint64_t packets_relayed;
     uint64_t packets_dropped;
+    uint64_t relays_deferred;    /* held by the counter policy */
+    uint64_t relays_suppressed;  /* relays the policy decided to skip */
+    uint64_t packets_routed;     /* directed packets sent down a known route */
+    uint64_t route_floods;       /* directed packets flooded for want of one */
     time_t   started_at;
 
     /* Config */
@@ -97,14 +422,44 @@ typedef struct {
     int      lora_enabled;
     int      running;
 
+    /* Relay policy */
+    int      relay_policy;       /* VEX_RELAY_FLOOD, _COUNTER or _GOSSIP */
+    int      relay_delay_ms;     /* counter: longest random hold */
+    int      relay_count;        /* counter: copies heard that cancel a relay */
+    double   gossip_prob;        /* gossip: chance of relaying */
+    vex_relay_queue_t *relay_queue;  /* counter: held packets */
+
+    /* QoS */
+    uint8_t  priority;           /* VEX_PRIO_* of messages this node sends */
+    vex_qos_t *qos;              /* NULL = VEX_QOS_OFF */
+
     /* Transport */
     int      listen_fd;      /* for unix socket transport */
 } vex_node_t;
 
+/* Transport fanout hook: send_to_all has queued a frame on the node's own
+ * peers; pass the same buffer on to peers other threads own, or to a
+ * simulated link layer, skipping except_fd (the source). Returns the
+ * peers it reached. */
+typedef int (*vex_fanout_fn)(void *ctx, vex_node_t *node, vex_pktbuf_t *b, int except_fd);
+
 /* ── packet.c ── */
 int  vex_packet_encode(const vex_packet_t *pkt, uint8_t *buf, size_t buf_len);
 int  vex_packet_decode(const uint8_t *buf, size_t len, vex_packet_t *pkt);
+int  vex_packet_validate(const uint8_t *buf, size_t len);
+int  vex_packet_decode_view(const uint8_t *buf, size_t len, vex_packet_view_t *view);
+int  vex_packet_encode_header(const vex_packet_view_t *view, uint8_t *buf, size_t buf_len);
 void vex_packet_make_id(const uint8_t *payload, uint16_t len, uint8_t *id_out);
+void vex_packet_set_id_scheme(int scheme);
+
+/* ── pool.c ── */
+vex_pktbuf_t *vex_pool_alloc(void);
+vex_pktbuf_t *vex_pool_owner(const uint8_t *data, size_t len);
+vex_pktbuf_t *vex_pool_frame(const uint8_t *data, size_t len);
+void vex_pool_ref(vex_pktbuf_t *b);
+void vex_pool_put(vex_pktbuf_t *b);
+void vex_pool_stats(uint32_t *used, uint32_t *high_water, uint64_t *misses);
+void vex_pool_set_shared(int on);
 
 /* ── seen.c ── */
 void vex_seen_init(vex_seen_cache_t *cache);
@@ -112,6 +467,24 @@ int  vex_seen_check(vex_seen_cache_t *cache, const uint8_t *packet_id);  /* 1=se
 void vex_seen_add(vex_seen_cache_t *cache, const uint8_t *packet_id);
 void vex_seen_prune(vex_seen_cache_t *cache);
 
+/* ── seen_shard.c ── */
+int  vex_seen_shards_init(vex_seen_shards_t *s, uint32_t shards, int mode,
+                          uint32_t bloom_capacity, double bloom_fp);
+void vex_seen_shards_free(vex_seen_shards_t *s);
+int  vex_seen_shards_test_add(vex_seen_shards_t *s, const uint8_t *packet_id);  /* 1=seen, 0=new */
+void vex_seen_shards_prune(vex_seen_shards_t *s);
+uint64_t vex_seen_shards_count(vex_seen_shards_t *s);
+
+/* ── bloom.c ── */
+int    vex_bloom_init(vex_bloom_t *bf, uint32_t capacity, double fp_rate);
+void   vex_bloom_free(vex_bloom_t *bf);
+int    vex_bloom_check(vex_bloom_t *bf, const uint8_t *packet_id);  /* 1=seen, 0=new */
+void   vex_bloom_add(vex_bloom_t *bf, const uint8_t *packet_id);
+void   vex_bloom_prune(vex_bloom_t *bf);
+double vex_bloom_fp_rate(const vex_bloom_t *bf);
+uint64_t vex_bloom_count(const vex_bloom_t *bf);
+size_t vex_bloom_memory(const vex_bloom_t *bf);
+
 /* ── crypto.c ── */
 int  vex_crypto_init(vex_node_t *node);
 int  vex_crypto_load_keys(vex_node_t *node, const char *path);
@@ -120,20 +493,131 @@ int  vex_crypto_encrypt_broadcast(const vex_node_t *node, const uint8_t *plain,
                                    uint8_t *cipher, uint16_t *cipher_len);
 int  vex_crypto_decrypt_broadcast(const vex_node_t *node, const uint8_t *cipher, uint16_t len,
                                    uint8_t *plain, uint16_t *plain_len);
+int  vex_crypto_seal_inplace(const vex_node_t *node, uint8_t *payload, uint16_t msg_len,
+                             uint16_t *payload_len);
+int  vex_crypto_open_inplace(const vex_node_t *node, uint8_t *payload, uint16_t len,
+                             uint16_t *msg_len);
 void vex_crypto_derive_mesh_key(vex_node_t *node);
 
+/* ── crypto_accel.c ── */
+void        vex_crypto_accel_disable(void);
+const char *vex_crypto_accel_name(void);
+
 /* ── mesh.c ── */
 int  vex_mesh_init(vex_node_t *node);
 int  vex_mesh_send(vex_node_t *node, const char *message);
-int  vex_mesh_relay(vex_node_t *node, const uint8_t *raw, size_t len, int source_fd);
-int  vex_mesh_receive(vex_node_t *node, const uint8_t *raw, size_t len, int source_fd);
+int  vex_mesh_relay(vex_node_t *node, uint8_t *raw, size_t len, int source_fd);
+int  vex_mesh_receive(vex_node_t *node, uint8_t *raw, size_t len, int source_fd);
+int  vex_mesh_use_bloom(vex_node_t *node, uint32_t capacity, double fp_rate);
+void vex_mesh_prune(vex_node_t *node);
+int  vex_mesh_set_relay_policy(vex_node_t *node, int policy, int delay_ms, int count,
+                               double gossip_prob);
+const char *vex_mesh_relay_policy_name(int policy);
+void vex_mesh_tick(vex_node_t *node);
+uint64_t vex_mesh_next_due(const vex_node_t *node);
+void vex_mesh_set_clock(uint64_t (*now_ms)(void));
+int  vex_mesh_send_to(vex_node_t *node, const uint8_t *dest, const char *message);
+int  vex_mesh_send_prio(vex_node_t *node, const char *message, int priority);
+int  vex_mesh_set_qos(vex_node_t *node, int mode);
+const char *vex_mesh_qos_name(int mode);
+int  vex_mesh_priority(const char *name);
+const char *vex_mesh_priority_name(int priority);
+const char *vex_mesh_qos_class_name(int rank);
+void vex_mesh_peer_down(vex_node_t *node, int fd);
+
+/* ── route.c ── */
+void vex_route_init(vex_route_table_t *t);
+void vex_route_learn(vex_route_table_t *t, const uint8_t *dest, int fd, uint8_t hops, time_t now);
+const vex_route_t *vex_route_lookup(vex_route_table_t *t, const uint8_t *dest, time_t now);
+void vex_route_drop_peer(vex_route_table_t *t, int fd);
+void vex_route_prune(vex_route_table_t *t, time_t now);
+
+/* ── frag.c ── */
+vex_frag_table_t *vex_frag_new(void);
+void     vex_frag_free(vex_frag_table_t *t);
+void     vex_frag_header(uint8_t *out, const uint8_t *msg_id, uint8_t index, uint8_t count);
+uint8_t *vex_frag_add(vex_frag_table_t *t, const uint8_t *frag, size_t len, time_t now,
+                      size_t *msg_len);
+void     vex_frag_prune(vex_frag_table_t *t, time_t now);
+size_t   vex_frag_pending(vex_frag_table_t *t, size_t *bytes);
 
 /* ── transport (unix socket for dev, BLE for production) ── */
 int  vex_transport_unix_init(vex_node_t *node, const char *sock_path);
 int  vex_transport_unix_accept(vex_node_t *node);
 int  vex_transport_unix_connect(vex_node_t *node, const char *sock_path);
+int  vex_transport_unix_accept_fd(vex_node_t *node);
+int  vex_transport_unix_dial(const char *sock_path);
+int  vex_transport_add_peer(vex_node_t *node, int fd, const char *name);
 int  vex_transport_send_to_peer(vex_peer_t *peer, const uint8_t *data, size_t len);
 int  vex_transport_send_to_all(vex_node_t *node, const uint8_t *data, size_t len, int except_fd);
+int  vex_transport_send_buf(vex_node_t *node, vex_pktbuf_t *b, int except_fd);
+int  vex_transport_unix_read(vex_peer_t *peer, vex_frame_fn on_frame, void *ctx);
+int  vex_transport_read(vex_peer_t *peer, vex_frame_fn on_frame, void *ctx);
+void vex_transport_set_mode(int mode);
+int  vex_transport_mode(void);
+void vex_transport_close_peer(vex_peer_t *peer);
+void vex_transport_set_batching(int on);
+int  vex_transport_flush(vex_peer_t *peer);
+void vex_transport_flush_all(vex_node_t *node);
+int  vex_transport_set_queue(int high, int low, int policy);
+void vex_transport_counters(uint64_t *frames, uint64_t *writes, uint64_t *dropped);
+int  vex_transport_room(const vex_node_t *node);
+int  vex_transport_set_coalesce(int window_ms, int budget);
+void vex_transport_coalesce_counters(uint64_t *packets, uint64_t *frames);
+int  vex_transport_tx_due(vex_peer_t *peer, uint64_t now_ms);
+uint64_t vex_transport_next_due(const vex_node_t *node);
+int  vex_transport_deliver(vex_peer_t *peer, uint8_t *frame, size_t len,
+                           vex_frame_fn on_frame, void *ctx);
+void vex_transport_set_peer_hook(vex_peer_hook_fn fn, void *ctx);
+void vex_transport_set_write_hook(vex_peer_hook_fn fn, void *ctx);
+void vex_transport_set_fanout_hook(vex_fanout_fn fn, void *ctx);
+void vex_transport_set_thread(int index);
+int  vex_transport_rx_feed(vex_peer_t *peer, const uint8_t *data, size_t len,
+                           vex_frame_fn on_frame, void *ctx);
+int  vex_transport_tx_iov(const vex_peer_t *peer, struct iovec *iov);
+int  vex_transport_tx_done(vex_peer_t *peer, size_t n);
+
+/* ── transport_dgram.c (SEQPACKET and UDP modes) ── */
+int  vex_transport_udp_init(vex_node_t *node, const char *spec);
+int  vex_transport_udp_connect(vex_node_t *node, const char *spec);
+int  vex_transport_udp_accept(vex_node_t *node, vex_frame_fn on_frame, void *ctx);
+int  vex_transport_udp_prune(vex_node_t *node, time_t idle_s);
+int  vex_transport_dgram_read(vex_peer_t *peer, vex_frame_fn on_frame, void *ctx);
+int  vex_dgram_send(vex_peer_t *peer, size_t *bytes);
+int  vex_dgram_flush_all(vex_node_t *node);
+
+/* ── transport_uring.c (make URING=1; Linux 6.0+) ──
+ * Completion-based I/O for the same peers: multishot receives into a
+ * provided-buffer ring, and one submit for every peer's flush. */
+int  vex_transport_uring_init(vex_node_t *node, vex_frame_fn on_frame, void *ctx);
+int  vex_transport_uring_active(void);
+int  vex_transport_uring_fd(void);
+int  vex_transport_uring_reap(int wait);
+void vex_transport_uring_close(void);
+uint64_t vex_transport_uring_enters(void);
+void vex_uring_arm(vex_peer_t *peer);
+int  vex_uring_send(vex_peer_t *peer);
+int  vex_uring_submit(void);
+void vex_uring_cancel(vex_peer_t *peer);
+
+/* ── workers.c (--threads N) ──
+ * Relay worker threads, each with its own node copy, peers and reactor.
+ * Frames for another thread's peers go through its lock-free inbox. */
+int  vex_workers_start(vex_node_t *node, int threads);
+void vex_workers_stop(void);
+int  vex_workers_count(void);
+vex_node_t *vex_workers_node(int index);
+void vex_workers_adopt(int fd, const char *name);
+void vex_workers_counters(uint64_t *handoffs, uint64_t *dropped, uint64_t *wakeups);
+
+/* ── reactor.c ── */
+int  vex_reactor_init(vex_reactor_t *r);
+void vex_reactor_close(vex_reactor_t *r);
+int  vex_reactor_add(vex_reactor_t *r, int fd, uint32_t events, vex_io_fn fn, void *ctx);
+int  vex_reactor_mod(vex_reactor_t *r, int fd, uint32_t events);
+void vex_reactor_del(vex_reactor_t *r, int fd);
+int  vex_reactor_run_once(vex_reactor_t *r, int timeout_ms);
+const char *vex_reactor_backend(const vex_reactor_t *r);
 
 /* ── util ── */
 void vex_hex(const uint8_t *data, size_t len, char *out);
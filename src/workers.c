@@ -0,0 +1,421 @@
+/* workers.c — Multi-threaded relay: peers partitioned over worker threads
+ *
+ * Each worker owns a copy of the node (identity, keys, config) with its
+ * own peer table and reactor, and runs the same loop as the single-
+ * threaded relay: read, dedup, decrypt for display, relay, one flush per
+ * turn. What ties the workers together:
+ *   - the seen cache is node->seen_shared, sharded by packet ID with a
+ *     lock per shard (seen_shard.c), so every packet is new to exactly one
+ *     worker however many of them receive it
+ *   - a relay queues the pooled frame on the worker's own peers, then the
+ *     transport's fanout hook hands a reference to every other worker
+ *     through that worker's inbox: a bounded lock-free MPSC ring
+ *   - the main thread keeps stdin, the listener and the timers; new
+ *     connections go to the worker with the fewest peers
+ *
+ * Inbox producers claim a cell by CAS on the tail and publish it with a
+ * release store of the cell's sequence number (a Vyukov bounded queue cut
+ * down to one consumer). A pipe wakes a worker; a flag makes that one
+ * write per burst rather than one per frame. A full inbox drops the frame
+ * for that worker's peers and counts it, as a full peer queue would. */
+
+#define _POSIX_C_SOURCE 200809L  /* pthread_sigmask under -std=c11 */
+#include "vex.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+
+#define INBOX_SIZE 4096              /* handed-off frames per worker, power of two */
+#define INBOX_MASK (INBOX_SIZE - 1)
+
+typedef struct {
+    _Atomic size_t seq;
+    vex_pktbuf_t  *buf;
+} inbox_cell_t;
+
+typedef struct {
+    struct { int fd; char name[64]; } conn[VEX_MAX_PEERS];
+    int count;
+} adopt_list_t;
+
+typedef struct {
+    inbox_cell_t inbox[INBOX_SIZE];
+    _Alignas(64) _Atomic size_t inbox_tail;   /* next cell producers claim */
+    _Alignas(64) size_t inbox_head;           /* next cell the owner reads */
+    _Atomic int wake_pending;
+    _Atomic int running;
+    _Atomic int peers;                        /* read by producers for fanout counts */
+    _Atomic int assigned;                     /* peers plus adoptions not yet taken */
+    _Atomic uint64_t handoffs;                /* written by the owner only */
+    _Atomic uint64_t dropped;                 /* inbox full, any producer */
+
+    pthread_mutex_t adopt_lock;
+    adopt_list_t    adopt;
+
+    int             index;
+    int             wake_rd, wake_wr;
+    pthread_t       thread;
+    vex_node_t     *node;
+    vex_reactor_t   reactor;
+} worker_t;
+
+static worker_t *workers[VEX_MAX_THREADS];
+static int nworkers;
+static _Thread_local worker_t *self;
+
+/* ── Inbox ── */
+
+static int inbox_push(worker_t *w, vex_pktbuf_t *b) {
+    size_t pos = atomic_load_explicit(&w->inbox_tail, memory_order_relaxed);
+    inbox_cell_t *c;
+
+    for (;;) {
+        c = &w->inbox[pos & INBOX_MASK];
+        size_t seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&w->inbox_tail, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            return -1;                       /* full */
+        } else {
+            pos = atomic_load_explicit(&w->inbox_tail, memory_order_relaxed);
+        }
+    }
+    c->buf = b;
+    atomic_store_explicit(&c->seq, pos + 1, memory_order_release);
+    return 0;
+}
+
+static vex_pktbuf_t *inbox_pop(worker_t *w) {
+    inbox_cell_t *c = &w->inbox[w->inbox_head & INBOX_MASK];
+    size_t seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+    if (seq != w->inbox_head + 1) return NULL;
+
+    vex_pktbuf_t *b = c->buf;
+    atomic_store_explicit(&c->seq, w->inbox_head + INBOX_SIZE, memory_order_release);
+    w->inbox_head++;
+    return b;
+}
+
+static void wake(worker_t *w) {
+    if (atomic_exchange(&w->wake_pending, 1)) return;
+    uint8_t one = 1;
+    if (write(w->wake_wr, &one, 1) < 0 && errno != EAGAIN)
+        vex_log("WORKER", "Cannot wake worker %d: %s", w->index, strerror(errno));
+}
+
+/* ── Transport hooks (run on the thread that owns the peer) ── */
+
+static void on_frame(void *ctx, vex_peer_t *peer, uint8_t *frame, size_t len) {
+    worker_t *w = ctx;
+    vex_mesh_receive(w->node, frame, len, peer->fd);
+}
+
+static void on_peer(void *ctx, int fd, uint32_t events) {
+    vex_peer_t *peer = ctx;
+    (void)fd;
+
+    if (!peer->active) return;
+    if (!(events & (VEX_IO_READ | VEX_IO_WRITE)) && (events & VEX_IO_ERROR)) {
+        vex_transport_close_peer(peer);
+        return;
+    }
+    if ((events & VEX_IO_WRITE) && vex_transport_flush(peer) < 0) return;
+    if (events & VEX_IO_READ) vex_transport_read(peer, on_frame, self);
+}
+
+static void on_peer_write(void *ctx, vex_peer_t *peer, int want) {
+    (void)ctx;
+    vex_reactor_mod(&self->reactor, peer->fd, VEX_IO_READ | (want ? VEX_IO_WRITE : 0));
+}
+
+static void on_peer_change(void *ctx, vex_peer_t *peer, int up) {
+    (void)ctx;
+    if (up) {
+        atomic_fetch_add(&self->peers, 1);
+        if (vex_reactor_add(&self->reactor, peer->fd, VEX_IO_READ, on_peer, peer) != 0) {
+            vex_log("REACTOR", "Cannot watch peer %s (fd=%d), dropping it", peer->name, peer->fd);
+            vex_transport_close_peer(peer);
+        }
+        return;
+    }
+
+    vex_reactor_del(&self->reactor, peer->fd);
+    vex_log("TRANSPORT", "Peer %s disconnected (worker %d)", peer->name, self->index);
+    vex_mesh_peer_down(self->node, peer->fd);
+    self->node->peer_count--;
+    atomic_fetch_sub(&self->peers, 1);
+    atomic_fetch_sub(&self->assigned, 1);
+}
+
+/* A relay on one worker: give every other worker with peers a reference.
+ * The source is always one of from's own peers, so except_fd is moot. */
+static int fanout(void *ctx, vex_node_t *from, vex_pktbuf_t *b, int except_fd) {
+    int reached = 0;
+    (void)ctx; (void)except_fd;
+
+    for (int i = 0; i < nworkers; i++) {
+        worker_t *w = workers[i];
+        if (w->node == from) continue;
+        int peers = atomic_load_explicit(&w->peers, memory_order_relaxed);
+        if (peers == 0) continue;
+
+        vex_pool_ref(b);
+        if (inbox_push(w, b) != 0) {
+            vex_pool_put(b);
+            atomic_fetch_add_explicit(&w->dropped, 1, memory_order_relaxed);
+            continue;
+        }
+        wake(w);
+        reached += peers;
+    }
+    return reached;
+}
+
+/* ── Worker loop ── */
+
+/* Woken: take new connections, then queue every handed-off frame */
+static void on_wake(void *ctx, int fd, uint32_t events) {
+    worker_t *w = ctx;
+    uint8_t drain[64];
+    (void)events;
+
+    while (read(fd, drain, sizeof(drain)) > 0) {}
+    atomic_store(&w->wake_pending, 0);
+
+    adopt_list_t adopt;
+    pthread_mutex_lock(&w->adopt_lock);
+    adopt = w->adopt;
+    w->adopt.count = 0;
+    pthread_mutex_unlock(&w->adopt_lock);
+    for (int i = 0; i < adopt.count; i++) {
+        if (vex_transport_add_peer(w->node, adopt.conn[i].fd, adopt.conn[i].name) < 0) {
+            vex_log("TRANSPORT", "Max peers reached on worker %d, rejecting connection", w->index);
+            close(adopt.conn[i].fd);
+            atomic_fetch_sub(&w->assigned, 1);
+        }
+    }
+
+    uint64_t n = 0;
+    vex_pktbuf_t *b;
+    while ((b = inbox_pop(w)) != NULL) {
+        vex_transport_send_buf(w->node, b, -1);
+        vex_pool_put(b);
+        n++;
+    }
+    atomic_store_explicit(&w->handoffs,
+                          atomic_load_explicit(&w->handoffs, memory_order_relaxed) + n,
+                          memory_order_relaxed);
+}
+
+static void *worker_main(void *arg) {
+    worker_t *w = arg;
+
+    self = w;
+    vex_transport_set_thread(w->index + 1);
+    while (atomic_load(&w->running)) {
+        /* Wake for the first send queue coalescing holds, if any */
+        int timeout = -1;
+        uint64_t due = vex_transport_next_due(w->node);
+        if (due) {
+            uint64_t now = vex_time_ms();
+            timeout = due > now ? (int)(due - now) : 0;
+        }
+        vex_reactor_run_once(&w->reactor, timeout);
+        vex_mesh_tick(w->node);          /* QoS relays the peers have room for */
+        vex_transport_flush_all(w->node);
+    }
+
+    for (int i = 0; i < VEX_MAX_PEERS; i++) {
+        if (!w->node->peers[i].active) continue;
+        vex_transport_flush(&w->node->peers[i]);
+        vex_transport_close_peer(&w->node->peers[i]);
+    }
+    return NULL;
+}
+
+static void worker_free(worker_t *w) {
+    if (w->wake_rd >= 0) close(w->wake_rd);
+    if (w->wake_wr >= 0) close(w->wake_wr);
+    vex_reactor_close(&w->reactor);
+    pthread_mutex_destroy(&w->adopt_lock);
+    if (w->node) free(w->node->qos);
+    free(w->node);
+    free(w);
+}
+
+static worker_t *worker_new(const vex_node_t *node, int index) {
+    int pipefd[2];
+    worker_t *w = calloc(1, sizeof(*w));
+    if (!w) return NULL;
+
+    w->index = index;
+    w->wake_rd = w->wake_wr = -1;
+    pthread_mutex_init(&w->adopt_lock, NULL);
+    vex_reactor_init(&w->reactor);
+    for (size_t i = 0; i < INBOX_SIZE; i++) atomic_init(&w->inbox[i].seq, i);
+    atomic_init(&w->running, 1);
+
+    w->node = calloc(1, sizeof(*w->node));
+    if (!w->node || pipe(pipefd) != 0) {
+        worker_free(w);
+        return NULL;
+    }
+    w->wake_rd = pipefd[0];
+    w->wake_wr = pipefd[1];
+    fcntl(w->wake_rd, F_SETFL, O_NONBLOCK);
+    fcntl(w->wake_wr, F_SETFL, O_NONBLOCK);
+
+    /* Same identity, keys and shared seen cache; no peers, no listener */
+    memcpy(w->node, node, sizeof(*node));
+    memset(w->node->peers, 0, sizeof(w->node->peers));
+    w->node->peer_count = 0;
+    w->node->listen_fd = -1;
+    w->node->packets_sent = w->node->packets_received = 0;
+    w->node->packets_relayed = w->node->packets_dropped = 0;
+    w->node->qos = NULL;                 /* each worker schedules its own relays */
+    if (node->qos && vex_mesh_set_qos(w->node, node->qos->mode) != 0) {
+        worker_free(w);
+        return NULL;
+    }
+
+    if (vex_reactor_add(&w->reactor, w->wake_rd, VEX_IO_READ, on_wake, w) != 0) {
+        worker_free(w);
+        return NULL;
+    }
+    return w;
+}
+
+/* ── Public API ── */
+
+/* Start `threads` relay workers for node, which must already share a seen
+ * cache (node->seen_shared). From here on peers belong to the workers:
+ * hand new connections over with vex_workers_adopt(). Returns 0 or -1 */
+int vex_workers_start(vex_node_t *node, int threads) {
+    if (threads < 1 || threads > VEX_MAX_THREADS || !node->seen_shared) return -1;
+
+    vex_pool_set_shared(1);
+    vex_transport_set_peer_hook(on_peer_change, NULL);
+    vex_transport_set_write_hook(on_peer_write, NULL);
+
+    for (int i = 0; i < threads; i++) {
+        workers[i] = worker_new(node, i);
+        if (!workers[i]) {
+            vex_log("WORKER", "Cannot set up worker %d", i);
+            nworkers = 0;                    /* none running yet */
+            vex_workers_stop();
+            return -1;
+        }
+    }
+    nworkers = threads;
+    vex_transport_set_fanout_hook(fanout, NULL);
+
+    /* Signals stay with the main thread, whose loop they interrupt */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&workers[i]->thread, NULL, worker_main, workers[i]) != 0) {
+            vex_log("WORKER", "Cannot start worker %d", i);
+            pthread_sigmask(SIG_SETMASK, &old, NULL);
+            for (int j = i; j < threads; j++) atomic_store(&workers[j]->running, 0);
+            nworkers = i;
+            vex_workers_stop();
+            return -1;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    vex_log("WORKER", "%d relay threads, seen cache in %u shards", threads,
+            node->seen_shared->mask + 1);
+    return 0;
+}
+
+/* Stop the workers after they flush and close their peers */
+void vex_workers_stop(void) {
+    if (!workers[0]) return;
+
+    vex_transport_set_fanout_hook(NULL, NULL);
+    for (int i = 0; i < nworkers; i++) {
+        atomic_store(&workers[i]->running, 0);
+        wake(workers[i]);
+    }
+    for (int i = 0; i < nworkers; i++) {
+        pthread_join(workers[i]->thread, NULL);
+
+        /* Frames handed off after the worker's last turn */
+        vex_pktbuf_t *b;
+        while ((b = inbox_pop(workers[i])) != NULL) vex_pool_put(b);
+        for (int j = 0; j < workers[i]->adopt.count; j++) close(workers[i]->adopt.conn[j].fd);
+    }
+    for (int i = 0; i < VEX_MAX_THREADS; i++) {
+        if (workers[i]) worker_free(workers[i]);
+        workers[i] = NULL;
+    }
+    nworkers = 0;
+    vex_transport_set_peer_hook(NULL, NULL);
+    vex_transport_set_write_hook(NULL, NULL);
+}
+
+int vex_workers_count(void) {
+    return nworkers;
+}
+
+/* Worker index's node, for stats; its counters and peers are updated
+ * concurrently, so reads are a snapshot at best */
+vex_node_t *vex_workers_node(int index) {
+    return index >= 0 && index < nworkers ? workers[index]->node : NULL;
+}
+
+/* Hand a connected socket to the worker with the fewest peers */
+void vex_workers_adopt(int fd, const char *name) {
+    worker_t *w = NULL;
+    int best = 0;
+
+    for (int i = 0; i < nworkers; i++) {
+        int peers = atomic_load(&workers[i]->assigned);
+        if (!w || peers < best) {
+            w = workers[i];
+            best = peers;
+        }
+    }
+    if (!w) {
+        close(fd);
+        return;
+    }
+
+    pthread_mutex_lock(&w->adopt_lock);
+    int full = w->adopt.count == VEX_MAX_PEERS;
+    if (!full) {
+        atomic_fetch_add(&w->assigned, 1);
+        w->adopt.conn[w->adopt.count].fd = fd;
+        snprintf(w->adopt.conn[w->adopt.count].name, sizeof(w->adopt.conn[0].name), "%s", name);
+        w->adopt.count++;
+    }
+    pthread_mutex_unlock(&w->adopt_lock);
+
+    if (full) {
+        vex_log("TRANSPORT", "Too many pending connections, rejecting %s", name);
+        close(fd);
+        return;
+    }
+    wake(w);
+}
+
+/* Frames handed between workers, handoffs dropped on a full inbox, and
+ * the workers' reactor wakeups */
+void vex_workers_counters(uint64_t *handoffs, uint64_t *dropped, uint64_t *wakeups) {
+    *handoffs = *dropped = *wakeups = 0;
+    for (int i = 0; i < nworkers; i++) {
+        *handoffs += atomic_load_explicit(&workers[i]->handoffs, memory_order_relaxed);
+        *dropped += atomic_load_explicit(&workers[i]->dropped, memory_order_relaxed);
+        *wakeups += workers[i]->reactor.wakeups;
+    }
+}
@@ -0,0 +1,143 @@
+/* test_qos.c — A stuck neighbour must not stall QoS relaying
+ *
+ * A node with the relay scheduler on has three socketpair peers: a source
+ * that injects a burst of broadcast packets every BURST_GAP_NS, one peer
+ * whose far end never reads, and one that reads everything. Once the stuck
+ * peer's queue is full it must stop gating the scheduler straight away:
+ * its queue sheds by its drop policy and the live peer gets the relays.
+ * Runs for RUN_MS once per scheduler, and exits non-zero if the live peer
+ * got less than 90% of what was sent in the first EARLY_MS (while the
+ * stuck peer fills up), or lost any of the rest.
+ *
+ * Usage: vextest-qos */
+
+#define _POSIX_C_SOURCE 200809L
+#include "vex.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#define PEER_SOURCE 0
+#define PEER_STUCK  1
+#define PEER_LIVE   2
+#define BURST       16
+#define BURST_GAP_NS 2000000L
+#define RUN_MS      1000
+#define EARLY_MS    250
+
+static vex_node_t node;
+static int far_fd[3];
+
+static void on_frame(void *ctx, vex_peer_t *peer, uint8_t *frame, size_t len) {
+    (void)ctx;
+    vex_mesh_receive(&node, frame, len, peer->fd);
+}
+
+/* Frames the live peer's far end has read so far */
+static uint64_t drain_live(uint8_t *buf, size_t *have) {
+    uint64_t frames = 0;
+    ssize_t n;
+    while ((n = read(far_fd[PEER_LIVE], buf + *have, 65536 - *have)) > 0) {
+        size_t off = 0;
+        *have += (size_t)n;
+        while (*have - off >= 2) {
+            size_t flen = (size_t)buf[off] << 8 | buf[off + 1];
+            if (*have - off < 2 + flen) break;
+            frames++;
+            off += 2 + flen;
+        }
+        memmove(buf, buf + off, *have - off);
+        *have -= off;
+    }
+    return frames;
+}
+
+static int run(int mode) {
+    static uint8_t rx[65536];
+    uint8_t frames[BURST * (2 + VEX_MAX_PACKET)];
+    size_t pkt_len = VEX_HEADER_SIZE + 64, frame_len = 2 + pkt_len, have = 0;
+    uint64_t rng = 0x9e3779b97f4a7c15ULL, sent = 0, got = 0, sent_early = 0, got_early = 0;
+
+    memset(&node, 0, sizeof(node));
+    vex_seen_init(&node.seen);
+    node.relay_enabled = 1;
+    if (vex_mesh_set_qos(&node, mode) != 0) return -1;
+
+    for (int i = 0; i < 3; i++) {
+        int sv[2], small = 4096;
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return -1;
+        if (i == PEER_STUCK) {
+            setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &small, sizeof(small));
+            setsockopt(sv[1], SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+        }
+        vex_transport_add_peer(&node, sv[0], "test");
+        far_fd[i] = sv[1];
+        fcntl(sv[1], F_SETFL, O_NONBLOCK);
+    }
+
+    struct timespec gap = { 0, BURST_GAP_NS };
+    uint64_t start = vex_time_ms();
+    for (;;) {
+        uint64_t elapsed = vex_time_ms() - start;
+        if (elapsed >= RUN_MS) break;
+        for (int b = 0; b < BURST; b++) {
+            uint8_t *f = frames + (size_t)b * frame_len;
+            f[0] = (uint8_t)(pkt_len >> 8);
+            f[1] = (uint8_t)pkt_len;
+            f[2] = VEX_VERSION;
+            for (size_t i = 1; i < pkt_len; i++) {
+                rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+                f[2 + i] = (uint8_t)(rng >> 56);
+            }
+            f[2 + VEX_TTL_OFFSET] = VEX_DEFAULT_TTL;
+            f[2 + VEX_HEADER_SIZE - 1] = VEX_FLAG_BROADCAST;
+        }
+        if (write(far_fd[PEER_SOURCE], frames, BURST * frame_len) < 0) break;
+        sent += BURST;
+
+        vex_transport_read(&node.peers[PEER_SOURCE], on_frame, NULL);
+        vex_mesh_tick(&node);
+        vex_transport_flush_all(&node);
+        uint64_t n = drain_live(rx, &have);
+        got += n;
+        if (elapsed < EARLY_MS) {
+            sent_early += BURST;
+            got_early += n;
+        }
+        nanosleep(&gap, NULL);
+    }
+    for (int i = 0; i < 8; i++) {           /* let the queues empty */
+        vex_mesh_tick(&node);
+        vex_transport_flush_all(&node);
+        got += drain_live(rx, &have);
+    }
+
+    const vex_peer_t *stuck = &node.peers[PEER_STUCK];
+    int ok = sent_early > 0 && got_early * 10 >= sent_early * 9 && got == sent &&
+             stuck->tx_dropped > 0;
+    printf("%s qos %s: live peer got %llu of %llu relays (%llu of %llu in the first %d ms), "
+           "stuck peer shed %llu\n", ok ? "PASS" : "FAIL", vex_mesh_qos_name(mode),
+           (unsigned long long)got, (unsigned long long)sent, (unsigned long long)got_early,
+           (unsigned long long)sent_early, EARLY_MS, (unsigned long long)stuck->tx_dropped);
+
+    for (int i = 0; i < 3; i++) {
+        vex_transport_close_peer(&node.peers[i]);
+        close(far_fd[i]);
+    }
+    vex_mesh_set_qos(&node, VEX_QOS_OFF);
+    return ok ? 0 : -1;
+}
+
+int main(void) {
+    int failed = 0;
+
+    /* Per-packet relay logs are noise here */
+    if (!freopen("/dev/null", "w", stderr)) return 1;
+
+    vex_transport_set_batching(1);
+    if (run(VEX_QOS_STRICT) != 0) failed++;
+    if (run(VEX_QOS_WEIGHTED) != 0) failed++;
+    return failed ? 1 : 0;
+}
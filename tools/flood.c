@@ -0,0 +1,654 @@
+/* flood.c — vexconnect-flood: load generator and relay meter for live nodes
+ *
+ * Connects to one or more nodes' --listen sockets as ordinary stream peers
+ * (--conns connections each), injects sealed, validly framed broadcast
+ * packets at a set rate, and reads the relayed copies back on the same
+ * connections. Each packet ID is a per-run tag plus a sequence number, so
+ * a copy maps straight back to its send time:
+ *   delivered  unique packets that came back on any connection
+ *   latency    first copy's arrival minus its send, p50/p99/p999
+ *   loss       unique packets that never came back before the drain ended
+ * With --dup R, each unique packet is followed with probability R by a
+ * resend of a recent one on another connection; a node that dedups
+ * correctly never relays those, so they cost it a lookup only.
+ *
+ * With --message N, the unit is instead a broadcast message of N bytes
+ * sent as fragments, each a packet of its own as above, and the report
+ * adds whole messages: how many had every fragment come back, the last
+ * fragment's arrival minus the first one's send, and the goodput in
+ * message bytes. Every node on the way reassembles them too.
+ *
+ * Packets carry --priority (normal by default). With --urgent R, each unit
+ * is instead urgent with probability R, and the report splits delivery
+ * and latency between the urgent packets and the rest, to see what a
+ * node's --qos scheduler buys them under load.
+ *
+ * A node started with --coalesce packs copies into multi-packet frames;
+ * they are split here, and the report counts the frames that carried them.
+ *
+ * Packets go out round-robin over the connections. At a fixed --rate, a
+ * packet whose connection has a full send buffer is counted as not sent,
+ * so a node that stops reading shows up instead of stalling the clock;
+ * with --rate 0 the tool sends whenever the node is reading.
+ *
+ * Usage: vexconnect-flood --target PATH [--target PATH ...] [--conns N]
+ *          [--rate PPS] [--duration S] [--size N|MIN-MAX] [--ttl N]
+ *          [--message N] [--priority C] [--urgent RATIO] [--dup RATIO]
+ *          [--drain MS] [--json] */
+
+#define _POSIX_C_SOURCE 200809L
+#include "vex.h"
+#include "tweetnacl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#define FLOOD_MAX_CONNS  256
+#define FLOOD_BUF        65536       /* per-connection receive and send buffers */
+#define FLOOD_RECENT     256         /* packets kept for --dup resends */
+#define FLOOD_BURST      1024        /* most packets sent per loop turn */
+#define FLOOD_MAX_MESSAGE (FLOOD_BUF / (2 + VEX_MAX_PACKET) * VEX_FRAG_DATA)  /* fits a send buffer */
+
+typedef struct {
+    int      fd;
+    int      open;
+    int      want_write;
+    uint8_t  rx[FLOOD_BUF];
+    size_t   rx_len;
+    uint8_t  tx[FLOOD_BUF];
+    size_t   tx_len;
+} flood_conn_t;
+
+typedef struct {
+    uint32_t seq;
+    uint16_t len;
+    uint8_t  wire[2 + VEX_MAX_PACKET];
+} flood_recent_t;
+
+static vex_node_t node;              /* only the mesh key is used */
+static vex_reactor_t reactor;
+static flood_conn_t *conns[FLOOD_MAX_CONNS];
+static int nconns;
+static uint8_t run_tag[4];
+static uint64_t rng_state;
+
+/* Per sequence number: send time, copies seen, and the first-copy latencies */
+static uint64_t *sent_ns;
+static uint8_t *copies;
+static uint64_t *latency_ns;
+static uint32_t nsent, ndelivered, cap;
+
+static flood_recent_t recent[FLOOD_RECENT];
+static uint32_t nrecent;
+
+/* --message: fragments per message, and per message the fragments back
+ * and the whole-message latencies */
+static size_t msg_bytes;
+static uint32_t msg_frags = 1;
+static uint8_t *msg_have;
+static uint64_t *msg_latency_ns;
+static uint32_t nmsgs, nmsgs_whole;
+static uint64_t first_send_ns, last_whole_ns;
+
+/* --urgent: which packets were urgent, and first-copy latencies by class */
+static int priority = VEX_PRIO_NORMAL;
+static double urgent_share;
+static uint8_t *is_urgent;
+static uint64_t *urgent_latency_ns, *other_latency_ns;
+static uint32_t nurgent, nurgent_delivered, nother_delivered;
+
+static uint64_t dups_sent, not_sent, total_copies, foreign, closed;
+static uint64_t frames_in, coalesced_in;
+static volatile sig_atomic_t interrupted;
+
+static void on_signal(int sig) {
+    (void)sig;
+    interrupted = 1;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* splitmix64, seeded from the run tag */
+static uint64_t rng_next(void) {
+    uint64_t z = (rng_state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static double rng_unit(void) {
+    return (double)(rng_next() >> 11) / 9007199254740992.0;
+}
+
+static int grow(void) {
+    uint32_t n = cap ? cap * 2 : 65536;
+    uint64_t *s = realloc(sent_ns, n * sizeof(*s));
+    if (s) sent_ns = s;
+    uint8_t *c = realloc(copies, n * sizeof(*c));
+    if (c) copies = c;
+    uint64_t *l = realloc(latency_ns, n * sizeof(*l));
+    if (l) latency_ns = l;
+    uint8_t *h = realloc(msg_have, n * sizeof(*h));
+    if (h) msg_have = h;
+    uint64_t *m = realloc(msg_latency_ns, n * sizeof(*m));
+    if (m) msg_latency_ns = m;
+    uint8_t *u = realloc(is_urgent, n * sizeof(*u));
+    if (u) is_urgent = u;
+    uint64_t *ul = realloc(urgent_latency_ns, n * sizeof(*ul));
+    if (ul) urgent_latency_ns = ul;
+    uint64_t *ol = realloc(other_latency_ns, n * sizeof(*ol));
+    if (ol) other_latency_ns = ol;
+    if (!s || !c || !l || !h || !m || !u || !ul || !ol) return -1;
+    memset(copies + cap, 0, n - cap);
+    memset(msg_have + cap, 0, n - cap);
+    cap = n;
+    return 0;
+}
+
+/* ── Connections ── */
+
+static void conn_close(flood_conn_t *c) {
+    if (!c->open) return;
+    vex_reactor_del(&reactor, c->fd);
+    close(c->fd);
+    c->open = 0;
+    closed++;
+}
+
+/* Write out the send backlog; watch for writability while some remains */
+static void conn_flush(flood_conn_t *c) {
+    while (c->tx_len > 0) {
+        ssize_t n = send(c->fd, c->tx, c->tx_len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) conn_close(c);
+            break;
+        }
+        memmove(c->tx, c->tx + n, c->tx_len - (size_t)n);
+        c->tx_len -= (size_t)n;
+    }
+
+    int want = c->open && c->tx_len > 0;
+    if (c->open && want != c->want_write) {
+        c->want_write = want;
+        vex_reactor_mod(&reactor, c->fd, VEX_IO_READ | (want ? VEX_IO_WRITE : 0));
+    }
+}
+
+/* A relayed frame: match it to its send by the ID's tag and sequence */
+static void on_copy(const uint8_t *pkt, size_t len, uint64_t now) {
+    if (len < VEX_HEADER_SIZE || memcmp(pkt + 1, run_tag, 4) != 0) {
+        foreign++;
+        return;
+    }
+    uint32_t seq = (uint32_t)pkt[5] << 24 | (uint32_t)pkt[6] << 16 |
+                   (uint32_t)pkt[7] << 8 | pkt[8];
+    if (seq >= nsent) {
+        foreign++;
+        return;
+    }
+
+    total_copies++;
+    if (copies[seq] == 0) {
+        latency_ns[ndelivered++] = now - sent_ns[seq];
+        if (is_urgent[seq]) urgent_latency_ns[nurgent_delivered++] = now - sent_ns[seq];
+        else other_latency_ns[nother_delivered++] = now - sent_ns[seq];
+        uint32_t m = seq / msg_frags;
+        if (msg_bytes && ++msg_have[m] == msg_frags) {
+            msg_latency_ns[nmsgs_whole++] = now - sent_ns[m * msg_frags];
+            last_whole_ns = now;
+        }
+    }
+    if (copies[seq] < UINT8_MAX) copies[seq]++;
+}
+
+/* A frame from the node: one packet, or several coalesced */
+static void on_frame(const uint8_t *frame, size_t len, uint64_t now) {
+    frames_in++;
+    if (len == 0 || frame[0] != VEX_COALESCED) {
+        on_copy(frame, len, now);
+        return;
+    }
+
+    coalesced_in++;
+    for (size_t off = 1; off + 2 <= len;) {
+        size_t plen = (size_t)frame[off] << 8 | frame[off + 1];
+        if (plen == 0 || off + 2 + plen > len) {
+            foreign++;
+            break;
+        }
+        on_copy(frame + off + 2, plen, now);
+        off += 2 + plen;
+    }
+}
+
+static void on_conn(void *ctx, int fd, uint32_t events) {
+    flood_conn_t *c = ctx;
+    (void)fd;
+
+    if (events & VEX_IO_WRITE) conn_flush(c);
+    if (!c->open || !(events & (VEX_IO_READ | VEX_IO_ERROR))) return;
+
+    uint64_t now = now_ns();
+    for (;;) {
+        ssize_t n = recv(c->fd, c->rx + c->rx_len, sizeof(c->rx) - c->rx_len, MSG_DONTWAIT);
+        if (n <= 0) {
+            if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+                conn_close(c);
+            break;
+        }
+        c->rx_len += (size_t)n;
+
+        size_t off = 0;
+        while (c->rx_len - off >= 2) {
+            size_t flen = (size_t)c->rx[off] << 8 | c->rx[off + 1];
+            if (flen > VEX_MAX_PACKET) {
+                fprintf(stderr, "Bad frame length %zu from the node, closing\n", flen);
+                conn_close(c);
+                return;
+            }
+            if (c->rx_len - off < 2 + flen) break;
+            on_frame(c->rx + off + 2, flen, now);
+            off += 2 + flen;
+        }
+        memmove(c->rx, c->rx + off, c->rx_len - off);
+        c->rx_len -= off;
+    }
+}
+
+/* ── Packets ── */
+
+/* A sealed broadcast packet of `size` wire bytes, framed, into out. With
+ * --message it is fragment seq % msg_frags of message seq / msg_frags,
+ * and its size follows from the message's */
+static uint16_t make_packet(uint8_t *out, uint32_t seq, size_t size, uint8_t ttl, int prio) {
+    uint8_t *wire = out + 2;
+    uint8_t *msg = wire + VEX_MSG_OFFSET;
+    uint8_t flags = VEX_FLAG_ENCRYPTED | VEX_FLAG_BROADCAST |
+                    (uint8_t)(prio << VEX_FLAG_PRIO_SHIFT);
+    uint16_t msg_len = (uint16_t)(size - VEX_MSG_OFFSET);
+    uint16_t payload_len;
+
+    if (msg_bytes) {
+        uint32_t m = seq / msg_frags, index = seq % msg_frags;
+        size_t left = msg_bytes - (size_t)index * VEX_FRAG_DATA;
+        uint8_t msg_id[8];
+        memcpy(msg_id, run_tag, 4);
+        msg_id[4] = (uint8_t)(m >> 24);
+        msg_id[5] = (uint8_t)(m >> 16);
+        msg_id[6] = (uint8_t)(m >> 8);
+        msg_id[7] = (uint8_t)m;
+        vex_frag_header(msg, msg_id, (uint8_t)index, (uint8_t)msg_frags);
+        msg += VEX_FRAG_HDR;
+        msg_len = (uint16_t)(left < VEX_FRAG_DATA ? left : VEX_FRAG_DATA);
+        flags |= VEX_FLAG_FRAGMENT;
+    }
+
+    int n = snprintf((char *)msg, msg_len + 1u, "flood %u ", seq);
+    if (n < msg_len) memset(msg + n, 'x', (size_t)(msg_len - n));
+    if (msg_bytes) msg_len += VEX_FRAG_HDR;
+    if (vex_crypto_seal_inplace(&node, wire + VEX_HEADER_SIZE, msg_len, &payload_len) != 0)
+        return 0;
+
+    vex_packet_view_t pkt;
+    pkt.version = VEX_VERSION;
+    memcpy(pkt.packet_id, run_tag, 4);
+    pkt.packet_id[4] = (uint8_t)(seq >> 24);
+    pkt.packet_id[5] = (uint8_t)(seq >> 16);
+    pkt.packet_id[6] = (uint8_t)(seq >> 8);
+    pkt.packet_id[7] = (uint8_t)seq;
+    pkt.ttl = ttl;
+    pkt.flags = flags;
+    pkt.payload = wire + VEX_HEADER_SIZE;
+    pkt.payload_len = payload_len;
+
+    int len = vex_packet_encode_header(&pkt, wire, VEX_MAX_PACKET);
+    if (len < 0) return 0;
+    out[0] = (uint8_t)(len >> 8);
+    out[1] = (uint8_t)len;
+    return (uint16_t)(2 + len);
+}
+
+/* Queue a framed packet on connection i. Returns 0, or -1 if its send
+ * buffer is full or it is closed */
+static int conn_send(int i, const uint8_t *frame, size_t len) {
+    flood_conn_t *c = conns[i];
+    if (!c->open || c->tx_len + len > sizeof(c->tx)) return -1;
+
+    memcpy(c->tx + c->tx_len, frame, len);
+    c->tx_len += len;
+    return 0;
+}
+
+/* Send the next unique packet, or every fragment of the next message on
+ * one connection, and with probability dup an earlier packet again.
+ * Returns 0, or -1 if the unit could not be queued */
+static int send_one(size_t size_min, size_t size_max, uint8_t ttl, double dup) {
+    if (dup > 0 && nrecent > 0 && rng_unit() < dup) {
+        flood_recent_t *r = &recent[rng_next() % (nrecent < FLOOD_RECENT ? nrecent : FLOOD_RECENT)];
+        int i = (int)((r->seq + 1) % (uint32_t)nconns);   /* not the original's connection */
+        if (conn_send(i, r->wire, r->len) == 0) dups_sent++;
+    }
+
+    while (nsent + msg_frags > cap)
+        if (grow() != 0) return -1;
+    int i = (int)(nsent / msg_frags % (uint32_t)nconns);
+    if (!conns[i]->open || conns[i]->tx_len + msg_frags * (2 + size_max) > sizeof(conns[i]->tx))
+        return -1;
+
+    size_t size = size_min + (size_max > size_min ? rng_next() % (size_max - size_min + 1) : 0);
+    int urgent = urgent_share > 0 && rng_unit() < urgent_share;
+    for (uint32_t k = 0; k < msg_frags; k++) {
+        flood_recent_t *r = &recent[nrecent % FLOOD_RECENT];
+        r->len = make_packet(r->wire, nsent, size, ttl, urgent ? VEX_PRIO_URGENT : priority);
+        if (r->len == 0 || conn_send(i, r->wire, r->len) != 0) return -1;
+
+        is_urgent[nsent] = (uint8_t)urgent;
+        nurgent += (uint32_t)urgent;
+        r->seq = nsent;
+        nrecent++;
+        sent_ns[nsent++] = now_ns();
+    }
+    if (first_send_ns == 0) first_send_ns = sent_ns[0];
+    if (msg_bytes) nmsgs++;
+    return 0;
+}
+
+static int connect_target(const char *path) {
+    int fd = vex_transport_unix_dial(path);
+    if (fd < 0) return -1;
+    if (nconns == FLOOD_MAX_CONNS) {
+        close(fd);
+        return -1;
+    }
+
+    flood_conn_t *c = calloc(1, sizeof(*c));
+    if (!c) {
+        close(fd);
+        return -1;
+    }
+    c->fd = fd;
+    c->open = 1;
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    if (vex_reactor_add(&reactor, fd, VEX_IO_READ, on_conn, c) != 0) {
+        close(fd);
+        free(c);
+        return -1;
+    }
+    conns[nconns++] = c;
+    return 0;
+}
+
+/* ── Report ── */
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double pct_us(const uint64_t *sorted, uint32_t n, double p) {
+    if (n == 0) return 0.0;
+    size_t i = (size_t)(p * (double)(n - 1) + 0.5);
+    return (double)sorted[i] / 1000.0;
+}
+
+static void report(double send_s, int json) {
+    qsort(latency_ns, ndelivered, sizeof(*latency_ns), cmp_u64);
+    qsort(msg_latency_ns, nmsgs_whole, sizeof(*msg_latency_ns), cmp_u64);
+    qsort(urgent_latency_ns, nurgent_delivered, sizeof(*urgent_latency_ns), cmp_u64);
+    qsort(other_latency_ns, nother_delivered, sizeof(*other_latency_ns), cmp_u64);
+    uint32_t nother = nsent - nurgent;
+    double whole_s = last_whole_ns > first_send_ns ? (double)(last_whole_ns - first_send_ns) / 1e9 : 0;
+    double goodput = whole_s > 0 ? (double)nmsgs_whole * (double)msg_bytes / whole_s : 0.0;
+    double loss = nsent ? 100.0 * (double)(nsent - ndelivered) / (double)nsent : 0.0;
+    double offered = send_s > 0 ? (double)nsent / send_s : 0.0;
+    double rate = send_s > 0 ? (double)ndelivered / send_s : 0.0;
+    double max_us = ndelivered ? (double)latency_ns[ndelivered - 1] / 1000.0 : 0.0;
+
+    if (json) {
+        printf("{\"sent\":%u,\"dups\":%llu,\"not_sent\":%llu,\"seconds\":%.3f,"
+               "\"offered_pps\":%.0f,\"delivered\":%u,\"delivered_pps\":%.0f,"
+               "\"loss_pct\":%.4f,\"copies\":%llu,\"p50_us\":%.1f,\"p99_us\":%.1f,"
+               "\"p999_us\":%.1f,\"max_us\":%.1f,\"conns\":%d,\"closed\":%llu",
+               nsent, (unsigned long long)dups_sent, (unsigned long long)not_sent, send_s,
+               offered, ndelivered, rate, loss, (unsigned long long)total_copies,
+               pct_us(latency_ns, ndelivered, 0.50), pct_us(latency_ns, ndelivered, 0.99),
+               pct_us(latency_ns, ndelivered, 0.999), max_us, nconns,
+               (unsigned long long)closed);
+        if (msg_bytes)
+            printf(",\"message_bytes\":%zu,\"fragments\":%u,\"messages\":%u,"
+                   "\"messages_whole\":%u,\"goodput_Bps\":%.0f,\"msg_p50_us\":%.1f,"
+                   "\"msg_p99_us\":%.1f", msg_bytes, msg_frags, nmsgs, nmsgs_whole, goodput,
+                   pct_us(msg_latency_ns, nmsgs_whole, 0.50),
+                   pct_us(msg_latency_ns, nmsgs_whole, 0.99));
+        if (coalesced_in)
+            printf(",\"frames_in\":%llu,\"coalesced_in\":%llu", (unsigned long long)frames_in,
+                   (unsigned long long)coalesced_in);
+        if (urgent_share > 0)
+            printf(",\"urgent_sent\":%u,\"urgent_delivered\":%u,\"urgent_p50_us\":%.1f,"
+                   "\"urgent_p99_us\":%.1f,\"other_sent\":%u,\"other_delivered\":%u,"
+                   "\"other_p50_us\":%.1f,\"other_p99_us\":%.1f", nurgent, nurgent_delivered,
+                   pct_us(urgent_latency_ns, nurgent_delivered, 0.50),
+                   pct_us(urgent_latency_ns, nurgent_delivered, 0.99), nother, nother_delivered,
+                   pct_us(other_latency_ns, nother_delivered, 0.50),
+                   pct_us(other_latency_ns, nother_delivered, 0.99));
+        printf("}\n");
+        return;
+    }
+
+    printf("[FLOOD] Sent: %u unique + %llu dups in %.2fs (%.0f/s offered) | Not sent: %llu\n",
+           nsent, (unsigned long long)dups_sent, send_s, offered,
+           (unsigned long long)not_sent);
+    printf("[FLOOD] Delivered: %u (%.0f/s) | Loss: %.3f%% | Copies: %llu over %d conns\n",
+           ndelivered, rate, loss, (unsigned long long)total_copies, nconns);
+    printf("[FLOOD] Latency: p50 %.1fus | p99 %.1fus | p999 %.1fus | max %.1fus\n",
+           pct_us(latency_ns, ndelivered, 0.50), pct_us(latency_ns, ndelivered, 0.99),
+           pct_us(latency_ns, ndelivered, 0.999), max_us);
+    if (coalesced_in)
+        printf("[FLOOD] Frames in: %llu for %llu copies (%llu coalesced)\n",
+               (unsigned long long)frames_in, (unsigned long long)total_copies,
+               (unsigned long long)coalesced_in);
+    if (msg_bytes) {
+        printf("[FLOOD] Messages: %u of %u whole (%zu bytes in %u fragments) | "
+               "Goodput: %.1f KB/s\n", nmsgs_whole, nmsgs, msg_bytes, msg_frags,
+               goodput / 1024.0);
+        printf("[FLOOD] Message latency: p50 %.1fus | p99 %.1fus\n",
+               pct_us(msg_latency_ns, nmsgs_whole, 0.50),
+               pct_us(msg_latency_ns, nmsgs_whole, 0.99));
+    }
+    if (urgent_share > 0) {
+        printf("[FLOOD] Urgent: %u of %u delivered (%.3f%% loss) | p50 %.1fus | p99 %.1fus\n",
+               nurgent_delivered, nurgent,
+               nurgent ? 100.0 * (double)(nurgent - nurgent_delivered) / (double)nurgent : 0.0,
+               pct_us(urgent_latency_ns, nurgent_delivered, 0.50),
+               pct_us(urgent_latency_ns, nurgent_delivered, 0.99));
+        printf("[FLOOD] %-6s: %u of %u delivered (%.3f%% loss) | p50 %.1fus | p99 %.1fus\n",
+               vex_mesh_priority_name(priority), nother_delivered, nother,
+               nother ? 100.0 * (double)(nother - nother_delivered) / (double)nother : 0.0,
+               pct_us(other_latency_ns, nother_delivered, 0.50),
+               pct_us(other_latency_ns, nother_delivered, 0.99));
+    }
+    if (foreign || closed)
+        printf("[FLOOD] Other traffic: %llu frames | Connections closed by node: %llu\n",
+               (unsigned long long)foreign, (unsigned long long)closed);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s --target PATH [options]\n\n"
+            "  --target PATH    Node --listen socket to connect to (repeatable)\n"
+            "  --conns N        Connections per target (default: 2)\n"
+            "  --rate PPS       Unique packets per second, 0 = as fast as the node reads\n"
+            "                   (default: 1000)\n"
+            "  --duration S     Seconds to send for (default: 10)\n"
+            "  --size N|MIN-MAX Wire size in bytes, fixed or uniform (default: 128, %d-%d)\n"
+            "  --ttl N          TTL of injected packets (default: %d)\n"
+            "  --message N      Send N-byte messages as fragments instead; --rate counts\n"
+            "                   messages (at most %d bytes)\n"
+            "  --priority C     Priority of sent packets: urgent, high, normal (default)\n"
+            "                   or bulk\n"
+            "  --urgent RATIO   Share of units sent urgent instead, reported apart\n"
+            "                   (default: 0)\n"
+            "  --dup RATIO      Chance each packet is followed by a resent earlier one\n"
+            "                   (default: 0)\n"
+            "  --drain MS       Wait for copies after the last send (default: 1000)\n"
+            "  --json           One JSON line instead of the text report\n",
+            prog, VEX_MSG_OFFSET + 1, VEX_MAX_PACKET, VEX_DEFAULT_TTL, FLOOD_MAX_MESSAGE);
+}
+
+int main(int argc, char **argv) {
+    const char *targets[FLOOD_MAX_CONNS];
+    int ntargets = 0, per_target = 2, ttl = VEX_DEFAULT_TTL, json = 0;
+    double rate = 1000, duration = 10, dup = 0;
+    long drain_ms = 1000;
+    size_t size_min = 128, size_max = 128;
+
+    static struct option long_opts[] = {
+        {"target",   required_argument, 0, 'T'},
+        {"conns",    required_argument, 0, 'c'},
+        {"rate",     required_argument, 0, 'r'},
+        {"duration", required_argument, 0, 'd'},
+        {"size",     required_argument, 0, 's'},
+        {"ttl",      required_argument, 0, 't'},
+        {"message",  required_argument, 0, 'm'},
+        {"priority", required_argument, 0, 'p'},
+        {"urgent",   required_argument, 0, 'u'},
+        {"dup",      required_argument, 0, 'D'},
+        {"drain",    required_argument, 0, 'w'},
+        {"json",     no_argument,       0, 'j'},
+        {"help",     no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "T:c:r:d:s:t:m:p:u:D:w:jh", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'T':
+                if (ntargets < FLOOD_MAX_CONNS) targets[ntargets++] = optarg;
+                break;
+            case 'c': per_target = atoi(optarg); break;
+            case 'r': rate = atof(optarg); break;
+            case 'd': duration = atof(optarg); break;
+            case 's': {
+                char *dash = strchr(optarg, '-');
+                size_min = (size_t)atol(optarg);
+                size_max = dash ? (size_t)atol(dash + 1) : size_min;
+                break;
+            }
+            case 't': ttl = atoi(optarg); break;
+            case 'm': msg_bytes = (size_t)atol(optarg); break;
+            case 'p':
+                if ((priority = vex_mesh_priority(optarg)) < 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'u': urgent_share = atof(optarg); break;
+            case 'D': dup = atof(optarg); break;
+            case 'w': drain_ms = atol(optarg); break;
+            case 'j': json = 1; break;
+            case 'h':
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (ntargets == 0 || per_target < 1 || rate < 0 || duration <= 0 || drain_ms < 0 ||
+        ttl < 1 || ttl > 255 || dup < 0 || dup >= 1 ||
+        size_min < VEX_MSG_OFFSET + 1 || size_max < size_min || size_max > VEX_MAX_PACKET ||
+        msg_bytes > FLOOD_MAX_MESSAGE || urgent_share < 0 || urgent_share > 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (msg_bytes > 0) {
+        /* Fragments are sized by the message; leave room for full ones */
+        msg_frags = (uint32_t)((msg_bytes + VEX_FRAG_DATA - 1) / VEX_FRAG_DATA);
+        size_min = size_max = VEX_MAX_PACKET;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    vex_crypto_derive_mesh_key(&node);
+    randombytes(run_tag, sizeof(run_tag));
+    memcpy(&rng_state, run_tag, sizeof(run_tag));
+    vex_reactor_init(&reactor);
+
+    for (int t = 0; t < ntargets; t++) {
+        for (int k = 0; k < per_target; k++) {
+            if (connect_target(targets[t]) != 0) {
+                fprintf(stderr, "Cannot connect to %s\n", targets[t]);
+                return 1;
+            }
+        }
+    }
+    if (nconns < 2)
+        fprintf(stderr, "Only one connection: copies come back only through other peers\n");
+    struct timespec settle = { 0, 200000000 };
+    nanosleep(&settle, NULL);  /* let the node register every connection */
+
+    int fixed_rate = rate > 0;
+    uint64_t start = now_ns();
+    uint64_t end = start + (uint64_t)(duration * 1e9);
+    uint64_t issued = 0, now = start;
+
+    while (!interrupted && (now = now_ns()) < end) {
+        uint64_t due = fixed_rate ? (uint64_t)((double)(now - start) * rate / 1e9) : issued + 64;
+        int timeout = 0;
+
+        for (int n = 0; issued < due && n < FLOOD_BURST; n++) {
+            if (send_one(size_min, size_max, (uint8_t)ttl, dup) != 0) {
+                if (!fixed_rate) {
+                    timeout = 1;        /* wait for the node to read */
+                    break;
+                }
+                not_sent++;
+            }
+            issued++;
+        }
+        for (int i = 0; i < nconns; i++) conn_flush(conns[i]);
+
+        if (fixed_rate && issued >= due) {
+            /* Sleep until the next packet is due, at millisecond grain */
+            uint64_t next = start + (uint64_t)((double)(issued + 1) * 1e9 / rate);
+            timeout = next > now ? (int)((next - now) / 1000000) : 0;
+        }
+        vex_reactor_run_once(&reactor, timeout);
+    }
+    double send_s = (double)(now - start) / 1e9;
+
+    /* Drain: copies still in flight */
+    uint64_t drain_end = now_ns() + (uint64_t)drain_ms * 1000000ULL;
+    while (!interrupted && (now = now_ns()) < drain_end && ndelivered < nsent) {
+        for (int i = 0; i < nconns; i++) conn_flush(conns[i]);
+        vex_reactor_run_once(&reactor, (int)((drain_end - now) / 1000000) + 1);
+    }
+
+    report(send_s, json);
+
+    for (int i = 0; i < nconns; i++) {
+        conn_close(conns[i]);
+        free(conns[i]);
+    }
+    vex_reactor_close(&reactor);
+    free(sent_ns);
+    free(copies);
+    free(latency_ns);
+    free(msg_have);
+    free(msg_latency_ns);
+    free(is_urgent);
+    free(urgent_latency_ns);
+    free(other_latency_ns);
+    return 0;
+}
@@ -0,0 +1,806 @@
+/* sim.c — vexconnect-sim: discrete-event mesh simulator
+ *
+ * Runs thousands of vex_node_t in one process and floods packets through
+ * them with the node's own code: vex_mesh_send at the origin and
+ * vex_mesh_receive (dedup, decrypt, relay) at every hop. Nodes have no
+ * socket peers; the transport's fanout hook hands each relay to a
+ * simulated link layer instead, which schedules deliveries on a virtual
+ * clock. A node's "source fd" is the index of the neighbour it heard the
+ * packet from.
+ *
+ * Link models (--link):
+ *   radio  one broadcast per relay, heard by every neighbour, the source
+ *          included; the sender's airtime is serialised at --bandwidth
+ *   wire   one frame per neighbour except the source, each directed link
+ *          serialised at its own bandwidth
+ * Each delivery adds the link's latency plus up to --jitter, and is lost
+ * with the link's loss probability.
+ *
+ * Topology: a random geometric graph in the unit square (--nodes, sized
+ * by --degree or --radius), or an edge list (--topology FILE) with lines
+ *   a b [latency_ms [loss [kbps]]]
+ * where omitted fields take the command-line values and '#' starts a
+ * comment.
+ *
+ * Every node runs one relay policy (--relay-policy, as for vexconnect);
+ * held relays wake their node through timer events on the same clock.
+ *
+ * Reported: per-packet coverage of the other nodes (and of those in the
+ * origin's connected component), transmissions and redundant receptions
+ * per delivery, and simulation events per second of wall time. The seen
+ * caches expire by wall clock, so runs are meant to be shorter than
+ * VEX_SEEN_TTL_SEC.
+ *
+ * Usage: vexconnect-sim [--nodes N] [--degree D | --radius R] [--topology FILE]
+ *          [--link radio|wire] [--latency MS] [--jitter MS] [--loss P]
+ *          [--bandwidth KBPS] [--ttl N] [--packets P] [--interval MS]
+ *          [--relay-policy flood|counter|gossip] [--relay-delay MS]
+ *          [--relay-count N] [--gossip-prob P] [--seed S] [--per-packet]
+ *          [--json] [--verbose] */
+
+#define _POSIX_C_SOURCE 200809L
+#include "vex.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+
+#define EV_INJECT  0
+#define EV_DELIVER 1
+#define EV_TIMER   2                 /* a held relay comes due */
+
+/* One transmission's bytes, shared by every delivery it schedules */
+typedef struct {
+    uint32_t refs;
+    uint32_t pkt;
+    uint16_t len;
+    uint8_t  data[];
+} sim_tx_t;
+
+typedef struct {
+    uint64_t  t;
+    uint64_t  seq;                   /* FIFO among equal times */
+    int32_t   kind;
+    int32_t   dst;
+    int32_t   src;
+    sim_tx_t *tx;
+} sim_event_t;
+
+/* A directed link */
+typedef struct {
+    uint64_t busy_until;
+    uint32_t latency_ns;
+    uint32_t bytes_per_s;            /* 0 = unlimited */
+    float    loss;
+} sim_link_t;
+
+typedef struct {
+    uint32_t origin;
+    uint32_t reached;                /* other nodes that accepted it */
+    uint32_t reachable;              /* other nodes in the origin's component */
+    uint32_t max_hops;
+    uint64_t tx;
+    uint64_t rx;
+    uint64_t injected_ns;
+    uint64_t settle_ns;              /* last new delivery, after injection */
+} sim_pkt_t;
+
+typedef struct {
+    const char *name;
+    /* Send tx from node `from` to its neighbours; returns receivers */
+    int (*transmit)(uint32_t from, int except, sim_tx_t *tx);
+} sim_link_model_t;
+
+/* Graph, as adjacency lists in one array */
+static uint32_t nnodes;
+static uint32_t *adj_off;            /* nnodes + 1 */
+static uint32_t *adj;
+static sim_link_t *links;            /* parallel to adj */
+static uint32_t *component;
+static uint32_t *component_size;
+static vex_node_t *nodes;
+static uint64_t *radio_busy;         /* per node airtime */
+static uint64_t *timer_at;           /* per node pending EV_TIMER, 0 = none */
+
+/* Defaults for generated links and omitted topology fields */
+static double opt_latency_ms = 5.0, opt_jitter_ms = 1.0, opt_loss = 0.0;
+static double opt_kbps = 1000.0;
+
+static const sim_link_model_t *model;
+static sim_event_t *heap;
+static size_t heap_len, heap_cap;
+static uint64_t ev_seq, now_ns, events;
+static uint64_t rng_state;
+
+static sim_pkt_t *pkts;
+static uint32_t npkts;
+static int32_t injecting = -1;       /* packet vex_mesh_send is sending */
+static uint64_t *id_keys;            /* packet ID -> index, open addressing */
+static uint32_t *id_pkts;
+static uint32_t id_mask;
+static uint64_t frames_lost;
+
+static uint64_t rng_next(void) {
+    uint64_t z = (rng_state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static double rng_unit(void) {
+    return (double)(rng_next() >> 11) / 9007199254740992.0;
+}
+
+static uint64_t wall_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* ── Event queue: binary min-heap on (t, seq) ── */
+
+static int ev_before(const sim_event_t *a, const sim_event_t *b) {
+    return a->t < b->t || (a->t == b->t && a->seq < b->seq);
+}
+
+static int ev_push(uint64_t t, int kind, int32_t dst, int32_t src, sim_tx_t *tx) {
+    if (heap_len == heap_cap) {
+        size_t cap = heap_cap ? heap_cap * 2 : 4096;
+        sim_event_t *h = realloc(heap, cap * sizeof(*h));
+        if (!h) return -1;
+        heap = h;
+        heap_cap = cap;
+    }
+
+    size_t i = heap_len++;
+    sim_event_t ev = { t, ev_seq++, kind, dst, src, tx };
+    while (i > 0 && ev_before(&ev, &heap[(i - 1) / 2])) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = ev;
+    return 0;
+}
+
+static sim_event_t ev_pop(void) {
+    sim_event_t top = heap[0], last = heap[--heap_len];
+    size_t i = 0;
+    for (;;) {
+        size_t c = 2 * i + 1;
+        if (c >= heap_len) break;
+        if (c + 1 < heap_len && ev_before(&heap[c + 1], &heap[c])) c++;
+        if (!ev_before(&heap[c], &last)) break;
+        heap[i] = heap[c];
+        i = c;
+    }
+    if (heap_len > 0) heap[i] = last;
+    return top;
+}
+
+static void tx_put(sim_tx_t *tx) {
+    if (--tx->refs == 0) free(tx);
+}
+
+/* ── Link models ── */
+
+static uint64_t airtime_ns(uint32_t bytes_per_s, size_t len) {
+    return bytes_per_s ? (uint64_t)len * 1000000000ULL / bytes_per_s : 0;
+}
+
+static uint64_t jitter_ns(void) {
+    return opt_jitter_ms > 0 ? (uint64_t)(rng_unit() * opt_jitter_ms * 1e6) : 0;
+}
+
+/* Schedule one delivery over link e, unless the link loses it */
+static int link_deliver(uint32_t e, uint64_t sent_at, uint32_t from, sim_tx_t *tx) {
+    if (links[e].loss > 0 && rng_unit() < links[e].loss) {
+        frames_lost++;
+        return 0;
+    }
+    uint64_t at = sent_at + links[e].latency_ns + jitter_ns();
+    if (ev_push(at, EV_DELIVER, (int32_t)adj[e], (int32_t)from, tx) != 0) return 0;
+    tx->refs++;
+    return 1;
+}
+
+static int radio_transmit(uint32_t from, int except, sim_tx_t *tx) {
+    uint64_t start = radio_busy[from] > now_ns ? radio_busy[from] : now_ns;
+    uint64_t end = start + airtime_ns((uint32_t)(opt_kbps * 125.0), tx->len);
+    int receivers = 0;
+
+    radio_busy[from] = end;
+    pkts[tx->pkt].tx++;
+    for (uint32_t e = adj_off[from]; e < adj_off[from + 1]; e++) {
+        link_deliver(e, end, from, tx);
+        if ((int)adj[e] != except) receivers++;
+    }
+    return receivers;
+}
+
+static int wire_transmit(uint32_t from, int except, sim_tx_t *tx) {
+    int receivers = 0;
+
+    for (uint32_t e = adj_off[from]; e < adj_off[from + 1]; e++) {
+        if ((int)adj[e] == except) continue;
+        uint64_t start = links[e].busy_until > now_ns ? links[e].busy_until : now_ns;
+        links[e].busy_until = start + airtime_ns(links[e].bytes_per_s, tx->len);
+        pkts[tx->pkt].tx++;
+        link_deliver(e, links[e].busy_until, from, tx);
+        receivers++;
+    }
+    return receivers;
+}
+
+static const sim_link_model_t link_models[] = {
+    { "radio", radio_transmit },
+    { "wire",  wire_transmit },
+};
+
+/* Index of the packet with this wire ID; the first sighting, at
+ * injection, records it. Relays held by a node's policy come out of
+ * vex_mesh_tick, so the ID is the only reliable link back */
+static uint32_t pkt_of(const uint8_t *packet_id) {
+    uint64_t key;
+    memcpy(&key, packet_id, 8);
+    uint32_t i = (uint32_t)(key * 0x9e3779b97f4a7c15ULL >> 32) & id_mask;
+    while (id_keys[i] != key && id_pkts[i] != UINT32_MAX) i = (i + 1) & id_mask;
+    if (id_pkts[i] == UINT32_MAX) {
+        id_keys[i] = key;
+        id_pkts[i] = (uint32_t)injecting;
+    }
+    return id_pkts[i];
+}
+
+/* Transport fanout hook: every send_to_all of a simulated node lands here */
+static int on_fanout(void *ctx, vex_node_t *node, vex_pktbuf_t *b, int except_fd) {
+    (void)ctx;
+    size_t len = (size_t)b->len - 2;
+    if (len < VEX_HEADER_SIZE) return 0;
+    uint32_t pkt = pkt_of(b->data + 3);
+    if (pkt >= npkts) return 0;
+    sim_tx_t *tx = malloc(sizeof(*tx) + len);
+    if (!tx) return 0;
+
+    tx->refs = 1;
+    tx->pkt = pkt;
+    tx->len = (uint16_t)len;
+    memcpy(tx->data, b->data + 2, len);
+
+    int receivers = model->transmit((uint32_t)(node - nodes), except_fd, tx);
+    tx_put(tx);
+    return receivers;
+}
+
+/* ── Topology ── */
+
+typedef struct {
+    uint32_t a, b;
+    sim_link_t link;
+} sim_edge_t;
+
+static sim_edge_t *edges;
+static size_t nedges, edges_cap;
+
+static sim_link_t link_default(void) {
+    sim_link_t l = { 0, (uint32_t)(opt_latency_ms * 1e6), (uint32_t)(opt_kbps * 125.0),
+                     (float)opt_loss };
+    return l;
+}
+
+static int edge_add(uint32_t a, uint32_t b, sim_link_t link) {
+    if (nedges == edges_cap) {
+        size_t cap = edges_cap ? edges_cap * 2 : 4096;
+        sim_edge_t *e = realloc(edges, cap * sizeof(*e));
+        if (!e) return -1;
+        edges = e;
+        edges_cap = cap;
+    }
+    edges[nedges++] = (sim_edge_t){ a, b, link };
+    return 0;
+}
+
+/* Nodes uniform in the unit square, linked within radius; a grid of
+ * radius-sized cells keeps this linear in the node count */
+static int topology_random(uint32_t n, double radius) {
+    double *x = malloc(n * sizeof(*x)), *y = malloc(n * sizeof(*y));
+    uint32_t cells = radius > 0 ? (uint32_t)(1.0 / radius) : 1;
+    if (cells < 1) cells = 1;
+    if (cells > 4096) cells = 4096;
+    uint32_t *head = malloc((size_t)cells * cells * sizeof(*head));
+    uint32_t *next = malloc(n * sizeof(*next));
+    int rc = -1;
+    if (!x || !y || !head || !next) goto out;
+
+    for (size_t c = 0; c < (size_t)cells * cells; c++) head[c] = UINT32_MAX;
+    for (uint32_t i = 0; i < n; i++) {
+        x[i] = rng_unit();
+        y[i] = rng_unit();
+        size_t c = (size_t)(y[i] * cells) * cells + (size_t)(x[i] * cells);
+        next[i] = head[c];
+        head[c] = i;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        int cx = (int)(x[i] * cells), cy = (int)(y[i] * cells);
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                int gx = cx + dx, gy = cy + dy;
+                if (gx < 0 || gy < 0 || gx >= (int)cells || gy >= (int)cells) continue;
+                for (uint32_t j = head[(size_t)gy * cells + (size_t)gx]; j != UINT32_MAX; j = next[j]) {
+                    if (j <= i) continue;
+                    double ddx = x[i] - x[j], ddy = y[i] - y[j];
+                    if (ddx * ddx + ddy * ddy <= radius * radius &&
+                        edge_add(i, j, link_default()) != 0)
+                        goto out;
+                }
+            }
+        }
+    }
+    nnodes = n;
+    rc = 0;
+out:
+    free(x); free(y); free(head); free(next);
+    return rc;
+}
+
+static int topology_load(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Cannot open topology %s\n", path);
+        return -1;
+    }
+
+    char line[256];
+    int lineno = 0;
+    uint32_t max_id = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+
+        unsigned a, b;
+        double lat = opt_latency_ms, loss = opt_loss, kbps = opt_kbps;
+        int got = sscanf(line, "%u %u %lf %lf %lf", &a, &b, &lat, &loss, &kbps);
+        if (got <= 0) continue;
+        if (got < 2 || a == b || lat < 0 || loss < 0 || loss > 1 || kbps < 0) {
+            fprintf(stderr, "%s:%d: expected 'a b [latency_ms [loss [kbps]]]'\n", path, lineno);
+            fclose(f);
+            return -1;
+        }
+
+        sim_link_t link = { 0, (uint32_t)(lat * 1e6), (uint32_t)(kbps * 125.0), (float)loss };
+        if (edge_add(a, b, link) != 0) {
+            fclose(f);
+            return -1;
+        }
+        if (a > max_id) max_id = a;
+        if (b > max_id) max_id = b;
+    }
+    fclose(f);
+    nnodes = nedges ? max_id + 1 : 0;
+    return 0;
+}
+
+/* Turn the undirected edge list into per-node directed links, and label
+ * connected components */
+static int topology_build(void) {
+    adj_off = calloc(nnodes + 1, sizeof(*adj_off));
+    adj = malloc(2 * nedges * sizeof(*adj) + 1);
+    links = malloc(2 * nedges * sizeof(*links) + 1);
+    component = malloc(nnodes * sizeof(*component));
+    component_size = calloc(nnodes, sizeof(*component_size));
+    uint32_t *fill = calloc(nnodes, sizeof(*fill));
+    uint32_t *stack = malloc(nnodes * sizeof(*stack));
+    if (!adj_off || !adj || !links || !component || !component_size || !fill || !stack) {
+        free(fill);
+        free(stack);
+        return -1;
+    }
+
+    for (size_t i = 0; i < nedges; i++) {
+        adj_off[edges[i].a + 1]++;
+        adj_off[edges[i].b + 1]++;
+    }
+    for (uint32_t i = 0; i < nnodes; i++) adj_off[i + 1] += adj_off[i];
+    for (size_t i = 0; i < nedges; i++) {
+        uint32_t ea = adj_off[edges[i].a] + fill[edges[i].a]++;
+        uint32_t eb = adj_off[edges[i].b] + fill[edges[i].b]++;
+        adj[ea] = edges[i].b;
+        links[ea] = edges[i].link;
+        adj[eb] = edges[i].a;
+        links[eb] = edges[i].link;
+    }
+
+    for (uint32_t i = 0; i < nnodes; i++) component[i] = UINT32_MAX;
+    for (uint32_t root = 0; root < nnodes; root++) {
+        if (component[root] != UINT32_MAX) continue;
+        uint32_t top = 0;
+        stack[top++] = root;
+        component[root] = root;
+        while (top > 0) {
+            uint32_t v = stack[--top];
+            component_size[root]++;
+            for (uint32_t e = adj_off[v]; e < adj_off[v + 1]; e++) {
+                if (component[adj[e]] != UINT32_MAX) continue;
+                component[adj[e]] = root;
+                stack[top++] = adj[e];
+            }
+        }
+    }
+
+    free(fill);
+    free(stack);
+    free(edges);
+    edges = NULL;
+    return 0;
+}
+
+/* ── Nodes ── */
+
+static uint64_t sim_clock_ms(void) {
+    return now_ns / 1000000;
+}
+
+static int nodes_init(uint8_t ttl, int policy, int delay_ms, int count, double gossip_prob) {
+    nodes = calloc(nnodes, sizeof(*nodes));
+    radio_busy = calloc(nnodes, sizeof(*radio_busy));
+    timer_at = calloc(nnodes, sizeof(*timer_at));
+    if (!nodes || !radio_busy || !timer_at) return -1;
+
+    vex_node_t *first = &nodes[0];
+    vex_crypto_derive_mesh_key(first);
+    for (uint32_t i = 0; i < nnodes; i++) {
+        vex_node_t *n = &nodes[i];
+        memcpy(n->mesh_key, first->mesh_key, sizeof(n->mesh_key));
+        snprintf(n->node_name, sizeof(n->node_name), "sim-%u", i);
+        n->default_ttl = ttl;
+        n->relay_enabled = 1;
+        n->running = 1;
+        n->listen_fd = -1;
+        n->started_at = time(NULL);
+        vex_seen_init(&n->seen);
+        if (vex_mesh_set_relay_policy(n, policy, delay_ms, count, gossip_prob) != 0) return -1;
+    }
+    return 0;
+}
+
+/* Wake the node when its earliest held relay comes due */
+static void timer_arm(uint32_t n) {
+    uint64_t due = vex_mesh_next_due(&nodes[n]);
+    if (!due) return;
+
+    uint64_t at = due * 1000000ULL;
+    if (at < now_ns) at = now_ns;
+    if (timer_at[n] && timer_at[n] <= at) return;
+    timer_at[n] = at;
+    ev_push(at, EV_TIMER, (int32_t)n, -1, NULL);
+}
+
+static void run_event(const sim_event_t *ev) {
+    now_ns = ev->t;
+    events++;
+
+    if (ev->kind == EV_INJECT) {
+        char msg[32];
+        injecting = ev->src;
+        snprintf(msg, sizeof(msg), "sim packet %d", injecting);
+        vex_mesh_send(&nodes[ev->dst], msg);
+        injecting = -1;
+        return;
+    }
+    if (ev->kind == EV_TIMER) {
+        if (timer_at[ev->dst] != ev->t) return;      /* superseded by an earlier one */
+        timer_at[ev->dst] = 0;
+        vex_mesh_tick(&nodes[ev->dst]);
+        timer_arm((uint32_t)ev->dst);
+        return;
+    }
+
+    sim_tx_t *tx = ev->tx;
+    sim_pkt_t *p = &pkts[tx->pkt];
+    vex_node_t *n = &nodes[ev->dst];
+    uint8_t raw[VEX_MAX_PACKET];
+    uint64_t before = n->packets_received;
+
+    memcpy(raw, tx->data, tx->len);      /* relaying rewrites the TTL in place */
+    uint32_t hops = (uint32_t)(n->default_ttl - raw[VEX_TTL_OFFSET] + 1);
+    vex_mesh_receive(n, raw, tx->len, ev->src);
+    timer_arm((uint32_t)ev->dst);
+
+    p->rx++;
+    if (n->packets_received != before) {
+        p->reached++;
+        p->settle_ns = now_ns - p->injected_ns;
+        if (hops > p->max_hops) p->max_hops = hops;
+    }
+    tx_put(tx);
+}
+
+/* ── Report ── */
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void report(FILE *out, const char *topo, double wall_s, int per_packet, int json) {
+    uint64_t tx = 0, rx = 0, reached = 0, reachable = 0, hops = 0, settle = 0;
+    uint32_t full = 0, largest = 0;
+    double *cov = malloc((npkts ? npkts : 1) * sizeof(*cov));
+    double others = nnodes > 1 ? (double)(nnodes - 1) : 1.0;
+
+    for (uint32_t i = 0; i < nnodes; i++)
+        if (component_size[i] > largest) largest = component_size[i];
+
+    for (uint32_t i = 0; i < npkts; i++) {
+        sim_pkt_t *p = &pkts[i];
+        tx += p->tx;
+        rx += p->rx;
+        reached += p->reached;
+        reachable += p->reachable;
+        hops += p->max_hops;
+        settle += p->settle_ns;
+        if (p->reached == p->reachable) full++;
+        if (cov) cov[i] = 100.0 * p->reached / others;
+        if (per_packet && !json)
+            fprintf(out, "[SIM] pkt %u origin %u: %u/%u reached (%.1f%%), %llu tx, %llu rx, "
+                    "%u hops, settled %.2fms\n",
+                    i, p->origin, p->reached, p->reachable, 100.0 * p->reached / others,
+                    (unsigned long long)p->tx, (unsigned long long)p->rx, p->max_hops,
+                    (double)p->settle_ns / 1e6);
+    }
+    if (cov) qsort(cov, npkts, sizeof(*cov), cmp_double);
+
+    double n = npkts ? (double)npkts : 1.0;
+    double cov_mean = 100.0 * (double)reached / n / others;
+    double cov_min = cov && npkts ? cov[0] : 0.0;
+    double cov_p50 = cov && npkts ? cov[npkts / 2] : 0.0;
+    double cov_reach = reachable ? 100.0 * (double)reached / (double)reachable : 0.0;
+    double tx_per = reached ? (double)tx / (double)reached : 0.0;
+    double dup_per = reached ? (double)(rx - reached) / (double)reached : 0.0;
+    double ev_rate = wall_s > 0 ? (double)events / wall_s : 0.0;
+    size_t degree_sum = adj_off[nnodes];
+    uint64_t relayed = 0, held = 0, suppressed = 0;
+    for (uint32_t i = 0; i < nnodes; i++) {
+        relayed += nodes[i].packets_relayed;
+        held += nodes[i].relays_deferred;
+        suppressed += nodes[i].relays_suppressed;
+    }
+    double saved = relayed + suppressed ? 100.0 * (double)suppressed / (double)(relayed + suppressed)
+                                        : 0.0;
+    const char *policy = vex_mesh_relay_policy_name(nodes[0].relay_policy);
+    free(cov);
+
+    if (json) {
+        fprintf(out, "{\"nodes\":%u,\"links\":%zu,\"largest_component\":%u,\"link_model\":\"%s\","
+                "\"relay_policy\":\"%s\",\"relays\":%llu,\"relays_held\":%llu,"
+                "\"relays_suppressed\":%llu,\"relays_saved_pct\":%.2f,\"packets\":%u,\"coverage_mean_pct\":%.2f,\"coverage_min_pct\":%.2f,"
+                "\"coverage_p50_pct\":%.2f,\"coverage_reachable_pct\":%.2f,\"full_coverage\":%u,"
+                "\"transmissions\":%llu,\"tx_per_delivery\":%.3f,\"receptions\":%llu,"
+                "\"redundant_rx_per_delivery\":%.3f,\"frames_lost\":%llu,\"mean_max_hops\":%.2f,"
+                "\"mean_settle_ms\":%.3f,\"events\":%llu,\"sim_seconds\":%.3f,"
+                "\"wall_seconds\":%.3f,\"events_per_sec\":%.0f}\n",
+                nnodes, degree_sum / 2, largest, model->name, policy,
+                (unsigned long long)relayed, (unsigned long long)held,
+                (unsigned long long)suppressed, saved, npkts, cov_mean, cov_min,
+                cov_p50, cov_reach, full, (unsigned long long)tx, tx_per,
+                (unsigned long long)rx, dup_per, (unsigned long long)frames_lost,
+                (double)hops / n, (double)settle / n / 1e6, (unsigned long long)events,
+                (double)now_ns / 1e9, wall_s, ev_rate);
+        return;
+    }
+
+    fprintf(out, "[SIM] Topology: %s, %u nodes, %zu links, mean degree %.1f, largest component %u\n",
+            topo, nnodes, degree_sum / 2, nnodes ? (double)degree_sum / nnodes : 0.0, largest);
+    fprintf(out, "[SIM] Link: %s | TTL %d | %u packets\n",
+            model->name, nnodes ? nodes[0].default_ttl : 0, npkts);
+    fprintf(out, "[SIM] Relay: %s | Relays: %llu | Held: %llu | Suppressed: %llu "
+            "(%.1f%% of relays saved)\n", policy, (unsigned long long)relayed,
+            (unsigned long long)held, (unsigned long long)suppressed, saved);
+    fprintf(out, "[SIM] Coverage: mean %.1f%% | min %.1f%% | p50 %.1f%% | of reachable %.1f%% | "
+            "full %u/%u\n", cov_mean, cov_min, cov_p50, cov_reach, full, npkts);
+    fprintf(out, "[SIM] Transmissions: %llu (%.2f per delivery) | Receptions: %llu "
+            "(%.2f redundant per delivery) | Lost frames: %llu\n",
+            (unsigned long long)tx, tx_per, (unsigned long long)rx, dup_per,
+            (unsigned long long)frames_lost);
+    fprintf(out, "[SIM] Hops: mean max %.1f | Settle: mean %.2fms simulated\n",
+            (double)hops / n, (double)settle / n / 1e6);
+    fprintf(out, "[SIM] Events: %llu in %.2fs wall (%.0f events/s), %.3fs simulated\n",
+            (unsigned long long)events, wall_s, ev_rate, (double)now_ns / 1e9);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n\n"
+            "  --nodes N         Random geometric graph of N nodes (default: 1000)\n"
+            "  --degree D        Radius giving mean degree D (default: 8)\n"
+            "  --radius R        Link radius in the unit square instead of --degree\n"
+            "  --topology FILE   Edge list 'a b [latency_ms [loss [kbps]]]' instead\n"
+            "  --link MODEL      radio (broadcast) or wire (per link) (default: radio)\n"
+            "  --latency MS      Link latency (default: 5)\n"
+            "  --jitter MS       Extra uniform delay per delivery, up to MS (default: 1)\n"
+            "  --loss P          Per-delivery loss probability (default: 0)\n"
+            "  --bandwidth KBPS  Link bandwidth in kbit/s, 0 = unlimited (default: 1000)\n"
+            "  --ttl N           TTL of injected packets (default: %d)\n"
+            "  --packets P       Packets to inject from random nodes (default: 100)\n"
+            "  --interval MS     Time between injections (default: 50)\n"
+            "  --seed S          Topology, origin and loss seed (default: 1)\n"
+            "  --relay-policy P  Every node relays by flood, counter or gossip\n"
+            "                    (default: flood)\n"
+            "  --relay-delay MS  Counter: longest random hold (default: %d)\n"
+            "  --relay-count N   Counter: copies heard that cancel a relay (default: %d)\n"
+            "  --gossip-prob P   Gossip: chance of relaying (default: %g)\n"
+            "  --per-packet      A line per packet as well as the summary\n"
+            "  --json            Summary as one JSON line\n"
+            "  --verbose         Keep the nodes' own log output\n",
+            prog, VEX_DEFAULT_TTL, VEX_RELAY_DEFAULT_DELAY_MS, VEX_RELAY_DEFAULT_COUNT,
+            VEX_GOSSIP_DEFAULT_PROB);
+}
+
+int main(int argc, char **argv) {
+    const char *topology = NULL, *link_name = "radio";
+    uint32_t nodes_opt = 1000, packets = 100;
+    double degree = 8.0, radius = 0.0, interval_ms = 50.0;
+    int ttl = VEX_DEFAULT_TTL, per_packet = 0, json = 0, verbose = 0;
+    int policy = VEX_RELAY_FLOOD, relay_delay = VEX_RELAY_DEFAULT_DELAY_MS;
+    int relay_count = VEX_RELAY_DEFAULT_COUNT;
+    double gossip_prob = VEX_GOSSIP_DEFAULT_PROB;
+    uint64_t seed = 1;
+
+    static struct option long_opts[] = {
+        {"nodes",      required_argument, 0, 'n'},
+        {"degree",     required_argument, 0, 'g'},
+        {"radius",     required_argument, 0, 'R'},
+        {"topology",   required_argument, 0, 'T'},
+        {"link",       required_argument, 0, 'L'},
+        {"latency",    required_argument, 0, 'l'},
+        {"jitter",     required_argument, 0, 'J'},
+        {"loss",       required_argument, 0, 'x'},
+        {"bandwidth",  required_argument, 0, 'b'},
+        {"ttl",        required_argument, 0, 't'},
+        {"packets",    required_argument, 0, 'p'},
+        {"interval",   required_argument, 0, 'i'},
+        {"seed",       required_argument, 0, 's'},
+        {"relay-policy", required_argument, 0, 'r'},
+        {"relay-delay", required_argument, 0, 'd'},
+        {"relay-count", required_argument, 0, 'C'},
+        {"gossip-prob", required_argument, 0, 'G'},
+        {"per-packet", no_argument,       0, 'P'},
+        {"json",       no_argument,       0, 'j'},
+        {"verbose",    no_argument,       0, 'v'},
+        {"help",       no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:g:R:T:L:l:J:x:b:t:p:i:s:r:d:C:G:Pjvh", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'n': nodes_opt = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'g': degree = atof(optarg); break;
+            case 'R': radius = atof(optarg); break;
+            case 'T': topology = optarg; break;
+            case 'L': link_name = optarg; break;
+            case 'l': opt_latency_ms = atof(optarg); break;
+            case 'J': opt_jitter_ms = atof(optarg); break;
+            case 'x': opt_loss = atof(optarg); break;
+            case 'b': opt_kbps = atof(optarg); break;
+            case 't': ttl = atoi(optarg); break;
+            case 'p': packets = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'i': interval_ms = atof(optarg); break;
+            case 's': seed = strtoull(optarg, NULL, 10); break;
+            case 'r':
+                if (strcmp(optarg, "flood") == 0) policy = VEX_RELAY_FLOOD;
+                else if (strcmp(optarg, "counter") == 0) policy = VEX_RELAY_COUNTER;
+                else if (strcmp(optarg, "gossip") == 0) policy = VEX_RELAY_GOSSIP;
+                else policy = -1;
+                break;
+            case 'd': relay_delay = atoi(optarg); break;
+            case 'C': relay_count = atoi(optarg); break;
+            case 'G': gossip_prob = atof(optarg); break;
+            case 'P': per_packet = 1; break;
+            case 'j': json = 1; break;
+            case 'v': verbose = 1; break;
+            case 'h':
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(link_models) / sizeof(link_models[0]); i++)
+        if (strcmp(link_name, link_models[i].name) == 0) model = &link_models[i];
+
+    if (!model || policy < 0 || ttl < 1 || ttl > 255 || opt_latency_ms < 0 || opt_jitter_ms < 0 ||
+        opt_loss < 0 || opt_loss > 1 || opt_kbps < 0 || interval_ms < 0 || degree <= 0 ||
+        radius < 0 || (!topology && nodes_opt < 2)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    rng_state = seed;
+    char topo[64];
+    if (topology) {
+        if (topology_load(topology) != 0) return 1;
+        snprintf(topo, sizeof(topo), "file");
+    } else {
+        if (radius == 0) radius = sqrt(degree / (3.14159265358979 * (double)nodes_opt));
+        if (topology_random(nodes_opt, radius) != 0) {
+            fprintf(stderr, "Out of memory building the graph\n");
+            return 1;
+        }
+        snprintf(topo, sizeof(topo), "random geometric r=%.4f", radius);
+    }
+    if (nnodes < 2 || topology_build() != 0) {
+        fprintf(stderr, "Topology needs at least two nodes and memory for them\n");
+        return 1;
+    }
+    if (nodes_init((uint8_t)ttl, policy, relay_delay, relay_count, gossip_prob) != 0) {
+        fprintf(stderr, "Out of memory for nodes, or bad relay policy settings\n");
+        return 1;
+    }
+
+    id_mask = 1;
+    while (id_mask < 2 * packets) id_mask <<= 1;
+    id_keys = malloc(id_mask * sizeof(*id_keys));
+    id_pkts = malloc(id_mask * sizeof(*id_pkts));
+    pkts = calloc(packets ? packets : 1, sizeof(*pkts));
+    if (!pkts || !id_keys || !id_pkts) return 1;
+    memset(id_pkts, 0xff, id_mask * sizeof(*id_pkts));
+    id_mask--;
+    npkts = packets;
+    for (uint32_t i = 0; i < npkts; i++) {
+        sim_pkt_t *p = &pkts[i];
+        p->origin = (uint32_t)(rng_next() % nnodes);
+        p->reachable = component_size[component[p->origin]] - 1;
+        p->injected_ns = (uint64_t)((double)i * interval_ms * 1e6);
+        ev_push(p->injected_ns, EV_INJECT, (int32_t)p->origin, (int32_t)i, NULL);
+    }
+
+    /* Nodes print every decrypted message and log every relay; keep the
+     * report on the real stdout and send the rest to /dev/null */
+    FILE *out = stdout;
+    if (!verbose) {
+        fflush(stdout);
+        int saved = dup(STDOUT_FILENO);
+        int devnull = open("/dev/null", O_WRONLY);
+        if (saved >= 0 && devnull >= 0) {
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+            out = fdopen(saved, "w");
+        }
+    }
+
+    vex_transport_set_fanout_hook(on_fanout, NULL);
+    vex_mesh_set_clock(sim_clock_ms);
+    uint64_t start = wall_ns();
+    while (heap_len > 0) {
+        sim_event_t ev = ev_pop();
+        run_event(&ev);
+    }
+    double wall_s = (double)(wall_ns() - start) / 1e9;
+    vex_transport_set_fanout_hook(NULL, NULL);
+    vex_mesh_set_clock(NULL);
+
+    report(out, topo, wall_s, per_packet, json);
+    fflush(out);
+
+    for (uint32_t i = 0; i < nnodes; i++)
+        free(nodes[i].relay_queue);
+    free(nodes);
+    free(radio_busy);
+    free(timer_at);
+    free(id_keys);
+    free(id_pkts);
+    free(adj_off);
+    free(adj);
+    free(links);
+    free(component);
+    free(component_size);
+    free(heap);
+    free(pkts);
+    return 0;
+}